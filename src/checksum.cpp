@@ -0,0 +1,157 @@
+#include "checksum.h"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define MINIGIT_HW_CRC32C
+#define MINIGIT_TARGET_SSE42 __attribute__((target("sse4.2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define MINIGIT_HW_CRC32C
+#define MINIGIT_TARGET_SSE42
+#endif
+
+namespace {
+constexpr uint32_t CRC32_POLY = 0xEDB88320;	 // IEEE，反射形式
+constexpr uint32_t CRC32C_POLY = 0x82F63B78; // Castagnoli，反射形式
+
+// slicing-by-8 查表：table[k][b] 为字节 b 之后再经过 k 个0字节的余数
+struct SliceTable {
+	uint32_t table[8][256];
+
+	explicit SliceTable(uint32_t poly) {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+			table[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; ++i)
+			for (int k = 1; k < 8; ++k)
+				table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+	}
+};
+
+const SliceTable &sliceTable(ChecksumType type) {
+	static const SliceTable crc32(CRC32_POLY);
+	static const SliceTable crc32c(CRC32C_POLY);
+	return type == ChecksumType::Crc32c ? crc32c : crc32;
+}
+
+inline uint32_t load32(const uint8_t *p) {
+	return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+// c 为取反后的中间值
+uint32_t crcSliced(const SliceTable &t, uint32_t c, const uint8_t *p, size_t size) {
+	const auto &T = t.table;
+	while (size >= 8) {
+		uint32_t one = c ^ load32(p);
+		uint32_t two = load32(p + 4);
+		c = T[7][one & 0xFF] ^ T[6][(one >> 8) & 0xFF] ^ T[5][(one >> 16) & 0xFF] ^
+			T[4][one >> 24] ^ T[3][two & 0xFF] ^ T[2][(two >> 8) & 0xFF] ^
+			T[1][(two >> 16) & 0xFF] ^ T[0][two >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size--)
+		c = (c >> 8) ^ T[0][(c ^ *p++) & 0xFF];
+	return c;
+}
+
+#ifdef MINIGIT_HW_CRC32C
+MINIGIT_TARGET_SSE42 uint32_t crc32cHardware(uint32_t c, const uint8_t *p, size_t size) {
+	uint64_t c64 = c;
+	while (size >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c64 = _mm_crc32_u64(c64, v);
+		p += 8;
+		size -= 8;
+	}
+	c = static_cast<uint32_t>(c64);
+	while (size--)
+		c = _mm_crc32_u8(c, *p++);
+	return c;
+}
+
+bool hasSse42() {
+#ifdef _MSC_VER
+	static const bool supported = [] {
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 20)) != 0;
+	}();
+#else
+	static const bool supported = __builtin_cpu_supports("sse4.2");
+#endif
+	return supported;
+}
+#endif
+} // namespace
+
+Checksum::Checksum(ChecksumType type) : kind(type) {
+	reset();
+}
+
+void Checksum::reset() {
+	crc = 0;
+	if (kind == ChecksumType::Xxh32)
+		XXH32_reset(&xxh, 0);
+}
+
+void Checksum::update(const uint8_t *data, size_t size) {
+	switch (kind) {
+	case ChecksumType::Xxh32:
+		XXH32_update(&xxh, data, size);
+		return;
+	case ChecksumType::Crc32c:
+#ifdef MINIGIT_HW_CRC32C
+		if (hasSse42()) {
+			crc = ~crc32cHardware(~crc, data, size);
+			return;
+		}
+#endif
+		crc = ~crcSliced(sliceTable(kind), ~crc, data, size);
+		return;
+	default:
+		crc = ~crcSliced(sliceTable(kind), ~crc, data, size);
+		return;
+	}
+}
+
+uint32_t Checksum::value() const {
+	return kind == ChecksumType::Xxh32 ? XXH32_digest(&xxh) : crc;
+}
+
+uint32_t Checksum::compute(ChecksumType type, const uint8_t *data, size_t size) {
+	if (type == ChecksumType::Xxh32)
+		return XXH32(data, size, 0);
+	Checksum c(type);
+	c.update(data, size);
+	return c.value();
+}
+
+bool Checksum::parse(const string &name, ChecksumType &type) {
+	if (name == "crc32")
+		type = ChecksumType::Crc32;
+	else if (name == "crc32c")
+		type = ChecksumType::Crc32c;
+	else if (name == "xxh32")
+		type = ChecksumType::Xxh32;
+	else
+		return false;
+	return true;
+}
+
+string Checksum::name(ChecksumType type) {
+	switch (type) {
+	case ChecksumType::Crc32c:
+		return "crc32c";
+	case ChecksumType::Xxh32:
+		return "xxh32";
+	default:
+		return "crc32";
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "common.h"
+
+#ifndef XXH_STATIC_LINKING_ONLY
+#define XXH_STATIC_LINKING_ONLY
+#endif
+#include <xxhash.h>
+
+// 校验和算法，取值写入消息头和归档头
+enum class ChecksumType : uint8_t {
+	Crc32 = 0,	// CRC32（IEEE），旧版本只支持这一种
+	Crc32c = 1, // CRC32C（Castagnoli），支持 SSE4.2 的 CPU 上用硬件指令计算
+	Xxh32 = 2,	// xxHash32，不依赖特定指令集，速度最快
+};
+
+/**
+ * 可分段计算的32位校验和
+ * CRC32 和不支持 SSE4.2 时的 CRC32C 使用 slicing-by-8 查表，每次处理8个字节
+ */
+class Checksum {
+public:
+	explicit Checksum(ChecksumType type = ChecksumType::Crc32);
+
+	void reset();
+	void update(const uint8_t *data, size_t size);
+	uint32_t value() const;
+	ChecksumType type() const { return kind; }
+
+	static uint32_t compute(ChecksumType type, const uint8_t *data, size_t size);
+	static uint32_t compute(ChecksumType type, const vector<uint8_t> &data) {
+		return compute(type, data.data(), data.size());
+	}
+
+	static bool supported(uint8_t type) { return type <= static_cast<uint8_t>(ChecksumType::Xxh32); }
+	// 解析 "crc32"、"crc32c"、"xxh32"
+	static bool parse(const string &name, ChecksumType &type);
+	static string name(ChecksumType type);
+
+private:
+	ChecksumType kind;
+	uint32_t crc = 0;
+	XXH32_state_t xxh;
+};
@@ -3,13 +3,16 @@
 #include <cstring>
 
 #include "commit.h"
+#include "commit_graph.h"
 #include "crypto.h"
 #include <iostream>
 #include <sstream>
 
 #include "compression.h"
 #include "filesystem_utils.h"
+#include "objects.h"
 #include "progress.h"
+#include "shallow.h"
 
 #include "utils.h"
 
@@ -136,12 +139,19 @@ bool Client::authenticate() {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive authentication response\n";
 		connected_ = false; // 标记连接断开
 		return false;
 	}
 
+	if (response.header.type == MessageType::ERROR_MSG && !response.payload.empty()) {
+		// 错误消息为状态码加错误文本
+		cerr << "Error: "
+			 << string(response.payload.begin() + 1, response.payload.end()) << "\n";
+		return false;
+	}
+
 	if (response.header.type != MessageType::AUTH_RESPONSE) {
 		cerr << "Invalid authentication response\n";
 		return false;
@@ -185,7 +195,7 @@ bool Client::login() {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive login response\n";
 		connected_ = false;
 		return false;
@@ -221,7 +231,7 @@ vector<string> Client::listRepositories() {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive list repositories response\n";
 		return repos;
 	}
@@ -280,7 +290,7 @@ vector<string> Client::log(int max_count, bool line) {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive log response\n";
 		return log_entries;
 	}
@@ -362,7 +372,7 @@ bool Client::useRepository(const string &repo_name) {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive use repository response\n";
 		return false;
 	}
@@ -401,7 +411,7 @@ bool Client::createRepository(const string &repo_name) {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive create repository response\n";
 		return false;
 	}
@@ -437,7 +447,7 @@ bool Client::removeRepository(const string &repo_name) {
 	}
 
 	ProtocolMessage response;
-	if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+	if (!receiveMessage(response)) {
 		cerr << "Failed to receive remove repository response\n";
 		return false;
 	}
@@ -473,6 +483,10 @@ bool Client::push() {
 		return false;
 	}
 
+	if (!negotiateCompression()) {
+		return false;
+	}
+
 	// 获取本地HEAD
 	string local_head =
 		FileSystemUtils::getInstance().readText(FileSystemUtils::getInstance().headPath());
@@ -490,9 +504,10 @@ bool Client::push() {
 
 	// 获取当前本地最新commit的父节点
 	if (!local_head.empty()) {
-		auto commit_opt = CommitManager::loadCommit(local_head);
-		if (commit_opt) {
-			commit_parent = commit_opt->parent;
+		CommitGraph::Entry entry;
+		if (CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir())
+				->find(local_head, entry)) {
+			commit_parent = entry.parent;
 		}
 	}
 
@@ -506,7 +521,7 @@ bool Client::push() {
 
 	// 接收push检查响应
 	ProtocolMessage check_response;
-	if (!NetworkUtils::receiveMessage(client_socket_, check_response)) {
+	if (!receiveMessage(check_response)) {
 		cerr << "Failed to receive push check response\n";
 		return false;
 	}
@@ -563,7 +578,9 @@ bool Client::push() {
 	std::string last_commit_id;
 	vector<fs::path> files_to_push;
 	vector<fs::path> relative_paths;
+	vector<string> candidates;
 
+	fs::path objects_dir = FileSystemUtils::getInstance().objectsDir();
 	for (const string &commit_id : commits_to_upload) {
 		// package all commit file
 		cout << "Uploading commit " << commit_id.substr(0, 12) << "...\n";
@@ -573,50 +590,62 @@ bool Client::push() {
 		//     return false;
 		// }
 
-		// 上传commit中的所有对象
-		auto commit_opt = CommitManager::loadCommit(commit_id);
-		if (!commit_opt) {
+		// 上传commit相对父提交新增的对象（变化的树对象和文件）
+		if (!CommitManager::loadCommitHeader(commit_id)) {
 			cerr << "Cannot load commit " << commit_id << "\n";
 			return false;
 		}
-		for (const auto &tree_item : commit_opt->tree) {
-			files_to_push.push_back(tree_item.second);
-			relative_paths.push_back(fs::path("objects") / tree_item.second);
-		}
+		auto introduced = CommitManager::objectsIntroduced(objects_dir, commit_id);
+		candidates.insert(candidates.end(), introduced.begin(), introduced.end());
 		// 将commit文件也加入上传列表
-		fs::path commit_path =
-			FileSystemUtils::getInstance().repoRoot() / ".minigit" / "objects" / commit_id;
-		files_to_push.push_back(commit_path);
-		relative_paths.push_back(fs::path("objects") / commit_id);
-	}
-	if (files_to_push.empty()) {
-		cout << "No files to push\n";
-		return true;
-	}
-	cout << "compress " << files_to_push.size() << " file(s)...\n";
-	vector<uint8_t> compressed_archive;
-	uint32_t raw_size;
-	bool compression_success = CompressionUtils::createCompressedArchive(
-		relative_paths, FileSystemUtils::getInstance().repoRoot() / ".minigit", compressed_archive,
-		raw_size, [](int progress, const string &description) {
-			ProgressDisplay::showCompressionProgress(progress, "compress", description);
-		});
-	ProgressDisplay::finish();
-	if (!compression_success) {
-		cerr << "Compression failed\n";
-		return false;
-	}
-	cout << "uploading commit(s) (" << ProgressDisplay::formatFileSize(compressed_archive.size())
-		 << ")...\n";
-	auto commit_push = ProtocolMessage::createPushObjectDataCompressed(
-		MessageType::PUSH_OBJECT_DATA_COMPRESSED, 0, compressed_archive, raw_size,
-		files_to_push.size());
-	if (!NetworkUtils::sendMessage(
-			client_socket_, commit_push, [raw_size](int progress, const string &description) {
-				ProgressDisplay::showTransferProgress(progress, raw_size, description);
-			})) {
-		cerr << "Failed to send commit compress data for " << last_commit_id << "\n";
-		return false;
+		candidates.push_back(commit_id);
+	}
+
+	// 去掉重复的对象，再只保留服务器缺少的对象
+	set<string> seen;
+	candidates.erase(remove_if(candidates.begin(), candidates.end(),
+							   [&seen](const string &id) { return !seen.insert(id).second; }),
+					 candidates.end());
+	size_t candidate_count = candidates.size();
+	if (!negotiateMissingObjects(candidates)) {
+		cerr << "Object negotiation failed\n";
+		return false;
+	}
+	cout << candidates.size() << " of " << candidate_count << " object(s) missing on server\n";
+	for (const auto &object_id : candidates) {
+		files_to_push.push_back(FileSystemUtils::getInstance().objectPath(object_id));
+		relative_paths.push_back(FileSystemUtils::objectRelativePath(object_id));
+	}
+	// 服务器已有全部对象时（例如上次推送只差更新HEAD）直接更新HEAD
+	if (!files_to_push.empty()) {
+		cout << "compress and upload " << files_to_push.size() << " file(s)...\n";
+		// 边压缩边发送，每段压缩数据单独作为一条消息
+		uint32_t file_count = static_cast<uint32_t>(files_to_push.size());
+		uint64_t raw_size = 0;
+		uint64_t sent_size = 0;
+		auto send_chunk = [&](const vector<uint8_t> &chunk) {
+			sent_size += chunk.size();
+			auto msg = ProtocolMessage::createPushObjectDataCompressed(
+				MessageType::PUSH_OBJECT_DATA_COMPRESSED, ARCHIVE_STREAM_CHUNK, chunk, 0,
+				file_count, Config::getInstance().checksum);
+			return NetworkUtils::sendMessage(client_socket_, msg);
+		};
+		bool compression_success = CompressionUtils::streamCompressedArchive(
+			relative_paths, FileSystemUtils::getInstance().repoRoot() / ".minigit", send_chunk,
+			raw_size,
+			[](int progress, const string &description) {
+				ProgressDisplay::showCompressionProgress(progress, "compress", description);
+			},
+			Objects::archiveLoader(objects_dir), compression_, Config::getInstance().checksum);
+		ProgressDisplay::finish();
+		auto archive_end = ProtocolMessage::createPushObjectDataCompressed(
+			MessageType::PUSH_OBJECT_DATA_COMPRESSED, ARCHIVE_STREAM_END, {}, raw_size, file_count,
+			Config::getInstance().checksum);
+		if (!compression_success || !NetworkUtils::sendMessage(client_socket_, archive_end)) {
+			cerr << "Failed to send commit compress data for " << last_commit_id << "\n";
+			return false;
+		}
+		cout << "uploaded commit(s) (" << ProgressDisplay::formatFileSize(sent_size) << ")\n";
 	}
 	// 发送推送请求（通知服务器更新HEAD）
 	auto push_request = ProtocolMessage::createPushRequest(last_commit_id);
@@ -627,7 +656,7 @@ bool Client::push() {
 
 	// 接收推送响应
 	ProtocolMessage push_response;
-	if (!NetworkUtils::receiveMessage(client_socket_, push_response)) {
+	if (!receiveMessage(push_response)) {
 		cerr << "Failed to receive push response\n";
 		return false;
 	}
@@ -636,13 +665,55 @@ bool Client::push() {
 		cout << "Push completed successfully!\n";
 		return true;
 	} else if (push_response.header.type == MessageType::ERROR_MSG) {
-		cerr << "Error: " << push_response.getStringPayload() << "\n";
+		// 错误消息为状态码加错误文本（例如其他客户端先完成了推送）
+		if (!push_response.payload.empty())
+			cerr << "Error: "
+				 << string(push_response.payload.begin() + 1, push_response.payload.end())
+				 << "\n";
 		return false;
 	}
 
 	return false;
 }
 
+// 压缩方式协商
+bool Client::negotiateCompression() {
+	const string &spec = Config::getInstance().compression;
+	if (spec.empty()) {
+		return true;
+	}
+	CompressionOptions requested;
+	if (!CompressionOptions::parse(spec, requested)) {
+		cerr << "Invalid compression: " << spec << "\n";
+		return false;
+	}
+
+	auto request = ProtocolMessage::createCompressionMessage(
+		MessageType::COMPRESSION_REQUEST, static_cast<uint8_t>(requested.codec), requested.level);
+	ProtocolMessage response;
+	if (!NetworkUtils::sendMessage(client_socket_, request) ||
+		!receiveMessage(response)) {
+		cerr << "Failed to negotiate compression\n";
+		return false;
+	}
+	if (response.header.type == MessageType::ERROR_MSG) {
+		cerr << "Error: " << response.getStringPayload() << "\n";
+		return false;
+	}
+	if (response.header.type != MessageType::COMPRESSION_RESPONSE ||
+		response.payload.size() < sizeof(CompressionPayload)) {
+		cerr << "Invalid compression response\n";
+		return false;
+	}
+	CompressionPayload payload;
+	memcpy(&payload, response.payload.data(), sizeof(CompressionPayload));
+	compression_.codec = static_cast<CompressionCodec>(payload.codec);
+	compression_.level = payload.level;
+	compression_ = compression_.clamped();
+	cout << "Compression: " << compression_.toString() << "\n";
+	return true;
+}
+
 // Pull操作
 bool Client::pull() {
 	if (!authenticated_) {
@@ -660,6 +731,10 @@ bool Client::pull() {
 		return false;
 	}
 
+	if (!negotiateCompression()) {
+		return false;
+	}
+
 	// 获取本地HEAD
 	string local_head =
 		FileSystemUtils::getInstance().readText(FileSystemUtils::getInstance().headPath());
@@ -667,8 +742,9 @@ bool Client::pull() {
 	cout << "Checking what to pull (local HEAD: "
 		 << (local_head.empty() ? "(none)" : local_head.substr(0, 12)) << ")...\n";
 
-	// 发送pull检查请求
-	auto check_request = ProtocolMessage::createPullCheckRequest(local_head);
+	// 发送pull检查请求，浅克隆要告诉服务器边界之前的历史本地并没有
+	auto check_request = ProtocolMessage::createPullCheckRequest(
+		local_head, Shallow::read(FileSystemUtils::getInstance().mgDir()));
 	if (!NetworkUtils::sendMessage(client_socket_, check_request)) {
 		cerr << "Failed to send pull check request\n";
 		return false;
@@ -676,7 +752,7 @@ bool Client::pull() {
 
 	// 接收pull检查响应
 	ProtocolMessage check_response;
-	if (!NetworkUtils::receiveMessage(client_socket_, check_response)) {
+	if (!receiveMessage(check_response)) {
 		cerr << "Failed to receive pull check response\n";
 		return false;
 	}
@@ -726,7 +802,7 @@ bool Client::pull() {
 	// 接收下发的所有对象
 	while (true) {
 		ProtocolMessage obj_msg;
-		if (!NetworkUtils::receiveMessage(client_socket_, obj_msg)) {
+		if (!receiveMessage(obj_msg)) {
 			cerr << "Failed to receive message\n";
 			return false;
 		}
@@ -749,7 +825,7 @@ bool Client::pull() {
 	}
 
 	// 接收最后的拉取响应
-	if (!NetworkUtils::receiveMessage(client_socket_, pull_response)) {
+	if (!receiveMessage(pull_response)) {
 		cerr << "Failed to receive pull response\n";
 		return false;
 	}
@@ -769,6 +845,7 @@ pull_completed_comp:
 	if (!remote_head.empty()) {
 		FileSystemUtils::getInstance().writeText(FileSystemUtils::getInstance().headPath(),
 												 remote_head);
+		CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir())->add(remote_head);
 		cout << "Updated HEAD to " << remote_head.substr(0, 12) << "\n";
 
 		// 更新工作目录（类似 checkout）
@@ -778,8 +855,7 @@ pull_completed_comp:
 			for (auto &kv : oc->tree) {
 				fs::path out = FileSystemUtils::getInstance().repoRoot() / kv.first;
 				fs::create_directories(out.parent_path());
-				fs::copy_file(FileSystemUtils::getInstance().objectsDir() / kv.second, out,
-							  fs::copy_options::overwrite_existing);
+				Objects::restoreFile(kv.second, out);
 			}
 			cout << "Updated working directory\n";
 		}
@@ -802,7 +878,15 @@ bool Client::clone(const string &repo_name) {
 		cerr << "Cannot establish connection to server\n";
 		return false;
 	}
-	auto request = ProtocolMessage::createStringMessage(MessageType::CLONE_REQUEST, repo_name);
+
+	if (!negotiateCompression()) {
+		return false;
+	}
+	// --depth 只传输最近的提交，服务器额外发送边界文件
+	int depth = Config::getInstance().depth;
+	auto request =
+		depth > 0 ? ProtocolMessage::createShallowCloneRequest(repo_name, depth)
+				  : ProtocolMessage::createStringMessage(MessageType::CLONE_REQUEST, repo_name);
 	if (!NetworkUtils::sendMessage(client_socket_, request)) {
 		cerr << "Failed to send clone request\n";
 		return false;
@@ -828,18 +912,116 @@ bool Client::clone(const string &repo_name) {
 		fs::path out = FileSystemUtils::getInstance().repoRoot() / kv.first;
 		fs::create_directories(out.parent_path());
 		try {
-			fs::copy_file(FileSystemUtils::getInstance().objectsDir() / kv.second, out,
-						  fs::copy_options::overwrite_existing);
+			Objects::restoreFile(kv.second, out);
 			cout << "Restored: " << kv.first << "\n";
 		} catch (const exception &e) {
 			cerr << "Warning: Could not restore " << kv.first << ": " << e.what() << "\n";
 		}
 	}
+	if (depth > 0) {
+		auto boundaries = Shallow::read(fs::current_path() / repo_name / MARKNAME);
+		cout << "Shallow clone (depth " << depth << ")"
+			 << (boundaries.empty() ? ", history is complete" : "") << "\n";
+	}
 	cout << "clone success"
 		 << "\n";
 	return true;
 }
 
+bool Client::deepen(uint32_t depth) {
+	if (!authenticated_) {
+		cerr << "Not authenticated\n";
+		return false;
+	}
+
+	if (current_repo_.empty()) {
+		cerr << "No repository selected. Use 'use <repo>' first\n";
+		return false;
+	}
+
+	fs::path mg_dir = FileSystemUtils::getInstance().mgDir();
+	vector<string> boundaries = Shallow::read(mg_dir);
+	if (boundaries.empty()) {
+		cout << "Repository is not shallow, history is already complete\n";
+		return true;
+	}
+
+	if (!ensureConnected()) {
+		cerr << "Cannot establish connection to server\n";
+		return false;
+	}
+
+	if (!negotiateCompression()) {
+		return false;
+	}
+
+	cout << "Deepening history by " << depth << " commit(s)...\n";
+	auto request = ProtocolMessage::createDeepenRequest(depth, boundaries);
+	if (!NetworkUtils::sendMessage(client_socket_, request)) {
+		cerr << "Failed to send deepen request\n";
+		return false;
+	}
+
+	// 对象以拉取的流式归档下发，最后是带新边界的加深响应
+	ProtocolMessage response;
+	while (true) {
+		if (!receiveMessage(response)) {
+			cerr << "Failed to receive message\n";
+			return false;
+		}
+		if (response.header.type == MessageType::ERROR_MSG) {
+			// 错误消息为状态码加错误文本
+			if (!response.payload.empty())
+				cerr << "Error: " << string(response.payload.begin() + 1, response.payload.end())
+					 << "\n";
+			return false;
+		} else if (response.header.type == MessageType::PULL_OBJECT_DATA_COMPRESSED) {
+			if (!receiveCompressedObjectData(response)) {
+				cerr << "Failed to process compressed object data\n";
+				return false;
+			}
+		} else if (response.header.type == MessageType::DEEPEN_RESPONSE) {
+			break;
+		} else {
+			cerr << "Unexpected message type: " << static_cast<int>(response.header.type)
+				 << "\n";
+			return false;
+		}
+	}
+
+	if (response.payload.size() < sizeof(DeepenResponsePayload)) {
+		cerr << "Invalid deepen response\n";
+		return false;
+	}
+	DeepenResponsePayload payload;
+	memcpy(&payload, response.payload.data(), sizeof(DeepenResponsePayload));
+	if (response.payload.size() <
+		sizeof(DeepenResponsePayload) + (size_t)payload.boundary_count * 20) {
+		cerr << "Invalid deepen response\n";
+		return false;
+	}
+	const unsigned char *raw = response.payload.data() + sizeof(DeepenResponsePayload);
+	vector<string> new_boundaries;
+	for (uint32_t i = 0; i < payload.boundary_count; ++i)
+		new_boundaries.push_back(sha1_to_hex(raw + (size_t)i * 20));
+
+	// 对象已经写入，再前移边界
+	if (!Shallow::write(mg_dir, new_boundaries)) {
+		cerr << "Failed to update " << Shallow::path(mg_dir) << "\n";
+		return false;
+	}
+	cout << "Received " << payload.commits_count << " commit(s)\n";
+	if (new_boundaries.empty()) {
+		// 历史完整后才能建立提交图
+		string head =
+			FileSystemUtils::getInstance().readText(FileSystemUtils::getInstance().headPath());
+		if (!head.empty())
+			CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir())->add(head);
+		cout << "History is now complete\n";
+	}
+	return true;
+}
+
 // 交互式命令行
 int Client::runInteractive() {
 	if (!connect()) {
@@ -1005,6 +1187,19 @@ bool Client::ensureConnected() {
 	return true;
 }
 
+// 接收服务器消息
+bool Client::receiveMessage(ProtocolMessage &msg,
+							const NetworkUtils::receiveMessageProgressCallback &progress) {
+	if (!NetworkUtils::receiveMessage(client_socket_, msg, progress))
+		return false;
+	// 没有要求明文时，未加密的回应只可能来自被篡改的连接或配置错误的服务器
+	if ((msg.header.flags & MESSAGE_FLAG_PLAINTEXT) && !Config::getInstance().plaintext) {
+		cerr << "Error: server sent an unencrypted reply; use --plaintext to allow it\n";
+		return false;
+	}
+	return true;
+}
+
 // 带重试的网络操作包装器
 template <typename Operation>
 bool Client::performNetworkOperation(Operation operation, const string &operation_name,
@@ -1177,7 +1372,7 @@ bool Client::receiveCloneData(const string &repo_name) {
 	try {
 		// 先接收克隆开始消息
 		ProtocolMessage start_msg;
-		if (!NetworkUtils::receiveMessage(client_socket_, start_msg)) {
+		if (!receiveMessage(start_msg)) {
 			cerr << "Failed to receive clone start message\n";
 			return false;
 		}
@@ -1209,11 +1404,9 @@ bool Client::receiveCloneData(const string &repo_name) {
 		uint32_t files_received = 0;
 		while (files_received < start_payload.total_files) {
 			ProtocolMessage file_msg;
-			if (!NetworkUtils::receiveMessage(client_socket_, file_msg,
-											  [start_payload](size_t progress, const string &des) {
-												  ProgressDisplay::showTransferProgress(
-													  progress, start_payload.total_size, des);
-											  })) {
+			if (!receiveMessage(file_msg, [start_payload](size_t progress, const string &des) {
+					ProgressDisplay::showTransferProgress(progress, start_payload.total_size, des);
+				})) {
 				cerr << "Failed to receive file message\n";
 				return false;
 			}
@@ -1229,13 +1422,23 @@ bool Client::receiveCloneData(const string &repo_name) {
 				cout << "Progress: " << files_received << "/" << start_payload.total_files
 					 << " files received\r";
 				cout.flush();
+			} else if (file_msg.header.type == MessageType::CLONE_FILE_RAW) {
+				bool file_done = false;
+				if (!processCloneFileRaw(local_repo_path, file_msg, file_done)) {
+					cerr << "Failed to process file\n";
+					return false;
+				}
+				if (file_done)
+					files_received++;
 			} else if (file_msg.header.type == MessageType::CLONE_DATA_COMPRESSED) {
-				if (!processCloneCompressedData(local_repo_path, file_msg)) {
+				bool done = false;
+				if (!processCloneCompressedData(local_repo_path, file_msg, done)) {
 					cerr << "Failed to process compressed data\n";
 					return false;
 				}
-				// 压缩数据包含所有文件，直接跳出循环
-				break;
+				// 压缩数据包含所有文件，归档结束后跳出循环
+				if (done)
+					break;
 			} else if (file_msg.header.type == MessageType::CLONE_DATA_END) {
 				break;
 			} else if (file_msg.header.type == MessageType::ERROR_MSG) {
@@ -1246,7 +1449,7 @@ bool Client::receiveCloneData(const string &repo_name) {
 
 		// 接收结束消息
 		ProtocolMessage end_msg;
-		if (!NetworkUtils::receiveMessage(client_socket_, end_msg)) {
+		if (!receiveMessage(end_msg)) {
 			cerr << "\nFailed to receive clone end message\n";
 			return false;
 		}
@@ -1263,7 +1466,7 @@ bool Client::receiveCloneData(const string &repo_name) {
 
 		// 最后接收响应消息
 		ProtocolMessage response;
-		if (!NetworkUtils::receiveMessage(client_socket_, response)) {
+		if (!receiveMessage(response)) {
 			cerr << "\nFailed to receive clone response\n";
 			return false;
 		}
@@ -1311,7 +1514,7 @@ bool Client::processCloneFile(const fs::path &local_repo_path, const ProtocolMes
 							  file_msg.payload.begin() + file_data_offset + file_payload.file_size);
 
 	// 验证校验和
-	uint32_t calculated_crc = ProtocolMessage::calculateCRC32(file_data);
+	uint32_t calculated_crc = file_msg.checksumOf(file_data);
 	if (calculated_crc != file_payload.checksum) {
 		cerr << "CRC mismatch for file: " << file_path << "\n";
 		return false;
@@ -1341,9 +1544,49 @@ bool Client::processCloneFile(const fs::path &local_repo_path, const ProtocolMes
 	}
 }
 
+// 处理克隆原始文件分段，分段按偏移顺序到达
+bool Client::processCloneFileRaw(const fs::path &local_repo_path, const ProtocolMessage &msg,
+								 bool &file_done) {
+	if (msg.payload.size() < sizeof(CloneFileRawPayload)) {
+		return false;
+	}
+	CloneFileRawPayload payload;
+	memcpy(&payload, msg.payload.data(), sizeof(CloneFileRawPayload));
+
+	size_t data_offset = sizeof(CloneFileRawPayload) + payload.file_path_length;
+	if (msg.payload.size() < data_offset + payload.chunk_size ||
+		payload.offset + payload.chunk_size > payload.file_size) {
+		return false;
+	}
+	string file_path(reinterpret_cast<const char *>(msg.payload.data()) +
+						 sizeof(CloneFileRawPayload),
+					 payload.file_path_length);
+	fs::path rel(file_path);
+	if (rel.empty() || rel.is_absolute() || file_path.find("..") != string::npos) {
+		cerr << "Invalid file path: " << file_path << "\n";
+		return false;
+	}
+
+	fs::path full_path = local_repo_path / rel;
+	fs::create_directories(full_path.parent_path());
+	// 第一段截断文件，之后的分段依次追加
+	ofstream out(full_path, payload.offset == 0 ? ios::binary | ios::trunc : ios::binary | ios::app);
+	if (!out.is_open() || static_cast<uint64_t>(out.tellp()) != payload.offset) {
+		cerr << "Out of order data for file: " << file_path << "\n";
+		return false;
+	}
+	out.write(reinterpret_cast<const char *>(msg.payload.data() + data_offset), payload.chunk_size);
+	if (!out) {
+		cerr << "Failed to write file " << file_path << "\n";
+		return false;
+	}
+	file_done = payload.offset + payload.chunk_size == payload.file_size;
+	return true;
+}
+
 // 处理克隆压缩数据
 bool Client::processCloneCompressedData(const fs::path &local_repo_path,
-										const ProtocolMessage &msg) {
+										const ProtocolMessage &msg, bool &done) {
 	if (msg.payload.size() < sizeof(CloneDataCompressedPayload)) {
 		cerr << "Invalid compressed clone data payload\n";
 		return false;
@@ -1363,12 +1606,28 @@ bool Client::processCloneCompressedData(const fs::path &local_repo_path,
 									msg.payload.begin() + offset + payload.compressed_size);
 
 	// 验证校验和
-	uint32_t calculated_crc = ProtocolMessage::calculateCRC32(compressed_data);
+	uint32_t calculated_crc = msg.checksumOf(compressed_data);
 	if (calculated_crc != payload.checksum) {
 		cerr << "CRC mismatch for compressed clone data\n";
 		return false;
 	}
 
+	if (payload.operation_type != ARCHIVE_WHOLE) {
+		// 克隆和拉取的压缩数据负载布局相同
+		PullObjectDataPayloadCompressed chunk;
+		memcpy(&chunk, &payload, sizeof(chunk));
+		if (!receiveArchiveChunk(local_repo_path, false, chunk, compressed_data, done)) {
+			cerr << "Failed to extract repository archive\n";
+			return false;
+		}
+		if (done) {
+			FileSystemUtils::migrateObjectLayout(local_repo_path / MARKNAME / "objects");
+			cout << "Repository archive extracted successfully\n";
+		}
+		return true;
+	}
+	done = true;
+
 	cout << "\nReceiving repository archive ("
 		 << ProgressDisplay::formatFileSize(compressed_data.size()) << " compressed)...\n";
 
@@ -1384,6 +1643,9 @@ bool Client::processCloneCompressedData(const fs::path &local_repo_path,
 		return false;
 	}
 
+	// 旧版本服务器上的仓库可能仍是平铺布局
+	FileSystemUtils::migrateObjectLayout(local_repo_path / MARKNAME / "objects");
+
 	cout << "Repository archive extracted successfully\n";
 	return true;
 }
@@ -1410,18 +1672,21 @@ void ClientCommand::parseConfig(const vector<string> &args) {
 		} else if (args[i] == "--cert" && i + 1 < args.size()) {
 			Config::getInstance().cert_path = args[i + 1];
 			i++;
+		} else if (args[i] == "--plaintext") {
+			Config::getInstance().plaintext = true;
 		}
 	}
 }
 
 void ClientCommand::printUsage() {
 	cout << "Usage: minigit connect [--host <host>] [--port <port>] [--password <password>] "
-			"[--cert <cert_path>]\n";
+			"[--cert <cert_path>] [--plaintext]\n";
 	cout << "Options:\n";
 	cout << "  --host <host>         Server hostname (default: localhost)\n";
 	cout << "  --port <port>         Server port (default: 8080)\n";
 	cout << "  --password <password> Password for authentication\n";
 	cout << "  --cert <cert_path>    Path to RSA certificate directory\n";
+	cout << "  --plaintext           Do not encrypt payloads (server must allow it)\n";
 }
 
 // CloneCommand实现
@@ -1449,6 +1714,26 @@ int CloneCommand::parseAndRun(const vector<string> &args) {
 		} else if (args[i] == "--cert" && i + 1 < args.size()) {
 			target.cert_path = args[i + 1];
 			i++;
+		} else if (args[i] == "--compress" && i + 1 < args.size()) {
+			Config::getInstance().compression = args[i + 1];
+			i++;
+		} else if (args[i] == "--plaintext") {
+			Config::getInstance().plaintext = true;
+		} else if (args[i] == "--checksum" && i + 1 < args.size()) {
+			if (!Checksum::parse(args[i + 1], Config::getInstance().checksum)) {
+				cerr << "Error: Unknown checksum: " << args[i + 1] << "\n";
+				printUsage();
+				return 1;
+			}
+			i++;
+		} else if (args[i] == "--depth" && i + 1 < args.size()) {
+			Config::getInstance().depth = atoi(args[i + 1].c_str());
+			if (Config::getInstance().depth <= 0) {
+				cerr << "Error: --depth must be a positive number\n";
+				printUsage();
+				return 1;
+			}
+			i++;
 		}
 	}
 
@@ -1517,13 +1802,19 @@ CloneCommand::CloneTarget CloneCommand::parseCloneURL(const string &url) {
 }
 
 void CloneCommand::printUsage() {
-	cout << "Usage: minigit clone <host:port/repo> [--password <password>] [--cert <cert_path>]\n";
+	cout << "Usage: minigit clone <host:port/repo> [--password <password>] [--cert <cert_path>] "
+			"[--compress <codec>] [--plaintext] [--checksum <algorithm>] [--depth <n>]\n";
 	cout << "Examples:\n";
 	cout << "  minigit clone localhost:8080/myrepo --password mypass\n";
+	cout << "  minigit clone localhost:8080/myrepo --password mypass --depth 1\n";
 	cout << "  minigit clone server.com/myrepo --cert /path/to/cert\n";
 	cout << "Options:\n";
 	cout << "  --password <password> Password for authentication\n";
 	cout << "  --cert <cert_path>    Path to RSA certificate directory\n";
+	cout << "  --compress <codec>    none, lz4[:acceleration] or lz4hc[:level] (default: lz4)\n";
+	cout << "  --plaintext           Do not encrypt payloads (server must allow it)\n";
+	cout << "  --checksum <alg>      crc32, crc32c or xxh32 (default: crc32)\n";
+	cout << "  --depth <n>           Only fetch the last n commits (extend with pull --deepen)\n";
 }
 
 // 设置远程仓库地址到config文件中
@@ -1557,19 +1848,11 @@ void Client::setRemoteConfigForClone(const fs::path &local_repo_path, const stri
 // 计算需要上传的commit列表
 vector<string> Client::getCommitsToUpload(const string &local_head, const string &remote_head) {
 	vector<string> commits_to_upload;
+	auto graph = CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir());
 
 	// 如果远程仓库为空，上传从local_head到根的所有commit
 	if (remote_head.empty()) {
-		string current_commit = local_head;
-		while (!current_commit.empty()) {
-			commits_to_upload.push_back(current_commit);
-
-			auto commit_opt = CommitManager::loadCommit(current_commit);
-			if (!commit_opt) {
-				break;
-			}
-			current_commit = commit_opt->parent;
-		}
+		commits_to_upload = graph->history(local_head);
 		// 反转以便从最早的commit开始上传
 		reverse(commits_to_upload.begin(), commits_to_upload.end());
 		return commits_to_upload;
@@ -1581,19 +1864,12 @@ vector<string> Client::getCommitsToUpload(const string &local_head, const string
 	}
 
 	// 寻找从remote_head到local_head的路径
-	string current_commit = local_head;
-	while (!current_commit.empty() && current_commit != remote_head) {
-		commits_to_upload.push_back(current_commit);
-
-		auto commit_opt = CommitManager::loadCommit(current_commit);
-		if (!commit_opt) {
-			break;
-		}
-		current_commit = commit_opt->parent;
-	}
+	commits_to_upload = graph->history(local_head, remote_head);
 
 	// 检查是否找到了remote_head
-	if (current_commit != remote_head) {
+	CommitGraph::Entry oldest;
+	if (commits_to_upload.empty() || !graph->find(commits_to_upload.back(), oldest) ||
+		oldest.parent != remote_head) {
 		cerr << "Warning: Remote commit not found in local history. This may indicate diverged "
 				"branches.\n";
 		cerr << "Uploading all commits from local HEAD.\n";
@@ -1604,24 +1880,52 @@ vector<string> Client::getCommitsToUpload(const string &local_head, const string
 	return commits_to_upload;
 }
 
+// 对象协商：每批最多发送 HAVE_BATCH 个对象哈希，服务器返回缺少对象的位图
+bool Client::negotiateMissingObjects(vector<string> &object_ids) {
+	constexpr size_t HAVE_BATCH = 4096;
+	vector<string> missing;
+	for (size_t start = 0; start < object_ids.size(); start += HAVE_BATCH) {
+		vector<string> batch(object_ids.begin() + start,
+							 object_ids.begin() + min(object_ids.size(), start + HAVE_BATCH));
+		auto request = ProtocolMessage::createPushHaveRequest(batch);
+		if (!NetworkUtils::sendMessage(client_socket_, request))
+			return false;
+
+		ProtocolMessage response;
+		if (!receiveMessage(response))
+			return false;
+		if (response.header.type == MessageType::ERROR_MSG) {
+			cerr << "Error: " << response.getStringPayload() << "\n";
+			return false;
+		}
+		PushHaveResponsePayload have_payload;
+		if (response.header.type != MessageType::PUSH_HAVE_RESPONSE ||
+			response.payload.size() < sizeof(PushHaveResponsePayload))
+			return false;
+		memcpy(&have_payload, response.payload.data(), sizeof(PushHaveResponsePayload));
+		if (have_payload.object_count != batch.size() ||
+			response.payload.size() < sizeof(PushHaveResponsePayload) + (batch.size() + 7) / 8)
+			return false;
+
+		const uint8_t *bits = response.payload.data() + sizeof(PushHaveResponsePayload);
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (bits[i / 8] & (1u << (i % 8)))
+				missing.push_back(std::move(batch[i]));
+		}
+	}
+	object_ids.swap(missing);
+	return true;
+}
+
 // 上传commit数据
 bool Client::uploadCommit(const string &commit_id) {
-	auto commit_opt = CommitManager::loadCommit(commit_id);
-	if (!commit_opt) {
+	// 直接发送存储的提交内容，重新序列化会改变旧格式提交的哈希
+	vector<uint8_t> commit_data;
+	if (!Objects::readObject(commit_id, commit_data)) {
 		cerr << "Cannot load commit " << commit_id << "\n";
 		return false;
 	}
 
-	// 序列化commit数据
-	string commit_json = CommitManager::serializeCommit(*commit_opt);
-	// 移除第一行的commit ID，只发送JSON数据
-	auto newline_pos = commit_json.find('\n');
-	if (newline_pos != string::npos) {
-		commit_json = commit_json.substr(newline_pos + 1);
-	}
-
-	vector<uint8_t> commit_data(commit_json.begin(), commit_json.end());
-
 	// 创建并发送commit数据消息
 	auto commit_msg = ProtocolMessage::createPushCommitData(commit_id, commit_data);
 	if (!NetworkUtils::sendMessage(client_socket_, commit_msg)) {
@@ -1634,22 +1938,13 @@ bool Client::uploadCommit(const string &commit_id) {
 
 // 上传对象数据
 bool Client::uploadObject(const string &object_id) {
-	fs::path object_path = FileSystemUtils::getInstance().objectsDir() / object_id;
-	if (!fs::exists(object_path)) {
+	// 读取对象数据（松散对象或包中的对象）
+	vector<uint8_t> object_data;
+	if (!Objects::readObject(object_id, object_data)) {
 		cerr << "Object file not found: " << object_id << "\n";
 		return false;
 	}
 
-	// 读取对象数据
-	ifstream object_file(object_path, ios::binary);
-	if (!object_file.is_open()) {
-		cerr << "Cannot open object file: " << object_path << "\n";
-		return false;
-	}
-
-	vector<uint8_t> object_data((istreambuf_iterator<char>(object_file)), {});
-	object_file.close();
-
 	// 创建并发送对象数据消息
 	auto object_msg = ProtocolMessage::createPushObjectData(object_id, object_data);
 	if (!NetworkUtils::sendMessage(client_socket_, object_msg)) {
@@ -1664,18 +1959,13 @@ bool Client::uploadObject(const string &object_id) {
 vector<string> Client::getCommitsToDownload(const string &local_head, const string &remote_head) {
 	vector<string> commits_to_download;
 
+	auto graph = CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir());
 	// 如果本地没有HEAD，需要下载所有commit
 	if (local_head.empty()) {
 		// 从远程HEAD开始向后遍历所有commit
-		string current_commit = remote_head;
-		while (!current_commit.empty()) {
-			commits_to_download.push_back(current_commit);
-			// 加载提交并获取父提交
-			auto commit_opt = CommitManager::loadCommit(current_commit);
-			if (!commit_opt) {
-				break; // 提交不存在，可能还没有下载
-			}
-			current_commit = commit_opt->parent;
+		commits_to_download = graph->history(remote_head);
+		if (commits_to_download.empty() && !remote_head.empty()) {
+			commits_to_download.push_back(remote_head); // 提交不存在，可能还没有下载
 		}
 		// 反转顺序，从最早的commit开始
 		reverse(commits_to_download.begin(), commits_to_download.end());
@@ -1688,18 +1978,13 @@ vector<string> Client::getCommitsToDownload(const string &local_head, const stri
 	}
 
 	// 找到分叉点，只下载远程有而本地没有的commit
-	set<string> local_commits;
-	string current_commit = local_head;
-	while (!current_commit.empty()) {
-		local_commits.insert(current_commit);
-		auto commit_opt = CommitManager::loadCommit(current_commit);
-		if (!commit_opt)
-			break;
-		current_commit = commit_opt->parent;
-	}
+	auto local_history = graph->history(local_head);
+	set<string> local_commits(local_history.begin(), local_history.end());
+	if (local_commits.empty())
+		local_commits.insert(local_head);
 
 	// 从远程HEAD开始，收集需要的commit
-	current_commit = remote_head;
+	string current_commit = remote_head;
 	while (!current_commit.empty() && local_commits.find(current_commit) == local_commits.end()) {
 		commits_to_download.push_back(current_commit);
 		// 这里我们需要从服务器获取commit信息，但由于这是计算阶段，
@@ -1741,9 +2026,9 @@ bool Client::receiveCommitData(const ProtocolMessage &msg) {
 	cout << "Receiving commit " << commit_id.substr(0, 12) << "...\n";
 
 	// 保存提交对象
-	fs::path commit_path = FileSystemUtils::getInstance().objectsDir() / commit_id;
+	fs::path commit_path = FileSystemUtils::getInstance().objectPath(commit_id);
 	if (!fs::exists(commit_path)) {
-		fs::create_directories(FileSystemUtils::getInstance().objectsDir());
+		fs::create_directories(commit_path.parent_path());
 		try {
 			ofstream commit_file(commit_path, ios::binary);
 			if (!commit_file.is_open()) {
@@ -1789,7 +2074,7 @@ bool Client::receiveObjectData(const ProtocolMessage &msg) {
 								msg.payload.begin() + offset + object_payload.object_data_length);
 
 	// 验证校验和
-	uint32_t calculated_crc = ProtocolMessage::calculateCRC32(object_data);
+	uint32_t calculated_crc = msg.checksumOf(object_data);
 	if (calculated_crc != object_payload.checksum) {
 		cerr << "CRC mismatch for object: " << object_id << "\n";
 		return false;
@@ -1798,9 +2083,9 @@ bool Client::receiveObjectData(const ProtocolMessage &msg) {
 	cout << "Receiving object " << object_id.substr(0, 12) << "...\n";
 
 	// 保存对象
-	fs::path object_path = FileSystemUtils::getInstance().objectsDir() / object_id;
+	fs::path object_path = FileSystemUtils::getInstance().objectPath(object_id);
 	if (!fs::exists(object_path)) {
-		fs::create_directories(FileSystemUtils::getInstance().objectsDir());
+		fs::create_directories(object_path.parent_path());
 		try {
 			ofstream object_file(object_path, ios::binary);
 			if (!object_file.is_open()) {
@@ -1820,6 +2105,32 @@ bool Client::receiveObjectData(const ProtocolMessage &msg) {
 }
 
 // 接收压缩对象数据
+bool Client::receiveArchiveChunk(const fs::path &output_path, bool keep_existing,
+								 const PullObjectDataPayloadCompressed &payload,
+								 const vector<uint8_t> &data, bool &done) {
+	if (!archive_extractor_)
+		archive_extractor_ = make_unique<ArchiveExtractor>(output_path, keep_existing);
+	if (!archive_extractor_->feed(data.data(), data.size())) {
+		ProgressDisplay::finish();
+		archive_extractor_.reset();
+		return false;
+	}
+	uint32_t extracted = archive_extractor_->fileCount();
+	if (payload.file_count > 0) {
+		ProgressDisplay::showCompressionProgress(
+			static_cast<int>(min(extracted, payload.file_count) * 100ull / payload.file_count),
+			"extract", to_string(extracted) + "/" + to_string(payload.file_count));
+	}
+	done = payload.operation_type == ARCHIVE_STREAM_END;
+	if (!done)
+		return true;
+
+	ProgressDisplay::finish();
+	bool complete = archive_extractor_->finish();
+	archive_extractor_.reset();
+	return complete;
+}
+
 bool Client::receiveCompressedObjectData(const ProtocolMessage &msg) {
 	if (msg.payload.size() < sizeof(PullObjectDataPayloadCompressed)) {
 		cerr << "Invalid compressed object data payload\n";
@@ -1840,12 +2151,25 @@ bool Client::receiveCompressedObjectData(const ProtocolMessage &msg) {
 									msg.payload.begin() + offset + payload.compressed_size);
 
 	// 验证校验和
-	uint32_t calculated_crc = ProtocolMessage::calculateCRC32(compressed_data);
+	uint32_t calculated_crc = msg.checksumOf(compressed_data);
 	if (calculated_crc != payload.checksum) {
 		cerr << "CRC mismatch for compressed data\n";
 		return false;
 	}
 
+	if (payload.operation_type != ARCHIVE_WHOLE) {
+		// 流式归档直接解压到对象目录，已有的对象跳过
+		bool done = false;
+		if (!receiveArchiveChunk(FileSystemUtils::getInstance().repoRoot(), true, payload,
+								 compressed_data, done)) {
+			cerr << "Failed to extract compressed archive\n";
+			return false;
+		}
+		if (done)
+			cout << "Compressed objects extracted successfully\n";
+		return true;
+	}
+
 	cout << "Receiving " << payload.file_count << " object(s) ("
 		 << ProgressDisplay::formatFileSize(compressed_data.size()) << " compressed)...\n";
 
@@ -1886,6 +2210,8 @@ bool Client::receiveCompressedObjectData(const ProtocolMessage &msg) {
 
 	// 清理临时文件
 	fs::remove_all(temp_extract_path);
+	// 旧版本服务器发送的是平铺布局的对象
+	FileSystemUtils::migrateObjectLayout(FileSystemUtils::getInstance().objectsDir());
 
 	cout << "Compressed objects extracted successfully\n";
 	return true;
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "common.h"
+#include "compression.h"
 #include "protocol.h"
+#include <memory>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -29,6 +31,10 @@ public:
 	// 确保连接可用（检测连接状态，必要时重连）
 	bool ensureConnected();
 
+	// 接收服务器消息；未指定 --plaintext 时拒绝未加密的回应
+	bool receiveMessage(ProtocolMessage &msg,
+						const NetworkUtils::receiveMessageProgressCallback &progress = nullptr);
+
 	// 认证
 	bool authenticate();
 
@@ -54,6 +60,9 @@ public:
 
 	bool clone(const string &repo_name);
 
+	// 浅克隆的仓库在每个边界之前再获取 depth 个提交
+	bool deepen(uint32_t depth);
+
 	// 日志操作
 	vector<string> log(int max_count = -1, bool line = false);
 
@@ -109,7 +118,13 @@ private:
 
 	bool processCloneFile(const fs::path &local_repo_path, const ProtocolMessage &file_msg);
 
-	bool processCloneCompressedData(const fs::path &local_repo_path, const ProtocolMessage &msg);
+	// file_done 在收到文件的最后一段后置为true
+	bool processCloneFileRaw(const fs::path &local_repo_path, const ProtocolMessage &msg,
+	                         bool &file_done);
+
+	// done 在收到整个归档后置为true
+	bool processCloneCompressedData(const fs::path &local_repo_path, const ProtocolMessage &msg,
+	                                bool &done);
 
 	void setRemoteConfigForClone(const fs::path &local_repo_path, const string &repo_name);
 
@@ -120,6 +135,12 @@ private:
 
 	bool uploadObject(const string &object_id);
 
+	// 按 --compress 选项与服务器协商本会话的压缩方式，未指定时不发送请求、使用默认方式
+	bool negotiateCompression();
+
+	// 分批询问服务器已有的对象，object_ids 中只保留服务器缺少的对象
+	bool negotiateMissingObjects(vector<string> &object_ids);
+
 	// 智能pull相关的辅助方法
 	vector<string> getCommitsToDownload(const string &local_head, const string &remote_head);
 
@@ -132,6 +153,16 @@ private:
 	bool receiveObjectData(const ProtocolMessage &msg);
 
 	bool receiveCompressedObjectData(const ProtocolMessage &msg);
+
+	// 把流式归档的一段数据交给解压器，收到结束消息后 done 置为true
+	bool receiveArchiveChunk(const fs::path &output_path, bool keep_existing,
+	                         const PullObjectDataPayloadCompressed &payload,
+	                         const vector<uint8_t> &data, bool &done);
+
+	// 正在接收的流式归档
+	unique_ptr<ArchiveExtractor> archive_extractor_;
+	// 协商后的压缩方式，推送时使用
+	CompressionOptions compression_;
 };
 
 /**
@@ -0,0 +1,80 @@
+#include "clone_cache.h"
+
+namespace {
+// 键的第一段是仓库目录
+string repoOf(const string &key) {
+	return key.substr(0, key.find('\n'));
+}
+} // namespace
+
+size_t CloneBundle::cost() const {
+	size_t bytes = sizeof(CloneBundle);
+	for (const auto &frame : frames)
+		bytes += frame.size();
+	for (const auto &file : raw_files)
+		bytes += file.relative_path.size() + file.path.native().size() + sizeof(RawFile);
+	return bytes;
+}
+
+string CloneBundleCache::key(const fs::path &repo_root, const string &head,
+							 const CompressionOptions &options, ChecksumType checksum,
+							 bool plaintext, uint32_t depth) {
+	return repo_root.string() + '\n' + head + '\n' + options.toString() + '\n' +
+		   Checksum::name(checksum) + '\n' + (plaintext ? "plain" : "aes") + '\n' +
+		   to_string(depth);
+}
+
+shared_ptr<const CloneBundle> CloneBundleCache::get(const string &key, const Builder &build) {
+	promise<shared_ptr<const CloneBundle>> result;
+	uint64_t generation;
+	{
+		unique_lock<mutex> lock(m);
+		if (auto bundle = bundles.get(key))
+			return bundle;
+		if (uncacheable.count(key))
+			return nullptr;
+		auto it = building.find(key);
+		if (it != building.end()) {
+			auto pending = it->second;
+			lock.unlock();
+			return pending.get();
+		}
+		building.emplace(key, result.get_future().share());
+		generation = generations[repoOf(key)];
+	}
+
+	shared_ptr<const CloneBundle> bundle;
+	try {
+		bundle = build();
+	} catch (...) {
+		{
+			lock_guard<mutex> lock(m);
+			building.erase(key);
+		}
+		result.set_value(nullptr);
+		throw;
+	}
+	{
+		lock_guard<mutex> lock(m);
+		building.erase(key);
+		// 构建期间仓库被推送或删除时不缓存，旧 HEAD 的包不再有请求使用
+		if (generations[repoOf(key)] == generation) {
+			if (bundle)
+				bundles.put(key, bundle, bundle->cost());
+			else
+				uncacheable.insert(key);
+		}
+	}
+	result.set_value(bundle);
+	return bundle;
+}
+
+void CloneBundleCache::invalidate(const fs::path &repo_root) {
+	string prefix = repo_root.string() + '\n';
+	lock_guard<mutex> lock(m);
+	++generations[repo_root.string()];
+	auto in_repo = [&](const string &key) { return key.compare(0, prefix.size(), prefix) == 0; };
+	bundles.eraseIf(in_repo);
+	for (auto it = uncacheable.begin(); it != uncacheable.end();)
+		it = in_repo(*it) ? uncacheable.erase(it) : next(it);
+}
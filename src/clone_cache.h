@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.h"
+#include "compression.h"
+#include "object_cache.h"
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * 一次克隆要发送的内容：直接发送的大文件列表和序列化好的归档消息
+ * 归档消息已经过压缩和加密（每条消息的IV随之缓存，重复发送只会暴露两次克隆内容相同），
+ * 发送时直接写入socket；加密是克隆中最耗CPU的部分
+ */
+struct CloneBundle {
+	struct RawFile {
+		string relative_path;
+		fs::path path;
+		uint64_t size;
+	};
+
+	uint32_t file_count = 0; // 克隆的文件总数（克隆开始消息）
+	uint64_t total_size = 0;
+	vector<RawFile> raw_files; // 明文模式下从磁盘直接发送，不放入缓存
+	vector<vector<uint8_t>> frames; // 归档数据段和归档结束消息，没有归档时为空
+
+	size_t cost() const;
+};
+
+/**
+ * 服务器的克隆包缓存
+ * 同一仓库同一 HEAD 的克隆内容相同，缓存构建好的克隆包，重复克隆不再遍历仓库和压缩。
+ * 键为 仓库目录 + HEAD + 压缩方式 + 校验和算法 + 是否明文 + 浅克隆深度，按消息和路径的大小计入预算，超出时淘汰最久未使用的包；
+ * 同一键的并发请求只构建一次，其余请求等待并共享结果；构建返回nullptr（仓库太大放不进缓存等）的键
+ * 也会记住，之后的请求直接返回nullptr，不再遍历仓库或排队等待。推送更新 HEAD 后使该仓库的包失效。线程安全
+ */
+class CloneBundleCache {
+public:
+	// 构建失败或不适合缓存时返回nullptr
+	using Builder = function<shared_ptr<const CloneBundle>()>;
+
+	explicit CloneBundleCache(size_t budget) : limit(budget), bundles(budget) {}
+
+	bool enabled() const { return limit > 0; }
+	size_t budget() const { return limit; }
+
+	// plaintext 为会话是否协商了明文传输，depth 为浅克隆的提交数，0为完整克隆
+	static string key(const fs::path &repo_root, const string &head,
+					  const CompressionOptions &options, ChecksumType checksum, bool plaintext,
+					  uint32_t depth = 0);
+
+	// 返回缓存的克隆包，没有时调用 build 构建；同一键正在构建时等待其结果；已知无法缓存时返回nullptr
+	shared_ptr<const CloneBundle> get(const string &key, const Builder &build);
+
+	// 删除仓库的所有克隆包，并使正在构建的包完成后不再放入缓存
+	void invalidate(const fs::path &repo_root);
+
+private:
+	size_t limit;
+	mutex m;
+	LruCache<CloneBundle> bundles;
+	unordered_map<string, shared_future<shared_ptr<const CloneBundle>>> building;
+	unordered_map<string, uint64_t> generations; // 仓库目录 -> 失效次数
+	unordered_set<string> uncacheable;			 // 构建返回nullptr的键
+};
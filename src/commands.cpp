@@ -24,6 +24,10 @@ int Commands::checkout() {
 	return CommandsBasic::checkout();
 }
 
+int Commands::repack() {
+	return CommandsBasic::repack();
+}
+
 // History commands - delegate to CommandsHistory
 int Commands::reset(vector<string> args) {
 	return CommandsHistory::reset(args);
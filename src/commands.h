@@ -28,6 +28,8 @@ public:
 
 	static int checkout();
 
+	static int repack();
+
 	// 历史命令 - 委托给 CommandsHistory
 	static int reset(vector<string> args);
 
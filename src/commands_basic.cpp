@@ -1,7 +1,9 @@
 #include "commands_basic.h"
 #include "client.h"
 #include "mignore.h"
+#include "reachability.h"
 #include "sha256.h"
+#include "working_tree.h"
 
 int CommandsBasic::init() {
 	if (fs::exists(FileSystemUtils::getInstance().mgDir())) {
@@ -263,13 +265,25 @@ int CommandsBasic::checkout() {
 	for (auto &kv : oc->tree) {
 		fs::path out = FileSystemUtils::getInstance().repoRoot() / kv.first;
 		fs::create_directories(out.parent_path());
-		fs::copy_file(FileSystemUtils::getInstance().objectsDir() / kv.second, out,
-					  fs::copy_options::overwrite_existing);
+		Objects::restoreFile(kv.second, out);
 	}
 	cout << "Checked out commit " << head.substr(0, 12) << "\n";
 	return 0;
 }
 
+int CommandsBasic::repack() {
+	FileSystemUtils::getInstance().ensureRepo();
+	fs::path objects_dir = FileSystemUtils::getInstance().objectsDir();
+	size_t count = Objects::repack(objects_dir);
+	cout << "Packed " << count << " object(s)\n";
+	// 可达性位图与包文件放在一起，服务器据此计算需要发送的对象
+	string head =
+		FileSystemUtils::getInstance().readText(FileSystemUtils::getInstance().headPath());
+	if (ReachabilityIndex::update(objects_dir, head))
+		cout << "Wrote reachability bitmaps\n";
+	return 0;
+}
+
 // Helper functions implementation
 string CommandsBasic::calculateWorkingFileHash(const fs::path &file_path) {
 	if (!fs::exists(file_path) || !fs::is_regular_file(file_path)) {
@@ -279,25 +293,9 @@ string CommandsBasic::calculateWorkingFileHash(const fs::path &file_path) {
 }
 
 void CommandsBasic::scanWorkingDirectory(const fs::path &dir, vector<string> &files) {
-	try {
-		for (auto &entry :
-			 fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied)) {
-			try {
-				bool irf = entry.is_regular_file();
-				if (irf && !FileSystemUtils::getInstance().isIgnored(entry.path())) {
-					string relative_path =
-						fs::relative(entry.path(), FileSystemUtils::getInstance().repoRoot())
-							.generic_string();
-					files.push_back(relative_path);
-				}
-			} catch (const fs::filesystem_error &) {
-				// 静默忽略单个文件的错误（比如权限问题）
-				continue;
-			}
-		}
-	} catch (const fs::filesystem_error &) {
-		// 静默忽略文件系统错误（比如权限问题）
-	}
+	vector<string> scanned = WorkingTree::scan(dir);
+	files.insert(files.end(), make_move_iterator(scanned.begin()),
+				 make_move_iterator(scanned.end()));
 }
 
 // 获取历史提交中所有曾经存在的文件（用于检测意外删除）
@@ -308,40 +306,14 @@ Index::IndexMap CommandsBasic::getHistoricalFiles(const string &head_commit_id)
 		return historical_files; // 空仓库，没有历史文件
 	}
 
-	// 遍历所有历史提交，收集所有曾经存在的文件
-	string current_commit_id = head_commit_id;
-	set<string> visited_commits; // 防止无限循环
-
-	while (!current_commit_id.empty() &&
-		   visited_commits.find(current_commit_id) == visited_commits.end()) {
-		visited_commits.insert(current_commit_id);
-
-		auto commit_opt = CommitManager::loadCommit(current_commit_id);
-		if (!commit_opt) {
-			break; // 无法加载提交，停止遍历
-		}
-
-		// 将当前提交中的所有文件添加到历史文件集合中
-		for (const auto &file_entry : commit_opt->tree) {
-			const string &file_path = file_entry.first;
-			const string &file_hash = file_entry.second;
-
-			// 如果该文件尚未被记录，或者当前提交中的版本更新，则保存
-			if (historical_files.find(file_path) == historical_files.end()) {
-				historical_files[file_path] = file_hash;
-			}
-		}
-
-		// 移动到父提交
-		current_commit_id = commit_opt->parent;
-	}
-
-	return historical_files;
+	// 沿提交图遍历历史，相邻提交之间只比较变化的子树
+	return CommitManager::historicalFiles(head_commit_id);
 }
 
 vector<CommandsBasic::FileStatus> CommandsBasic::getWorkingDirectoryStatus() {
 	vector<FileStatus> statuses;
-	auto index = Index::read();
+	IndexFile index;
+	index.open(FileSystemUtils::getInstance().indexPath());
 
 	// 获取当前HEAD提交中的文件
 	Index::IndexMap head_files;
@@ -364,8 +336,8 @@ vector<CommandsBasic::FileStatus> CommandsBasic::getWorkingDirectoryStatus() {
 	for (const auto &kv : head_files) {
 		all_files.insert(kv.first);
 	}
-	for (const auto &kv : index) {
-		all_files.insert(kv.first);
+	for (size_t i = 0; i < index.size(); ++i) {
+		all_files.insert(string(index.path(i)));
 	}
 	for (const auto &file : working_files) {
 		all_files.insert(file);
@@ -373,6 +345,19 @@ vector<CommandsBasic::FileStatus> CommandsBasic::getWorkingDirectoryStatus() {
 
 	// remove ignore file
 
+	// 并行计算工作目录中文件的哈希，stat未变化的已跟踪文件直接使用暂存区中的哈希
+	Index::Changes refreshed;
+	vector<string> hashes = WorkingTree::hashWithIndex(working_files, index, refreshed);
+	if (!refreshed.empty()) {
+		index.close();
+		Index::update(refreshed);
+		index.open(FileSystemUtils::getInstance().indexPath());
+	}
+	map<string, string> working_hashes;
+	for (size_t i = 0; i < working_files.size(); ++i) {
+		working_hashes[working_files[i]] = std::move(hashes[i]);
+	}
+
 	// 分析每个文件的状态
 	for (const string &file_path : all_files) {
 		FileStatus status;
@@ -380,7 +365,8 @@ vector<CommandsBasic::FileStatus> CommandsBasic::getWorkingDirectoryStatus() {
 
 		fs::path full_path = FileSystemUtils::getInstance().repoRoot() / file_path;
 		bool exists_in_working = fs::exists(full_path);
-		bool exists_in_index = index.find(file_path) != index.end();
+		size_t index_pos = index.find(file_path);
+		bool exists_in_index = index_pos != IndexFile::npos;
 		bool exists_in_head = head_files.find(file_path) != head_files.end();
 
 		string head_hash;
@@ -390,13 +376,16 @@ vector<CommandsBasic::FileStatus> CommandsBasic::getWorkingDirectoryStatus() {
 
 		string staged_hash;
 		if (exists_in_index) {
-			staged_hash = index[file_path];
+			staged_hash = index.sha(index_pos);
 			status.staged_hash = staged_hash;
 		}
 
 		string working_hash;
 		if (exists_in_working) {
-			working_hash = calculateWorkingFileHash(full_path);
+			auto hash_it = working_hashes.find(file_path);
+			if (hash_it != working_hashes.end()) {
+				working_hash = hash_it->second;
+			}
 			status.working_hash = working_hash;
 		}
 
@@ -8,7 +8,7 @@
 
 /**
  * MiniGit基本命令实现类
- * 实现基本的Git命令功能：init, add, commit, status, checkout
+ * 实现基本的Git命令功能：init, add, commit, status, checkout, repack
  */
 class CommandsBasic {
 public:
@@ -18,6 +18,7 @@ public:
 	static int commit(vector<string> args);
 	static int status();
 	static int checkout();
+	static int repack();
 
 	// 文件状态检测辅助方法
 	struct FileStatus {
@@ -1,5 +1,8 @@
 #include "commands_history.h"
+#include "commit_graph.h"
 #include "sha256.h"
+#include "trees.h"
+#include "working_tree.h"
 #include <commands_remote.h>
 
 int CommandsHistory::reset(vector<string> args) {
@@ -98,8 +101,7 @@ int CommandsHistory::reset(vector<string> args) {
 			fs::path out = FileSystemUtils::getInstance().repoRoot() / kv.first;
 			fs::create_directories(out.parent_path());
 			try {
-				fs::copy_file(FileSystemUtils::getInstance().objectsDir() / kv.second, out,
-							  fs::copy_options::overwrite_existing);
+				Objects::restoreFile(kv.second, out);
 				cout << "Restored: " << kv.first << "\n";
 			} catch (const exception &e) {
 				cerr << "Warning: Could not restore " << kv.first << ": " << e.what() << "\n";
@@ -174,19 +176,18 @@ int CommandsHistory::log(vector<string> args) {
 
 	// 遍历提交历史
 	vector<Commit> commit_history;
-	string commit_id = current_id;
-	int count = 0;
 
-	while (!commit_id.empty() && (max_count == -1 || count < max_count)) {
-		auto commit_opt = CommitManager::loadCommit(commit_id);
+	// 按提交图确定要显示的提交，只读取这些提交的对象
+	auto ids = CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir())
+				   ->history(current_id, "", max_count == -1 ? SIZE_MAX : (size_t)max_count);
+	for (const auto &commit_id : ids) {
+		// 文件变更由 showCommitChanges 比较树对象得到，这里不需要展开文件树
+		auto commit_opt = CommitManager::loadCommitHeader(commit_id);
 		if (!commit_opt) {
 			cerr << "Warning: Cannot load commit " << commit_id << "\n";
 			break;
 		}
-
 		commit_history.push_back(*commit_opt);
-		commit_id = commit_opt->parent;
-		count++;
 	}
 
 	// 显示提交历史
@@ -298,25 +299,9 @@ string CommandsHistory::calculateWorkingFileHash(const fs::path &file_path) {
 }
 
 void CommandsHistory::scanWorkingDirectory(const fs::path &dir, vector<string> &files) {
-	try {
-		for (auto &entry :
-			 fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied)) {
-			try {
-				bool irf = entry.is_regular_file();
-				if (irf && !FileSystemUtils::getInstance().isIgnored(entry.path())) {
-					string relative_path =
-						fs::relative(entry.path(), FileSystemUtils::getInstance().repoRoot())
-							.generic_string();
-					files.push_back(relative_path);
-				}
-			} catch (const fs::filesystem_error &) {
-				// 静默忽略单个文件的错误（比如权限问题）
-				continue;
-			}
-		}
-	} catch (const fs::filesystem_error &) {
-		// 静默忽略文件系统错误（比如权限问题）
-	}
+	vector<string> scanned = WorkingTree::scan(dir);
+	files.insert(files.end(), make_move_iterator(scanned.begin()),
+				 make_move_iterator(scanned.end()));
 }
 
 // 获取历史提交中所有曾经存在的文件（用于检测意外删除）
@@ -327,76 +312,67 @@ Index::IndexMap CommandsHistory::getHistoricalFiles(const string &head_commit_id
 		return historical_files; // 空仓库，没有历史文件
 	}
 
-	// 遍历所有历史提交，收集所有曾经存在的文件
-	string current_commit_id = head_commit_id;
-	set<string> visited_commits; // 防止无限循环
-
-	while (!current_commit_id.empty() &&
-		   visited_commits.find(current_commit_id) == visited_commits.end()) {
-		visited_commits.insert(current_commit_id);
-
-		auto commit_opt = CommitManager::loadCommit(current_commit_id);
-		if (!commit_opt) {
-			break; // 无法加载提交，停止遍历
-		}
-
-		// 将当前提交中的所有文件添加到历史文件集合中
-		for (const auto &file_entry : commit_opt->tree) {
-			const string &file_path = file_entry.first;
-			const string &file_hash = file_entry.second;
-
-			// 如果该文件尚未被记录，或者当前提交中的版本更新，则保存
-			if (historical_files.find(file_path) == historical_files.end()) {
-				historical_files[file_path] = file_hash;
-			}
-		}
-
-		// 移动到父提交
-		current_commit_id = commit_opt->parent;
-	}
-
-	return historical_files;
+	// 沿提交图遍历历史，相邻提交之间只比较变化的子树
+	return CommitManager::historicalFiles(head_commit_id);
 }
 
 // 显示提交的文件变更（包括新增、修改和删除）
 void CommandsHistory::showCommitChanges(const Commit &commit) {
-	Index::IndexMap parent_files;
-
-	// 获取父提交的文件列表
-	if (!commit.parent.empty()) {
-		auto parent_commit = CommitManager::loadCommit(commit.parent);
-		if (parent_commit) {
-			parent_files = parent_commit->tree;
-		}
-	}
-
 	vector<pair<string, string>> added_files;	 // 新增的文件
 	vector<pair<string, string>> modified_files; // 修改的文件
 	vector<string> deleted_files;				 // 删除的文件
 
-	// 检查当前提交中的文件（新增或修改）
-	for (const auto &file : commit.tree) {
-		const string &file_path = file.first;
-		const string &file_hash = file.second;
-
-		auto parent_it = parent_files.find(file_path);
-		if (parent_it == parent_files.end()) {
-			// 文件在父提交中不存在，是新增的
-			added_files.push_back({file_path, file_hash});
-		} else if (parent_it->second != file_hash) {
-			// 文件在父提交中存在但哈希不同，是修改的
-			modified_files.push_back({file_path, file_hash});
+	fs::path objects_dir = FileSystemUtils::getInstance().objectsDir();
+	// 父提交的根树从提交图中获得
+	CommitGraph::Entry parent;
+	bool has_parent =
+		!commit.parent.empty() && CommitGraph::forDirectory(objects_dir)->find(commit.parent, parent);
+
+	bool tree_diff = !commit.root_tree.empty() && (!has_parent || !parent.root_tree.empty());
+	if (tree_diff) {
+		// 两个提交都引用树对象：只进入哈希不同的子树
+		string parent_root = has_parent ? parent.root_tree : string();
+		Trees::diff(objects_dir, parent_root, commit.root_tree,
+					[&](const string &path, const string &old_id, const string &new_id) {
+						if (old_id.empty())
+							added_files.push_back({path, new_id});
+						else if (new_id.empty())
+							deleted_files.push_back(path);
+						else
+							modified_files.push_back({path, new_id});
+					});
+		// 树按目录逐层比较，按完整路径重新排序与扁平比较的输出保持一致
+		sort(added_files.begin(), added_files.end());
+		sort(modified_files.begin(), modified_files.end());
+		sort(deleted_files.begin(), deleted_files.end());
+	} else {
+		// 旧格式的提交没有树对象，展开完整的文件列表比较
+		Index::IndexMap files, parent_files;
+		auto full = CommitManager::loadCommit(commit.id);
+		if (full)
+			files = full->tree;
+		if (has_parent) {
+			auto parent_full = CommitManager::loadCommit(commit.parent);
+			if (parent_full)
+				parent_files = parent_full->tree;
 		}
-		// 如果哈希相同，则文件未变更，不显示
-	}
 
-	// 检查父提交中的文件是否被删除
-	for (const auto &parent_file : parent_files) {
-		const string &file_path = parent_file.first;
+		// 检查当前提交中的文件（新增或修改）
+		for (const auto &file : files) {
+			auto parent_it = parent_files.find(file.first);
+			if (parent_it == parent_files.end()) {
+				// 文件在父提交中不存在，是新增的
+				added_files.push_back({file.first, file.second});
+			} else if (parent_it->second != file.second) {
+				// 文件在父提交中存在但哈希不同，是修改的
+				modified_files.push_back({file.first, file.second});
+			}
+		}
 
-		if (commit.tree.find(file_path) == commit.tree.end()) {
-			// 文件在当前提交中不存在，被删除了
-			deleted_files.push_back(file_path);
+		// 检查父提交中的文件是否被删除
+		for (const auto &parent_file : parent_files) {
+			if (files.find(parent_file.first) == files.end())
+				deleted_files.push_back(parent_file.first);
 		}
 	}
 
@@ -430,7 +406,8 @@ void CommandsHistory::showCommitChanges(const Commit &commit) {
 
 vector<CommandsHistory::FileStatus> CommandsHistory::getWorkingDirectoryStatus() {
 	vector<FileStatus> statuses;
-	auto index = Index::read();
+	IndexFile index;
+	index.open(FileSystemUtils::getInstance().indexPath());
 
 	// 获取当前HEAD提交中的文件
 	Index::IndexMap head_files;
@@ -452,13 +429,26 @@ vector<CommandsHistory::FileStatus> CommandsHistory::getWorkingDirectoryStatus()
 	for (const auto &kv : head_files) {
 		all_files.insert(kv.first);
 	}
-	for (const auto &kv : index) {
-		all_files.insert(kv.first);
+	for (size_t i = 0; i < index.size(); ++i) {
+		all_files.insert(string(index.path(i)));
 	}
 	for (const auto &file : working_files) {
 		all_files.insert(file);
 	}
 
+	// 并行计算工作目录中文件的哈希，stat未变化的已跟踪文件直接使用暂存区中的哈希
+	Index::Changes refreshed;
+	vector<string> hashes = WorkingTree::hashWithIndex(working_files, index, refreshed);
+	if (!refreshed.empty()) {
+		index.close();
+		Index::update(refreshed);
+		index.open(FileSystemUtils::getInstance().indexPath());
+	}
+	map<string, string> working_hashes;
+	for (size_t i = 0; i < working_files.size(); ++i) {
+		working_hashes[working_files[i]] = std::move(hashes[i]);
+	}
+
 	// 分析每个文件的状态
 	for (const string &file_path : all_files) {
 		FileStatus status;
@@ -466,7 +456,8 @@ vector<CommandsHistory::FileStatus> CommandsHistory::getWorkingDirectoryStatus()
 
 		fs::path full_path = FileSystemUtils::getInstance().repoRoot() / file_path;
 		bool exists_in_working = fs::exists(full_path);
-		bool exists_in_index = index.find(file_path) != index.end();
+		size_t index_pos = index.find(file_path);
+		bool exists_in_index = index_pos != IndexFile::npos;
 		bool exists_in_head = head_files.find(file_path) != head_files.end();
 
 		string head_hash;
@@ -476,13 +467,16 @@ vector<CommandsHistory::FileStatus> CommandsHistory::getWorkingDirectoryStatus()
 
 		string staged_hash;
 		if (exists_in_index) {
-			staged_hash = index[file_path];
+			staged_hash = index.sha(index_pos);
 			status.staged_hash = staged_hash;
 		}
 
 		string working_hash;
 		if (exists_in_working) {
-			working_hash = calculateWorkingFileHash(full_path);
+			auto hash_it = working_hashes.find(file_path);
+			if (hash_it != working_hashes.end()) {
+				working_hash = hash_it->second;
+			}
 			status.working_hash = working_hash;
 		}
 
@@ -1,4 +1,5 @@
 #include "commands_remote.h"
+#include "commit_graph.h"
 #include "client.h"
 
 string CommandsRemote::getRemote() {
@@ -50,12 +51,24 @@ int CommandsRemote::push(vector<string> args) {
 			if (args[i] == "--password" && i + 1 < args.size()) {
 				password = args[i + 1];
 				i++;
+			} else if (args[i] == "--compress" && i + 1 < args.size()) {
+				Config::getInstance().compression = args[i + 1];
+				i++;
+			} else if (args[i] == "--plaintext") {
+				Config::getInstance().plaintext = true;
+			} else if (args[i] == "--checksum" && i + 1 < args.size()) {
+				if (!Checksum::parse(args[i + 1], Config::getInstance().checksum)) {
+					cerr << "Unknown checksum: " << args[i + 1] << " (crc32, crc32c or xxh32)\n";
+					return 1;
+				}
+				i++;
 			}
 		}
 
 		if (password.empty()) {
 			cerr << "Network push requires --password option\n";
-			cerr << "Usage: minigit push --password <password>\n";
+			cerr << "Usage: minigit push --password <password> [--compress <codec>] [--plaintext]\n"
+					"       [--checksum <algorithm>]\n";
 			return 1;
 		}
 
@@ -73,16 +86,24 @@ int CommandsRemote::push(vector<string> args) {
 	// 原有的本地文件系统push逻辑
 	fs::path r = remote;
 	fs::create_directories(r / "objects");
+	FileSystemUtils::migrateObjectLayout(r / "objects");
 	// copy all local objects not present remotely
-	for (auto &e : fs::directory_iterator(FileSystemUtils::getInstance().objectsDir())) {
-		auto id = e.path().filename().string();
-		if (!fs::exists(r / "objects" / id))
-			fs::copy_file(e.path(), r / "objects" / id, fs::copy_options::overwrite_existing);
+	fs::path local_objects = FileSystemUtils::getInstance().objectsDir();
+	for (auto &e : fs::recursive_directory_iterator(local_objects)) {
+		// 提交图由各仓库自己维护
+		if (!e.is_regular_file() || e.path() == CommitGraph::graphPath(local_objects))
+			continue;
+		fs::path dst = r / "objects" / fs::relative(e.path(), local_objects);
+		if (!fs::exists(dst)) {
+			fs::create_directories(dst.parent_path());
+			fs::copy_file(e.path(), dst, fs::copy_options::overwrite_existing);
+		}
 	}
 	// update remote HEAD
 	string head =
 		FileSystemUtils::getInstance().readText(FileSystemUtils::getInstance().headPath());
 	FileSystemUtils::getInstance().writeText(r / "HEAD", head);
+	CommitGraph::forDirectory(r / "objects")->add(head);
 	cout << "Pushed to " << remote << " (HEAD=" << head.substr(0, 12) << ")\n";
 	return 0;
 }
@@ -103,12 +124,31 @@ int CommandsRemote::pull(vector<string> args) {
 			if (args[i] == "--password" && i + 1 < args.size()) {
 				password = args[i + 1];
 				i++;
+			} else if (args[i] == "--compress" && i + 1 < args.size()) {
+				Config::getInstance().compression = args[i + 1];
+				i++;
+			} else if (args[i] == "--plaintext") {
+				Config::getInstance().plaintext = true;
+			} else if (args[i] == "--checksum" && i + 1 < args.size()) {
+				if (!Checksum::parse(args[i + 1], Config::getInstance().checksum)) {
+					cerr << "Unknown checksum: " << args[i + 1] << " (crc32, crc32c or xxh32)\n";
+					return 1;
+				}
+				i++;
+			} else if (args[i] == "--deepen" && i + 1 < args.size()) {
+				Config::getInstance().depth = atoi(args[i + 1].c_str());
+				if (Config::getInstance().depth <= 0) {
+					cerr << "--deepen must be a positive number\n";
+					return 1;
+				}
+				i++;
 			}
 		}
 
 		if (password.empty()) {
 			cerr << "Network pull requires --password option\n";
-			cerr << "Usage: minigit pull --password <password>\n";
+			cerr << "Usage: minigit pull --password <password> [--compress <codec>] [--plaintext]\n"
+					"       [--checksum <algorithm>] [--deepen <n>]\n";
 			return 1;
 		}
 
@@ -131,15 +171,23 @@ int CommandsRemote::pull(vector<string> args) {
 		return 1;
 	}
 	// copy objects from remote
-	for (auto &e : fs::directory_iterator(r / "objects")) {
-		auto id = e.path().filename().string();
-		if (!fs::exists(FileSystemUtils::getInstance().objectsDir() / id))
-			fs::copy_file(e.path(), r / "objects" / id, fs::copy_options::overwrite_existing);
+	FileSystemUtils::migrateObjectLayout(r / "objects");
+	for (auto &e : fs::recursive_directory_iterator(r / "objects")) {
+		if (!e.is_regular_file() || e.path() == CommitGraph::graphPath(r / "objects"))
+			continue;
+		fs::path dst =
+			FileSystemUtils::getInstance().objectsDir() / fs::relative(e.path(), r / "objects");
+		if (!fs::exists(dst)) {
+			fs::create_directories(dst.parent_path());
+			fs::copy_file(e.path(), dst, fs::copy_options::overwrite_existing);
+		}
 	}
 	// update local HEAD to remote's HEAD
 	string rhead = FileSystemUtils::getInstance().readText(r / "HEAD");
-	if (!rhead.empty())
+	if (!rhead.empty()) {
 		FileSystemUtils::getInstance().writeText(FileSystemUtils::getInstance().headPath(), rhead);
+		CommitGraph::forDirectory(FileSystemUtils::getInstance().objectsDir())->add(rhead);
+	}
 	cout << "Pulled from " << remote << " (HEAD=" << rhead.substr(0, 12) << ")\n";
 	return 0;
 }
@@ -250,6 +298,15 @@ int CommandsRemote::networkPull(const NetworkRemote &remote, const string &passw
 		return 1;
 	}
 
+	// --deepen 只补充浅克隆缺少的历史，不更新 HEAD
+	if (Config::getInstance().depth > 0) {
+		if (!client.deepen(Config::getInstance().depth)) {
+			cerr << "Deepen failed\n";
+			return 1;
+		}
+		return 0;
+	}
+
 	// 执行 pull
 	if (!client.pull()) {
 		cerr << "Pull failed\n";
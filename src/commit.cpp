@@ -1,4 +1,9 @@
 ﻿#include "commit.h"
+#include "objects.h"
+#include "commit_graph.h"
+#include "object_cache.h"
+#include "trees.h"
+#include <cstring>
 
 string CommitManager::nowISO8601() {
 	using namespace std::chrono;
@@ -15,50 +20,48 @@ string CommitManager::nowISO8601() {
 	return string(buf);
 }
 
-std::set<string> CommitManager::commitsCount(const string &newer, const string &older) {
-	string parent_head = newer;
-	int commits_count = 0;
-	std::set<string> head;
-	while (parent_head != older) {
-		auto commits = CommitManager::loadCommit(parent_head);
-
-		if (commits) {
-			commits_count += 1;
-			head.insert(parent_head);
-			parent_head = commits->parent;
-		}
-	}
-	return head;
+namespace {
+const char COMMIT_MAGIC[3] = {'M', 'G', 'C'};
+// 版本1内嵌扁平文件列表，版本2引用根树对象
+const uint8_t COMMIT_VERSION = 2;
+
+void appendU32(string &s, uint32_t v) {
+	s.append(reinterpret_cast<const char *>(&v), sizeof(v));
 }
 
-string CommitManager::serializeCommit(const Commit &c) {
-	// naive JSON (no escaping for simplicity)
-	string s = "{\n";
-	s += R"(  "parent": ")" + c.parent + "\",\n";
-	s += R"(  "message": ")" + c.message + "\",\n";
-	s += R"(  "timestamp": ")" + c.timestamp + "\",\n";
-	s += R"(  "tree": {\n)";
-	// bool first = true;
-	for (const auto &[fst, snd] : c.tree) {
-		s += string("    ") + "\"" + fst + "\": \"" + snd + "\",\n";
-	}
-	if (!c.tree.empty())
-		s.pop_back(), s.pop_back(), s += "\n"; // remove last comma
-	s += "  }\n";
-	s += "}\n";
-	// compute id as sha256 of this text
-	vector<unsigned char> bytes(s.begin(), s.end());
-	string id = sha256_bytes(bytes);
-	return id + "\n" + s; // return with leading id on first line for storage convenience
+void appendField(string &s, const string &v) {
+	appendU32(s, static_cast<uint32_t>(v.size()));
+	s.append(v);
 }
 
-Commit CommitManager::deserializeCommit(const string &raw) {
+// 顺序读取二进制提交中的字段
+struct ByteReader {
+	string_view rest;
+
+	bool take(size_t n, string_view &out) {
+		if (rest.size() < n)
+			return false;
+		out = rest.substr(0, n);
+		rest.remove_prefix(n);
+		return true;
+	}
+	bool u32(uint32_t &v) {
+		string_view b;
+		if (!take(sizeof(v), b))
+			return false;
+		memcpy(&v, b.data(), sizeof(v));
+		return true;
+	}
+	bool field(string_view &out) {
+		uint32_t len;
+		return u32(len) && take(len, out);
+	}
+};
+
+// 旧版本的JSON提交格式
+Commit deserializeLegacyCommit(const string &id, const string &j) {
 	Commit c;
-	string s = raw;
-	auto nl = s.find('\n');
-	string idline = s.substr(0, nl);
-	c.id = idline;
-	string j = s.substr(nl + 1);
+	c.id = id;
 	auto fp = [&](const string &k) {
 		size_t p = j.find("\"" + k + "\"");
 		if (p == string::npos)
@@ -96,36 +99,278 @@ Commit CommitManager::deserializeCommit(const string &raw) {
 	}
 	return c;
 }
+} // namespace
+
+std::set<string> CommitManager::commitsCount(const string &newer, const string &older) {
+	return commitsCount(RepoContext::current(), newer, older);
+}
+
+std::set<string> CommitManager::commitsCount(const RepoContext &repo, const string &newer,
+											 const string &older) {
+	// 按提交图中的父提交下标遍历，不读取提交对象
+	auto ids = repo.graph().history(newer, older);
+	return std::set<string>(ids.begin(), ids.end());
+}
+
+map<string, string> CommitManager::historicalFiles(const string &head) {
+	map<string, string> files;
+	fs::path objects_dir = FileSystemUtils::getInstance().objectsDir();
+	auto graph = CommitGraph::forDirectory(objects_dir);
+	string child_root;
+	for (const auto &id : graph->history(head)) {
+		CommitGraph::Entry entry;
+		graph->find(id, entry);
+		if (entry.root_tree.empty()) {
+			// 旧格式的提交没有树对象，只能展开完整的文件列表
+			auto c = loadCommit(id);
+			if (!c)
+				break;
+			for (const auto &kv : c->tree)
+				files.emplace(kv.first, kv.second);
+		} else if (child_root.empty()) {
+			Trees::diff(objects_dir, "", entry.root_tree,
+						[&files](const string &path, const string &, const string &blob) {
+							files.emplace(path, blob);
+						});
+		} else {
+			// 较新提交中已有的路径保留新版本，只需要补充父提交中不同的部分
+			Trees::diff(objects_dir, child_root, entry.root_tree,
+						[&files](const string &path, const string &, const string &blob) {
+							if (!blob.empty())
+								files.emplace(path, blob);
+						});
+		}
+		child_root = entry.root_tree;
+	}
+	return files;
+}
+
+string CommitManager::serializeCommit(const Commit &c) {
+	string s;
+	s.reserve(sizeof(COMMIT_MAGIC) + 2 + 20 + 8 + c.timestamp.size() + c.message.size() + 20);
+	s.append(COMMIT_MAGIC, sizeof(COMMIT_MAGIC));
+	s.push_back(static_cast<char>(COMMIT_VERSION));
+	unsigned char raw[20];
+	if (c.parent.empty()) {
+		s.push_back(0);
+	} else {
+		if (!sha1_from_hex(c.parent, raw))
+			throw runtime_error("Invalid parent commit id: " + c.parent);
+		s.push_back(1);
+		s.append(reinterpret_cast<const char *>(raw), 20);
+	}
+	appendField(s, c.timestamp);
+	appendField(s, c.message);
+	if (!sha1_from_hex(c.root_tree, raw))
+		throw runtime_error("Invalid root tree id: " + c.root_tree);
+	s.append(reinterpret_cast<const char *>(raw), 20);
+
+	// 提交ID为提交对象内容的哈希
+	unsigned char id_raw[20];
+	SHA1 hasher;
+	hasher.init();
+	hasher.update(reinterpret_cast<const unsigned char *>(s.data()), s.size());
+	hasher.finalize(id_raw);
+	// return with leading id on first line for storage convenience
+	return sha1_to_hex(id_raw) + "\n" + s;
+}
+
+bool CommitView::isBinary(string_view body) {
+	return body.size() > sizeof(COMMIT_MAGIC) &&
+		   memcmp(body.data(), COMMIT_MAGIC, sizeof(COMMIT_MAGIC)) == 0;
+}
+
+bool CommitView::parse(string_view body) {
+	if (!isBinary(body))
+		return false;
+	ByteReader r{body.substr(sizeof(COMMIT_MAGIC))};
+	string_view b;
+	if (!r.take(1, b))
+		return false;
+	version = static_cast<uint8_t>(b[0]);
+	if (version != 1 && version != 2)
+		return false;
+	if (!r.take(1, b))
+		return false;
+	parent = nullptr;
+	if (b[0]) {
+		if (!r.take(20, b))
+			return false;
+		parent = reinterpret_cast<const unsigned char *>(b.data());
+	}
+	if (!r.field(timestamp) || !r.field(message))
+		return false;
+
+	root_tree = nullptr;
+	entry_count = 0;
+	entries = string_view();
+	if (version == 2) {
+		if (!r.take(20, b))
+			return false;
+		root_tree = reinterpret_cast<const unsigned char *>(b.data());
+		return true;
+	}
+	if (!r.u32(entry_count))
+		return false;
+	entries = r.rest;
+	return true;
+}
+
+bool CommitView::forEachEntry(
+	const function<void(string_view path, const unsigned char *sha)> &fn) const {
+	ByteReader r{entries};
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		string_view path, sha;
+		if (!r.field(path) || !r.take(20, sha))
+			return false;
+		fn(path, reinterpret_cast<const unsigned char *>(sha.data()));
+	}
+	return true;
+}
+
+bool CommitManager::parseCommitBody(const string &id, string_view body, Commit &c,
+									bool with_tree) {
+	c.id = id;
+	if (!CommitView::isBinary(body)) {
+		// 旧版本的JSON格式
+		c = deserializeLegacyCommit(id, string(body));
+		if (!with_tree)
+			c.tree.clear();
+		return true;
+	}
+
+	CommitView view;
+	if (!view.parse(body))
+		return false;
+	c.parent = view.parent ? sha1_to_hex(view.parent) : string();
+	c.timestamp.assign(view.timestamp);
+	c.message.assign(view.message);
+	c.root_tree = view.root_tree ? sha1_to_hex(view.root_tree) : string();
+	c.tree.clear();
+	if (!with_tree || view.version != 1)
+		return true;
+	// 条目已按路径排序，从尾部插入
+	return view.forEachEntry([&c](string_view path, const unsigned char *sha) {
+		c.tree.emplace_hint(c.tree.end(), string(path), sha1_to_hex(sha));
+	});
+}
+
+Commit CommitManager::deserializeCommit(const string &raw) {
+	auto nl = raw.find('\n');
+	string id = raw.substr(0, nl);
+	string_view body = nl == string::npos ? string_view() : string_view(raw).substr(nl + 1);
+	Commit c;
+	if (!parseCommitBody(id, body, c, true))
+		throw runtime_error("Corrupt commit object: " + id);
+	return c;
+}
 
 string CommitManager::storeCommit(const Commit &c) {
-	string payload = serializeCommit(c);
+	return storeCommit(RepoContext::current(), c);
+}
+
+string CommitManager::storeCommit(const RepoContext &repo, const Commit &c) {
+	// 按目录写出树对象，未变化的子目录对应已有的树对象
+	Commit stored = c;
+	const fs::path &objects_dir = repo.objectsDir();
+	if (stored.root_tree.empty())
+		stored.root_tree = Trees::store(objects_dir, c.tree);
+
+	string payload = serializeCommit(stored);
 	auto nl = payload.find('\n');
 	string id = payload.substr(0, nl);
 	string body = payload.substr(nl + 1);
-	fs::path dst = FileSystemUtils::getInstance().objectsDir() / id;
+	fs::path dst = FileSystemUtils::objectPath(objects_dir, id);
 	if (!fs::exists(dst)) {
-		ofstream f(dst, ios::binary);
-		f << body;
+		fs::create_directories(dst.parent_path());
+		// 提交对象小且只写一次，使用LZ4HC换取更高的压缩率
+		LooseObject::write(dst, ObjectType::Commit, reinterpret_cast<const uint8_t *>(body.data()),
+						   body.size(), true);
 	}
-	FileSystemUtils::getInstance().writeText(FileSystemUtils::getInstance().headPath(), id);
+	repo.graph().add(id);
+	repo.refs().setHead(id);
 	return id;
 }
 
-optional<Commit> CommitManager::loadCommit(const string &id) {
-	fs::path p = FileSystemUtils::getInstance().objectsDir() / id;
-	// cout << "loadCommit " << p.string() << endl;
-	if (!fs::exists(p))
+optional<Commit> CommitManager::readCommit(const fs::path &objects_dir, const string &id,
+										   bool with_tree) {
+	// 缓存中保存不含文件树的提交，命中时不访问文件系统
+	auto cache = ObjectCache::forDirectory(objects_dir);
+	auto cached = cache->getCommit(id);
+	Commit c;
+	if (cached) {
+		c = *cached;
+	} else {
+		// 只看文件头就能排除blob，避免解压大文件
+		ObjectInfo info;
+		if (!Objects::objectInfo(objects_dir, id, info) || info.type == ObjectType::Blob ||
+			info.type == ObjectType::Tree)
+			return nullopt;
+		// 提交可能是松散对象，也可能已经被打包
+		vector<uint8_t> data;
+		if (!Objects::readObject(objects_dir, id, data))
+			return nullopt;
+		string_view body(reinterpret_cast<const char *>(data.data()), data.size());
+		if (!parseCommitBody(id, body, c, false))
+			return nullopt;
+		cache->putCommit(id, make_shared<const Commit>(c));
+	}
+	if (!with_tree)
+		return c;
+
+	if (!c.root_tree.empty())
+		return Trees::flatten(objects_dir, c.root_tree, c.tree) ? optional<Commit>(c) : nullopt;
+	// 旧格式的文件列表在提交对象内部，重新解析（对象内容同样有缓存）
+	vector<uint8_t> data;
+	if (!Objects::readObject(objects_dir, id, data))
+		return nullopt;
+	string_view body(reinterpret_cast<const char *>(data.data()), data.size());
+	if (!parseCommitBody(id, body, c, true))
 		return nullopt;
-	string body = FileSystemUtils::getInstance().readText(p);
-	Commit c = deserializeCommit(id + "\n" + body);
 	return c;
 }
 
+optional<Commit> CommitManager::loadCommit(const string &id) {
+	return loadCommit(RepoContext::current(), id);
+}
+
+optional<Commit> CommitManager::loadCommit(const RepoContext &repo, const string &id) {
+	return readCommit(repo.objectsDir(), id, true);
+}
+
+optional<Commit> CommitManager::loadCommitHeader(const string &id) {
+	return loadCommitHeader(RepoContext::current(), id);
+}
+
+optional<Commit> CommitManager::loadCommitHeader(const RepoContext &repo, const string &id) {
+	return readCommit(repo.objectsDir(), id, false);
+}
+
+vector<string> CommitManager::objectsIntroduced(const fs::path &objects_dir, const string &id) {
+	vector<string> ids;
+	auto c = readCommit(objects_dir, id, false);
+	if (!c)
+		return ids;
+	if (c->root_tree.empty()) {
+		// 旧格式：提交中直接列出了全部文件
+		c = readCommit(objects_dir, id, true);
+		if (!c)
+			return ids;
+		for (const auto &kv : c->tree)
+			ids.push_back(kv.second);
+		return ids;
+	}
+
+	string parent_root;
+	if (!c->parent.empty()) {
+		auto parent = readCommit(objects_dir, c->parent, false);
+		if (parent)
+			parent_root = parent->root_tree;
+	}
+	Trees::newObjects(objects_dir, parent_root, c->root_tree, ids);
+	return ids;
+}
+
 optional<Commit> CommitManager::loadCommit(const string repo_name, const string &id) {
-	fs::path p = FileSystemUtils::getInstance().objectsDir() / id;
-	if (!fs::exists(p))
-		return nullopt;
-	string body = FileSystemUtils::getInstance().readText(p);
-	Commit c = deserializeCommit(id + "\n" + body);
-	return c;
+	return loadCommit(id);
 }
\ No newline at end of file
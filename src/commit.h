@@ -2,7 +2,10 @@
 
 #include "common.h"
 #include "filesystem_utils.h"
+#include "repo_context.h"
 #include "sha256.h"
+#include <functional>
+#include <string_view>
 
 /**
  * 提交数据结构
@@ -12,7 +15,34 @@ struct Commit {
 	string parent;
 	string message;
 	string timestamp;
-	map<string, string> tree;
+	map<string, string> tree; // 扁平的 路径 -> blob哈希，只在需要文件列表时展开
+	string root_tree;		  // 根目录树对象（旧格式的提交为空）
+};
+
+/**
+ * 二进制提交对象的只读视图
+ * 格式："MGC" + 版本(1字节) + 是否有父提交(1字节) + [20字节父提交哈希]
+ *   + u32长度 + 时间戳 + u32长度 + 提交信息，之后
+ *   版本2：20字节根树哈希
+ *   版本1：u32条目数 + 每个树条目：u32路径长度 + 路径 + 20字节对象哈希（按路径排序）
+ * 字段直接指向对象数据，不做拷贝，数据的生命周期由调用方保证
+ */
+struct CommitView {
+	uint8_t version = 0;
+	const unsigned char *parent = nullptr; // 没有父提交时为nullptr
+	string_view timestamp;
+	string_view message;
+	const unsigned char *root_tree = nullptr; // 版本2
+	uint32_t entry_count = 0;				   // 版本1
+	string_view entries;					   // 版本1的树条目区域
+
+	// 是否是二进制格式（旧的JSON格式以 '{' 开头）
+	static bool isBinary(string_view body);
+
+	bool parse(string_view body);
+
+	// 依次访问版本1的树条目，条目格式错误时返回false
+	bool forEachEntry(const function<void(string_view path, const unsigned char *sha)> &fn) const;
 };
 
 /**
@@ -22,15 +52,37 @@ struct Commit {
 class CommitManager {
   public:
 	// 提交操作
+	// 不带仓库参数的版本使用命令行当前所在的仓库
 	static string storeCommit(const Commit &c);
+	static string storeCommit(const RepoContext &repo, const Commit &c);
 	static optional<Commit> loadCommit(const string &id);
+	static optional<Commit> loadCommit(const RepoContext &repo, const string &id);
 	static optional<Commit> loadCommit(string repo_name, const string &id);
+	// 只读取父提交、时间、提交信息和根树哈希，不展开文件树（用于遍历历史）
+	static optional<Commit> loadCommitHeader(const string &id);
+	static optional<Commit> loadCommitHeader(const RepoContext &repo, const string &id);
+	// 从指定对象目录读取提交，with_tree 为true时展开文件树
+	static optional<Commit> readCommit(const fs::path &objects_dir, const string &id,
+									   bool with_tree);
+
+	/**
+	 * 提交相对其父提交新引入的对象（变化的树对象和blob），不包括提交本身
+	 * 父提交为空时返回整棵树；旧格式的提交返回全部文件
+	 */
+	static vector<string> objectsIntroduced(const fs::path &objects_dir, const string &id);
 
 	// 序列化操作
 	static string serializeCommit(const Commit &c);
+	// 不读取树对象：新格式的提交只得到 root_tree，tree 为空
 	static Commit deserializeCommit(const string &raw);
+	// 解析提交对象内容（二进制或旧的JSON格式），with_tree 为false时跳过旧格式中的文件树
+	static bool parseCommitBody(const string &id, string_view body, Commit &c, bool with_tree);
 
 	// 工具函数
 	static string nowISO8601();
 	static std::set<string> commitsCount(const string &newer, const string &older);
+	static std::set<string> commitsCount(const RepoContext &repo, const string &newer,
+										 const string &older);
+	// 历史提交中出现过的所有文件，同一路径取最新提交中的版本
+	static map<string, string> historicalFiles(const string &head);
 };
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "commit_graph.h"
+#include "commit.h"
+#include "objects.h"
+#include "sha256.h"
+#include <cstring>
+#include <iomanip>
+
+namespace {
+const char GRAPH_MAGIC[4] = {'M', 'G', 'C', 'G'};
+const uint8_t GRAPH_VERSION = 1;
+constexpr uint32_t NO_PARENT = 0xFFFFFFFF;
+
+#pragma pack(push, 1)
+struct GraphHeader {
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t count;
+};
+
+struct GraphRow {
+	unsigned char id[20];
+	unsigned char root_tree[20]; // 全0表示旧格式的提交
+	uint32_t parent;			 // 父提交的记录下标，没有父提交为 NO_PARENT
+	uint32_t generation;
+	int64_t timestamp;
+};
+#pragma pack(pop)
+
+mutex graphs_mutex;
+unordered_map<string, shared_ptr<CommitGraph>> graphs;
+
+// 提交时间为本地时间的 ISO8601 字符串
+int64_t parseTimestamp(const string &ts) {
+	std::tm tm{};
+	istringstream in(ts);
+	in >> get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+	if (in.fail())
+		return 0;
+	tm.tm_isdst = -1;
+	return static_cast<int64_t>(mktime(&tm));
+}
+
+const GraphRow *rowsOf(const MappedFile &file) {
+	return reinterpret_cast<const GraphRow *>(file.data() + sizeof(GraphHeader));
+}
+} // namespace
+
+shared_ptr<CommitGraph> CommitGraph::forDirectory(const fs::path &objects_dir) {
+	fs::path dir = fs::absolute(objects_dir).lexically_normal();
+	lock_guard<mutex> lock(graphs_mutex);
+	auto &graph = graphs[dir.string()];
+	if (!graph)
+		graph.reset(new CommitGraph(dir));
+	return graph;
+}
+
+bool CommitGraph::reload() {
+	fs::path path = graphPath(objects_dir);
+	error_code ec;
+	uintmax_t size = fs::file_size(path, ec);
+	if (!ec && file.isOpen() && size == file.size())
+		return false;
+
+	file.close();
+	uint32_t old_count = count;
+	const GraphHeader *header = nullptr;
+	if (!ec && file.open(path) && file.size() >= sizeof(GraphHeader))
+		header = reinterpret_cast<const GraphHeader *>(file.data());
+	if (!header || memcmp(header->magic, GRAPH_MAGIC, 4) != 0 ||
+		header->version != GRAPH_VERSION) {
+		// 文件不存在或已损坏，下次追加时重新生成
+		file.close();
+		count = 0;
+		positions.clear();
+		return false;
+	}
+
+	uint64_t available = (file.size() - sizeof(GraphHeader)) / sizeof(GraphRow);
+	uint32_t n = static_cast<uint32_t>(min<uint64_t>(header->count, available));
+	if (n < count) {
+		// 文件被重新生成过
+		count = 0;
+		positions.clear();
+	}
+	const GraphRow *rows = rowsOf(file);
+	for (uint32_t i = count; i < n; ++i)
+		positions.emplace(string(reinterpret_cast<const char *>(rows[i].id), 20), i);
+	count = n;
+	return count > old_count;
+}
+
+bool CommitGraph::lookup(const string &id, uint32_t &pos) {
+	unsigned char raw[20];
+	if (!sha1_from_hex(id, raw))
+		return false;
+	string key(reinterpret_cast<const char *>(raw), 20);
+	auto it = positions.find(key);
+	if (it == positions.end() && reload())
+		it = positions.find(key);
+	if (it == positions.end())
+		return false;
+	pos = it->second;
+	return true;
+}
+
+CommitGraph::Entry CommitGraph::entryAt(uint32_t pos) const {
+	static const unsigned char zero[20] = {};
+	const GraphRow &row = rowsOf(file)[pos];
+	Entry e;
+	e.id = sha1_to_hex(row.id);
+	if (row.parent < pos)
+		e.parent = sha1_to_hex(rowsOf(file)[row.parent].id);
+	if (memcmp(row.root_tree, zero, 20) != 0)
+		e.root_tree = sha1_to_hex(row.root_tree);
+	e.generation = row.generation;
+	e.timestamp = row.timestamp;
+	return e;
+}
+
+bool CommitGraph::addLocked(const string &id, uint32_t &pos) {
+	if (lookup(id, pos))
+		return true;
+	auto b = broken.find(id);
+	if (b != broken.end()) {
+		ObjectInfo info;
+		if (!Objects::objectInfo(objects_dir, b->second, info))
+			return false;
+		// 缺失的祖先已补齐（加深或推送），之前的记录全部作废
+		broken.clear();
+	}
+
+	// 沿父提交读取不在图中的提交，直到遇到已有的祖先或根提交
+	vector<Commit> missing;
+	uint32_t parent_pos = NO_PARENT;
+	string current = id;
+	set<string> seen;
+	while (!current.empty()) {
+		if (lookup(current, parent_pos))
+			break;
+		auto c = CommitManager::readCommit(objects_dir, current, false);
+		if (!c || !seen.insert(current).second) {
+			broken[id] = current;
+			for (auto &commit : missing)
+				broken[commit.id] = current;
+			return false;
+		}
+		current = c->parent;
+		missing.push_back(std::move(*c));
+	}
+
+	// 祖先在前，保证父提交的下标总是小于子提交
+	vector<GraphRow> rows;
+	rows.reserve(missing.size());
+	uint32_t generation = parent_pos == NO_PARENT ? 0 : rowsOf(file)[parent_pos].generation;
+	uint32_t next = count;
+	for (auto it = missing.rbegin(); it != missing.rend(); ++it) {
+		GraphRow row{};
+		sha1_from_hex(it->id, row.id);
+		if (!it->root_tree.empty())
+			sha1_from_hex(it->root_tree, row.root_tree);
+		row.parent = parent_pos;
+		row.generation = ++generation;
+		row.timestamp = parseTimestamp(it->timestamp);
+		rows.push_back(row);
+		parent_pos = next++;
+	}
+
+	fs::path path = graphPath(objects_dir);
+	error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	// 写入前解除映射（Windows 不允许截断已映射的文件）
+	file.close();
+	{
+		fstream out;
+		if (count == 0)
+			out.open(path, ios::binary | ios::out | ios::trunc);
+		else
+			out.open(path, ios::binary | ios::in | ios::out);
+		if (!out.is_open())
+			return false;
+
+		// 先追加记录再回填记录数，中途失败时多出的记录会被忽略
+		out.seekp(sizeof(GraphHeader) + static_cast<uint64_t>(count) * sizeof(GraphRow));
+		out.write(reinterpret_cast<const char *>(rows.data()), rows.size() * sizeof(GraphRow));
+		GraphHeader header{};
+		memcpy(header.magic, GRAPH_MAGIC, 4);
+		header.version = GRAPH_VERSION;
+		header.count = next;
+		out.seekp(0);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		if (!out.good())
+			return false;
+	}
+	reload();
+	return lookup(id, pos);
+}
+
+bool CommitGraph::add(const string &id) {
+	lock_guard<mutex> lock(m);
+	uint32_t pos;
+	return addLocked(id, pos);
+}
+
+bool CommitGraph::find(const string &id, Entry &entry) {
+	lock_guard<mutex> lock(m);
+	uint32_t pos;
+	if (!addLocked(id, pos))
+		return false;
+	entry = entryAt(pos);
+	return true;
+}
+
+vector<string> CommitGraph::history(const string &from, const string &stop, size_t limit) {
+	lock_guard<mutex> lock(m);
+	vector<string> ids;
+	string current = from;
+	while (!current.empty() && current != stop && ids.size() < limit) {
+		uint32_t pos;
+		if (addLocked(current, pos)) {
+			uint32_t stop_pos = NO_PARENT;
+			if (!stop.empty())
+				lookup(stop, stop_pos);
+			const GraphRow *rows = rowsOf(file);
+			while (ids.size() < limit && pos != stop_pos) {
+				ids.push_back(sha1_to_hex(rows[pos].id));
+				if (rows[pos].parent >= pos)
+					break;
+				pos = rows[pos].parent;
+			}
+			break;
+		}
+
+		// 祖先对象不完整，无法加入提交图，只能逐个读取提交对象
+		auto c = CommitManager::readCommit(objects_dir, current, false);
+		if (!c)
+			break;
+		ids.push_back(current);
+		current = c->parent;
+	}
+	return ids;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include "mapped_file.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * 提交图文件
+ * objects/info/commit-graph：文件头（魔数 "MGCG"、版本、提交数）+ 定长记录表，
+ *   每条记录为 20字节提交哈希 + 20字节根树哈希 + u32父提交下标 + u32代数 + i64时间戳；
+ * 父提交总是排在子提交之前，新提交只追加到末尾。文件通过mmap读取，
+ * 遍历历史时按父提交下标跳转，不需要读取提交对象
+ */
+class CommitGraph {
+public:
+	struct Entry {
+		string id;
+		string parent;			 // 没有父提交时为空
+		string root_tree;		 // 旧格式的提交为空
+		uint32_t generation = 0; // 到根提交的提交数，根提交为1
+		int64_t timestamp = 0;	 // 秒，无法解析时为0
+	};
+
+	static shared_ptr<CommitGraph> forDirectory(const fs::path &objects_dir);
+	static fs::path graphPath(const fs::path &objects_dir) {
+		return objects_dir / "info" / "commit-graph";
+	}
+
+	/**
+	 * 把提交及其缺失的祖先加入提交图（提交、push、pull之后调用）
+	 * 只有不在图中的提交才会读取提交对象；祖先对象不完整时返回false
+	 */
+	bool add(const string &id);
+
+	bool find(const string &id, Entry &entry);
+
+	/**
+	 * 从 from 开始沿父提交向前遍历，包括 from、不包括 stop，最多 limit 个，由新到旧返回
+	 * stop 不是 from 的祖先时一直遍历到根提交；祖先链不完整时退回逐个读取提交对象
+	 */
+	vector<string> history(const string &from, const string &stop = "",
+						   size_t limit = SIZE_MAX);
+
+private:
+	explicit CommitGraph(const fs::path &objects_dir) : objects_dir(objects_dir) {}
+
+	mutex m;
+	fs::path objects_dir;
+	MappedFile file;
+	uint32_t count = 0;
+	unordered_map<string, uint32_t> positions; // 20字节原始哈希 -> 记录下标
+	// 因祖先缺失而无法加入的提交 -> 缺失的祖先；浅克隆里每个提交都会命中，
+	// 记下断点避免每次都沿父链重新读到断点
+	unordered_map<string, string> broken;
+
+	// 文件被其他进程追加过时重新映射，返回是否有新记录
+	bool reload();
+	bool lookup(const string &id, uint32_t &pos);
+	bool addLocked(const string &id, uint32_t &pos);
+	Entry entryAt(uint32_t pos) const;
+};
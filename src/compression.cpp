@@ -1,11 +1,170 @@
 #include "compression.h"
 #include "filesystem_utils.h"
+#include "thread_pool.h"
+#include <cmath>
 #include <cstring>
 #include <iomanip>
 #include <lz4.h>
+#include <lz4frame.h>
+#include <lz4hc.h>
 #include <sstream>
 
-#include "utils.h"
+namespace {
+// 流式归档与旧格式使用相同的魔数，版本号为2
+constexpr uint32_t STREAM_MAGIC = 0x4D474954;
+constexpr uint32_t STREAM_VERSION = 2;
+// 从磁盘分段读取文件时每段的大小
+constexpr size_t INPUT_PIECE = 256 * 1024;
+
+#pragma pack(push, 1)
+struct StreamHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t checksum; // ChecksumType，旧版本此处为0（CRC32）
+	uint8_t reserved;
+};
+
+struct StreamEntry {
+	uint32_t path_length; // 为0表示归档结束
+	uint64_t file_size;
+};
+#pragma pack(pop)
+
+// 条目路径长度上限（与常见系统的 PATH_MAX 相同），防止对端用超长路径让解压器无限缓存
+constexpr uint32_t MAX_ENTRY_PATH = 4096;
+
+// 单个帧解压后的大小上限，防止恶意数据导致分配过多内存
+constexpr uint64_t MAX_FRAME_CONTENT = 16 * ArchiveWriter::BLOCK_SIZE;
+
+// 块类型（每块数据的第一个字节）
+constexpr uint8_t BLOCK_STORED = 0;
+constexpr uint8_t BLOCK_LZ4F = 1;
+
+// LZ4 快速模式支持的最大加速倍数（见 lz4.c 中的 LZ4_ACCELERATION_MAX）
+constexpr int MAX_ACCELERATION = 65537;
+
+// 抽样熵（比特/字节）超过此值的块视为已压缩数据
+constexpr double INCOMPRESSIBLE_ENTROPY = 7.5;
+
+// 在块内均匀取若干段统计字节分布，估计香农熵
+bool looksIncompressible(const vector<uint8_t> &data) {
+	constexpr size_t SAMPLES = 16;
+	constexpr size_t SAMPLE_SIZE = 256;
+	if (data.size() < SAMPLES * SAMPLE_SIZE)
+		return false; // 太小的块直接压缩，代价可以忽略
+	size_t counts[256] = {};
+	size_t stride = data.size() / SAMPLES;
+	for (size_t i = 0; i < SAMPLES; ++i) {
+		const uint8_t *p = data.data() + i * stride;
+		for (size_t k = 0; k < SAMPLE_SIZE; ++k)
+			counts[p[k]]++;
+	}
+	double entropy = 0;
+	const double total = SAMPLES * SAMPLE_SIZE;
+	for (size_t c : counts) {
+		if (c == 0)
+			continue;
+		double p = c / total;
+		entropy -= p * log2(p);
+	}
+	return entropy > INCOMPRESSIBLE_ENTROPY;
+}
+
+// 每块独立压缩为一个带内容大小的帧，解压时可以预先分配输出空间
+LZ4F_preferences_t framePrefs(size_t content_size, const CompressionOptions &options) {
+	LZ4F_preferences_t prefs = LZ4F_INIT_PREFERENCES;
+	prefs.frameInfo.blockSizeID = LZ4F_max1MB;
+	prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+	prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+	prefs.frameInfo.contentSize = content_size;
+	// LZ4F：负数为快速模式的加速倍数，0 为默认快速模式，不小于 LZ4HC_CLEVEL_MIN 为 HC 模式
+	if (options.codec == CompressionCodec::Lz4Hc)
+		prefs.compressionLevel = options.level;
+	else
+		prefs.compressionLevel = options.level > 1 ? -options.level : 0;
+	return prefs;
+}
+
+void storeBlock(const vector<uint8_t> &in, vector<uint8_t> &out) {
+	out.resize(1 + in.size());
+	out[0] = BLOCK_STORED;
+	memcpy(out.data() + 1, in.data(), in.size());
+}
+
+bool compressBlock(const vector<uint8_t> &in, const CompressionOptions &options,
+				   vector<uint8_t> &out) {
+	if (options.codec == CompressionCodec::None || looksIncompressible(in)) {
+		storeBlock(in, out);
+		return true;
+	}
+	LZ4F_preferences_t prefs = framePrefs(in.size(), options);
+	out.resize(1 + LZ4F_compressFrameBound(in.size(), &prefs));
+	out[0] = BLOCK_LZ4F;
+	size_t n = LZ4F_compressFrame(out.data() + 1, out.size() - 1, in.data(), in.size(), &prefs);
+	if (LZ4F_isError(n))
+		return false;
+	if (n >= in.size()) {
+		storeBlock(in, out);
+		return true;
+	}
+	out.resize(1 + n);
+	return true;
+}
+
+bool decompressFrame(const uint8_t *in, size_t in_total, vector<uint8_t> &out) {
+	LZ4F_dctx *dctx = nullptr;
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+		return false;
+	bool ok = false;
+	LZ4F_frameInfo_t info;
+	size_t in_pos = in_total;
+	size_t hint = LZ4F_getFrameInfo(dctx, &info, in, &in_pos);
+	if (!LZ4F_isError(hint) && info.contentSize > 0 && info.contentSize <= MAX_FRAME_CONTENT) {
+		out.resize(static_cast<size_t>(info.contentSize));
+		size_t out_pos = 0;
+		while (hint != 0 && !LZ4F_isError(hint) && in_pos < in_total) {
+			size_t out_size = out.size() - out_pos;
+			size_t in_size = in_total - in_pos;
+			hint = LZ4F_decompress(dctx, out.data() + out_pos, &out_size, in + in_pos, &in_size,
+								   nullptr);
+			out_pos += out_size;
+			in_pos += in_size;
+			if (out_size == 0 && in_size == 0)
+				break;
+		}
+		// 帧必须恰好结束在数据末尾，且解压大小与声明一致
+		ok = hint == 0 && in_pos == in_total && out_pos == out.size();
+	}
+	LZ4F_freeDecompressionContext(dctx);
+	return ok;
+}
+
+bool decompressBlock(const vector<uint8_t> &in, vector<uint8_t> &out) {
+	if (in.empty())
+		return false;
+	switch (in[0]) {
+	case BLOCK_STORED:
+		out.assign(in.begin() + 1, in.end());
+		return true;
+	case BLOCK_LZ4F:
+		return decompressFrame(in.data() + 1, in.size() - 1, out);
+	default:
+		return false;
+	}
+}
+
+// 拒绝绝对路径和包含 .. 的条目，防止写到输出目录之外
+bool safeRelativePath(const string &path) {
+	fs::path p(path);
+	if (p.empty() || p.is_absolute() || p.has_root_name())
+		return false;
+	for (const auto &part : p)
+		if (part == "..")
+			return false;
+	return true;
+}
+
+} // namespace
 
 uint8_t CompressionUtils::DECOMPRESS_FLAG_CLONE = 0x0;
 uint8_t CompressionUtils::DECOMPRESS_FLAG_PUSH = CompressionUtils::DECOMPRESS_FLAG_CLONE + 1;
@@ -180,10 +339,13 @@ bool CompressionUtils::decompressData(const vector<uint8_t> &packed_data, vector
 	return true;
 }
 
-bool CompressionUtils::createCompressedArchive(const vector<fs::path> &file_paths,
+bool CompressionUtils::streamCompressedArchive(const vector<fs::path> &file_paths,
 											   const fs::path &base_path,
-											   vector<uint8_t> &archive_data, uint32_t &raw_size,
-											   ProgressCallback progress_callback) {
+											   const ArchiveWriter::Sink &sink, uint64_t &raw_size,
+											   ProgressCallback progress_callback,
+											   const FileLoader &loader,
+											   const CompressionOptions &options,
+											   ChecksumType checksum) {
 	if (file_paths.empty()) {
 		return false;
 	}
@@ -192,86 +354,48 @@ bool CompressionUtils::createCompressedArchive(const vector<fs::path> &file_path
 		progress_callback(0, "create archive...");
 	}
 
-	// 构建归档数据
-	vector<uint8_t> raw_archive;
-
-	// 写入归档头部
-	ArchiveHeader header;
-	header.magic = ARCHIVE_MAGIC;
-	header.version = ARCHIVE_VERSION;
-	header.file_count = static_cast<uint32_t>(file_paths.size());
-	header.total_size = 0;
-
-	// 计算总大小
-	for (const auto &file_path : file_paths) {
-		fs::path full_path = base_path / file_path;
-		if (fs::exists(full_path) && fs::is_regular_file(full_path)) {
-			header.total_size += fs::file_size(full_path);
-		}
+	ArchiveWriter writer(sink, options, checksum);
+	if (!writer.begin()) {
+		return false;
 	}
 
-	// 写入头部
-	const uint8_t *header_bytes = reinterpret_cast<const uint8_t *>(&header);
-	raw_archive.insert(raw_archive.end(), header_bytes, header_bytes + sizeof(header));
-
-	// 写入文件条目
 	for (size_t i = 0; i < file_paths.size(); ++i) {
 		const auto &file_path = file_paths[i];
-		fs::path full_path = base_path / file_path;
+		string path_str = file_path.generic_string();
 
 		if (progress_callback) {
-			int progress = 10 + (i * 40 / file_paths.size());
+			int progress = static_cast<int>(i * 100 / file_paths.size());
 			progress_callback(progress, "add file: " + file_path.filename().string());
 		}
 
-		if (!fs::exists(full_path) || !fs::is_regular_file(full_path)) {
+		vector<uint8_t> file_data;
+		if (loader && loader(file_path, file_data)) {
+			if (!writer.addFile(path_str, file_data)) {
+				return false;
+			}
 			continue;
 		}
 
-		// 读取文件数据
-		vector<uint8_t> file_data;
-		try {
-			file_data = FileSystemUtils::getInstance().readBinary(full_path);
-		} catch (const exception &e) {
+		// 不存在的文件跳过，结束条目标记归档末尾，不需要预先知道文件数量
+		fs::path full_path = base_path / file_path;
+		if (!fs::exists(full_path) || !fs::is_regular_file(full_path)) {
 			continue;
 		}
+		if (!writer.addFile(path_str, full_path)) {
+			return false;
+		}
+	}
 
-		// 创建文件条目
-		ArchiveEntry entry;
-		string path_str = file_path.generic_string();
-		entry.path_length = static_cast<uint32_t>(path_str.length());
-		entry.file_size = file_data.size();
-		entry.checksum = crc32(file_data);
-
-		// 写入条目头
-		const uint8_t *entry_bytes = reinterpret_cast<const uint8_t *>(&entry);
-		raw_archive.insert(raw_archive.end(), entry_bytes, entry_bytes + sizeof(entry));
-
-		// 写入路径
-		raw_archive.insert(raw_archive.end(), path_str.begin(), path_str.end());
-
-		// 写入文件数据
-		raw_archive.insert(raw_archive.end(), file_data.begin(), file_data.end());
+	if (!writer.finish()) {
+		return false;
 	}
+	raw_size = writer.rawSize();
 
 	if (progress_callback) {
-		progress_callback(50, "compress archive data...");
+		progress_callback(100, "compressed " +
+								   getCompressionRatio(writer.rawSize(), writer.compressedSize()));
 	}
-	raw_size = raw_archive.size();
-	// 压缩整个归档
-	bool result = compressData(raw_archive, archive_data, [&](int progress, const string &desc) {
-		if (progress_callback) {
-			int adjusted_progress = 50 + (progress * 50 / 100);
-			progress_callback(adjusted_progress, desc);
-		}
-	});
-
-	// if (progress_callback && result) {
-	// 	string ratio = getCompressionRatio(raw_archive.size(), archive_data.size());
-	// 	progress_callback(100, "archiving has been completed" + ratio);
-	// }
-
-	return result;
+	return true;
 }
 
 bool CompressionUtils::extractCompressedArchive(const vector<uint8_t> &archive_data,
@@ -351,7 +475,7 @@ bool CompressionUtils::extractCompressedArchive(const vector<uint8_t> &archive_d
 		offset += entry.file_size;
 
 		// 验证校验和
-		uint32_t calculated_checksum = crc32(file_data);
+		uint32_t calculated_checksum = Checksum::compute(ChecksumType::Crc32, file_data);
 		if (calculated_checksum != entry.checksum) {
 			return false;
 		}
@@ -388,4 +512,370 @@ string CompressionUtils::getCompressionRatio(size_t original_size, size_t compre
 	ostringstream oss;
 	oss << "(" << fixed << setprecision(1) << ratio << "% compression)";
 	return oss.str();
-}
\ No newline at end of file
+}
+
+// CompressionOptions实现
+
+bool CompressionOptions::parse(const string &spec, CompressionOptions &out) {
+	string name = spec;
+	string level;
+	size_t colon = spec.find(':');
+	if (colon != string::npos) {
+		name = spec.substr(0, colon);
+		level = spec.substr(colon + 1);
+	}
+
+	CompressionOptions options;
+	if (name == "none") {
+		options.codec = CompressionCodec::None;
+		options.level = 0;
+	} else if (name == "lz4") {
+		options.codec = CompressionCodec::Lz4;
+		options.level = 1;
+	} else if (name == "lz4hc") {
+		options.codec = CompressionCodec::Lz4Hc;
+		options.level = LZ4HC_CLEVEL_DEFAULT;
+	} else {
+		return false;
+	}
+	if (!level.empty()) {
+		if (options.codec == CompressionCodec::None ||
+			level.find_first_not_of("0123456789") != string::npos || level.size() > 5)
+			return false;
+		options.level = stoi(level);
+	}
+	out = options.clamped();
+	return true;
+}
+
+CompressionOptions CompressionOptions::clamped() const {
+	CompressionOptions options = *this;
+	switch (codec) {
+	case CompressionCodec::None:
+		options.level = 0;
+		break;
+	case CompressionCodec::Lz4Hc:
+		options.level = max(LZ4HC_CLEVEL_MIN, min(level, LZ4HC_CLEVEL_MAX));
+		break;
+	default:
+		// 未知的编码按默认的 LZ4 处理
+		options.codec = CompressionCodec::Lz4;
+		options.level = max(1, min(level, MAX_ACCELERATION));
+		break;
+	}
+	return options;
+}
+
+string CompressionOptions::toString() const {
+	switch (codec) {
+	case CompressionCodec::None:
+		return "none";
+	case CompressionCodec::Lz4Hc:
+		return "lz4hc:" + to_string(level);
+	default:
+		return "lz4:" + to_string(level);
+	}
+}
+
+// ArchiveWriter实现
+
+struct ArchiveWriter::Block {
+	vector<uint8_t> raw;
+	vector<uint8_t> frame;
+	bool ok = false;
+	TaskGroup group; // 最后析构，保证压缩任务结束后才释放数据
+};
+
+ArchiveWriter::ArchiveWriter(Sink sink, const CompressionOptions &options, ChecksumType checksum)
+	: sink(std::move(sink)), options(options.clamped()), checksum(checksum),
+	  max_in_flight(2 * ThreadPool::getInstance().size() + 1) {}
+
+ArchiveWriter::~ArchiveWriter() = default;
+
+bool ArchiveWriter::begin() {
+	block.reserve(BLOCK_SIZE);
+	StreamHeader header{STREAM_MAGIC, STREAM_VERSION, static_cast<uint8_t>(checksum), 0};
+	return write(&header, sizeof(header));
+}
+
+bool ArchiveWriter::beginEntry(const string &path, uint64_t size) {
+	StreamEntry entry{static_cast<uint32_t>(path.size()), size};
+	return write(&entry, sizeof(entry)) && write(path.data(), path.size());
+}
+
+bool ArchiveWriter::addFile(const string &path, const vector<uint8_t> &data) {
+	if (path.empty())
+		return false;
+	uint32_t crc = Checksum::compute(checksum, data);
+	if (!beginEntry(path, data.size()) || !write(data.data(), data.size()) ||
+		!write(&crc, sizeof(crc)))
+		return false;
+	++file_count;
+	return true;
+}
+
+bool ArchiveWriter::addFile(const string &path, const fs::path &file) {
+	if (path.empty())
+		return false;
+	ifstream in(file, ios::binary);
+	error_code ec;
+	uint64_t size = fs::file_size(file, ec);
+	if (!in.is_open() || ec)
+		return false;
+	if (!beginEntry(path, size))
+		return false;
+
+	// 条目头中已写入文件大小，读取时文件被截断会导致归档损坏，只能中止
+	vector<uint8_t> buffer(static_cast<size_t>(min<uint64_t>(size, INPUT_PIECE)));
+	Checksum crc(checksum);
+	uint64_t left = size;
+	while (left > 0) {
+		size_t n = static_cast<size_t>(min<uint64_t>(left, buffer.size()));
+		if (!in.read(reinterpret_cast<char *>(buffer.data()), n))
+			return false;
+		crc.update(buffer.data(), n);
+		if (!write(buffer.data(), n))
+			return false;
+		left -= n;
+	}
+	uint32_t value = crc.value();
+	if (!write(&value, sizeof(value)))
+		return false;
+	++file_count;
+	return true;
+}
+
+bool ArchiveWriter::finish() {
+	StreamEntry end{0, 0};
+	if (!write(&end, sizeof(end)) || !submitBlock())
+		return false;
+	while (!in_flight.empty()) {
+		if (!emitOldest())
+			return false;
+	}
+	return !failed;
+}
+
+bool ArchiveWriter::write(const void *data, size_t size) {
+	if (failed)
+		return false;
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	raw_size += size;
+	while (size > 0) {
+		size_t n = min(size, BLOCK_SIZE - block.size());
+		block.insert(block.end(), p, p + n);
+		p += n;
+		size -= n;
+		if (block.size() == BLOCK_SIZE && !submitBlock())
+			return false;
+	}
+	return true;
+}
+
+bool ArchiveWriter::submitBlock() {
+	if (block.empty())
+		return true;
+	auto pending = make_unique<Block>();
+	pending->raw.swap(block);
+	block.reserve(BLOCK_SIZE);
+	Block *b = pending.get();
+	b->group.spawn([b, options = options]() {
+		b->ok = compressBlock(b->raw, options, b->frame);
+		vector<uint8_t>().swap(b->raw);
+	});
+	in_flight.push_back(std::move(pending));
+	while (in_flight.size() > max_in_flight) {
+		if (!emitOldest())
+			return false;
+	}
+	return true;
+}
+
+bool ArchiveWriter::emitOldest() {
+	unique_ptr<Block> b = std::move(in_flight.front());
+	in_flight.pop_front();
+	b->group.wait();
+	if (!b->ok || !sink(b->frame)) {
+		failed = true;
+		return false;
+	}
+	compressed_size += b->frame.size();
+	return true;
+}
+
+// ArchiveExtractor实现
+
+struct ArchiveExtractor::Block {
+	vector<uint8_t> frame;
+	vector<uint8_t> raw;
+	bool ok = false;
+	TaskGroup group;
+};
+
+ArchiveExtractor::ArchiveExtractor(const fs::path &output_path, bool keep_existing)
+	: output_path(output_path), keep_existing(keep_existing),
+	  max_in_flight(2 * ThreadPool::getInstance().size() + 1) {
+	field_size = sizeof(StreamHeader);
+}
+
+ArchiveExtractor::~ArchiveExtractor() {
+	// 归档不完整时删除写了一半的临时文件
+	if (file.is_open()) {
+		file.close();
+		error_code ec;
+		fs::remove(temp_path, ec);
+	}
+}
+
+bool ArchiveExtractor::feed(const uint8_t *data, size_t size) {
+	if (failed)
+		return false;
+	if (size == 0)
+		return true;
+	auto pending = make_unique<Block>();
+	pending->frame.assign(data, data + size);
+	Block *b = pending.get();
+	b->group.spawn([b]() {
+		b->ok = decompressBlock(b->frame, b->raw);
+		vector<uint8_t>().swap(b->frame);
+	});
+	in_flight.push_back(std::move(pending));
+	// 文件按顺序写出，只需保证解压中的帧不超过上限
+	while (in_flight.size() > max_in_flight) {
+		if (!consumeOldest())
+			return false;
+	}
+	return true;
+}
+
+bool ArchiveExtractor::finish() {
+	while (!failed && !in_flight.empty()) {
+		if (!consumeOldest())
+			return false;
+	}
+	return !failed && state == State::Done;
+}
+
+bool ArchiveExtractor::consumeOldest() {
+	unique_ptr<Block> b = std::move(in_flight.front());
+	in_flight.pop_front();
+	b->group.wait();
+	if (!b->ok || !consume(b->raw.data(), b->raw.size())) {
+		failed = true;
+		return false;
+	}
+	return true;
+}
+bool ArchiveExtractor::consume(const uint8_t *data, size_t size) {
+	while (size > 0) {
+		if (state == State::Done)
+			return false; // 结束条目之后不应再有数据
+
+		if (state == State::Data) {
+			size_t n = static_cast<size_t>(min<uint64_t>(remaining, size));
+			crc.update(data, n);
+			if (!skipping && !file.write(reinterpret_cast<const char *>(data), n))
+				return false;
+			data += n;
+			size -= n;
+			remaining -= n;
+			raw_size += n;
+			if (remaining == 0) {
+				state = State::Checksum;
+				field_size = sizeof(uint32_t);
+			}
+			continue;
+		}
+
+		// 拼接定长字段
+		size_t n = min(field_size - field.size(), size);
+		field.insert(field.end(), data, data + n);
+		data += n;
+		size -= n;
+		raw_size += n;
+		if (field.size() < field_size)
+			continue;
+
+		switch (state) {
+		case State::Header: {
+			StreamHeader header;
+			memcpy(&header, field.data(), sizeof(header));
+			if (header.magic != STREAM_MAGIC || header.version != STREAM_VERSION ||
+				!Checksum::supported(header.checksum))
+				return false;
+			crc = Checksum(static_cast<ChecksumType>(header.checksum));
+			state = State::Entry;
+			field_size = sizeof(StreamEntry);
+			break;
+		}
+		case State::Entry: {
+			StreamEntry entry;
+			memcpy(&entry, field.data(), sizeof(entry));
+			if (entry.path_length == 0) {
+				state = State::Done;
+				break;
+			}
+			if (entry.path_length > MAX_ENTRY_PATH)
+				return false;
+			remaining = entry.file_size;
+			state = State::Path;
+			field_size = entry.path_length;
+			break;
+		}
+		case State::Path:
+			path.assign(field.begin(), field.end());
+			if (!openFile())
+				return false;
+			crc.reset();
+			state = remaining > 0 ? State::Data : State::Checksum;
+			field_size = remaining > 0 ? 0 : sizeof(uint32_t);
+			break;
+		case State::Checksum: {
+			uint32_t expected;
+			memcpy(&expected, field.data(), sizeof(expected));
+			// 先校验再 rename，校验失败的条目不会以对象哈希出现在对象目录中
+			if (!closeFile(expected == crc.value()))
+				return false;
+			++file_count;
+			state = State::Entry;
+			field_size = sizeof(StreamEntry);
+			break;
+		}
+		default:
+			return false;
+		}
+		field.clear();
+	}
+	return true;
+}
+
+bool ArchiveExtractor::openFile() {
+	if (!safeRelativePath(path))
+		return false;
+	if (path.find(MARKNAME) != string::npos) {
+		file_path = output_path / path;
+	} else {
+		file_path = output_path / MARKNAME / path;
+	}
+	skipping = keep_existing && fs::exists(file_path);
+	if (skipping)
+		return true;
+	fs::create_directories(file_path.parent_path());
+	temp_path = FileSystemUtils::temporaryPath(file_path);
+	file.open(temp_path, ios::binary | ios::trunc);
+	return file.is_open();
+}
+
+bool ArchiveExtractor::closeFile(bool verified) {
+	if (skipping)
+		return verified;
+	file.close();
+	error_code ec;
+	if (verified && !file.fail())
+		fs::rename(temp_path, file_path, ec);
+	if (!verified || file.fail() || ec) {
+		fs::remove(temp_path, ec);
+		return false;
+	}
+	return true;
+}
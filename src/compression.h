@@ -1,7 +1,137 @@
 #pragma once
 
+#include "checksum.h"
 #include "common.h"
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <memory>
+
+// 归档压缩方式
+enum class CompressionCodec : uint8_t {
+	None = 0,  // 不压缩，适合高速局域网
+	Lz4 = 1,   // LZ4 快速模式
+	Lz4Hc = 2, // LZ4HC 高压缩率模式，适合慢速广域网
+};
+
+/**
+ * 一次传输使用的压缩方式和级别
+ * Lz4 的 level 为加速倍数（1为默认，越大越快、压缩率越低），Lz4Hc 的 level 为 LZ4HC 压缩级别
+ */
+struct CompressionOptions {
+	CompressionCodec codec = CompressionCodec::Lz4;
+	int level = 1;
+
+	// 解析 "none"、"lz4[:加速倍数]"、"lz4hc[:级别]"
+	static bool parse(const string &spec, CompressionOptions &out);
+	// 把级别限制在编码支持的范围内
+	CompressionOptions clamped() const;
+	string toString() const;
+};
+
+/**
+ * 流式归档写入器
+ * 归档（版本2）解压后的字节流依次为：
+ *   文件头{u32 魔数, u16 版本, u8 校验和算法, u8 保留}
+ *   + 若干条目{u32 路径长度, u64 文件大小, 路径, 文件数据, u32 校验和} + 路径长度为0的结束条目
+ * 字节流按 BLOCK_SIZE 切成块，每块独立编码为 1 字节块类型 + 数据：
+ *   原样存放，或一个 LZ4 帧（带内容大小和校验和，快速模式和 HC 模式解码方式相同）
+ * 由线程池并行压缩后按顺序交给 sink（通常直接作为一条消息发送），内存占用与归档总大小无关；
+ * 抽样熵过高的块（已压缩的文件）和压缩后不变小的块原样存放
+ */
+class ArchiveWriter {
+public:
+	using Sink = std::function<bool(const vector<uint8_t> &frame)>;
+
+	static constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+	explicit ArchiveWriter(Sink sink, const CompressionOptions &options = {},
+	                       ChecksumType checksum = ChecksumType::Crc32);
+	~ArchiveWriter();
+
+	bool begin();
+	bool addFile(const string &path, const vector<uint8_t> &data);
+	// 从磁盘分段读取文件，不把整个文件读入内存
+	bool addFile(const string &path, const fs::path &file);
+	bool finish();
+
+	uint32_t fileCount() const { return file_count; }
+	uint64_t rawSize() const { return raw_size; }
+	uint64_t compressedSize() const { return compressed_size; }
+
+private:
+	struct Block;
+
+	bool beginEntry(const string &path, uint64_t size);
+	bool write(const void *data, size_t size);
+	// 把当前块交给线程池压缩，压缩中的块过多时先输出最早的块
+	bool submitBlock();
+	bool emitOldest();
+
+	Sink sink;
+	CompressionOptions options;
+	ChecksumType checksum;
+	vector<uint8_t> block;
+	deque<unique_ptr<Block>> in_flight;
+	size_t max_in_flight;
+	bool failed = false;
+	uint32_t file_count = 0;
+	uint64_t raw_size = 0;
+	uint64_t compressed_size = 0;
+};
+
+/**
+ * 流式归档解压器
+ * 按到达顺序传入 ArchiveWriter 输出的帧，帧由线程池并行解压，
+ * 解压结果按顺序解析条目并写出文件，不需要等待整个归档
+ */
+class ArchiveExtractor {
+public:
+	/**
+	 * @param output_path 输出路径，条目路径不含 MARKNAME 时写到 output_path/MARKNAME 下
+	 * @param keep_existing 目标文件已存在时跳过（对象按内容寻址，已有文件内容相同）
+	 */
+	explicit ArchiveExtractor(const fs::path &output_path, bool keep_existing = false);
+	~ArchiveExtractor();
+
+	// 传入一个完整的帧
+	bool feed(const uint8_t *data, size_t size);
+	// 等待所有帧解压并写出，返回归档是否完整
+	bool finish();
+
+	uint32_t fileCount() const { return file_count; }
+	uint64_t rawSize() const { return raw_size; }
+
+private:
+	struct Block;
+	enum class State { Header, Entry, Path, Data, Checksum, Done };
+
+	bool consumeOldest();
+	bool consume(const uint8_t *data, size_t size);
+	bool openFile();
+	// verified 为false（校验和不匹配）时删除临时文件，不发布到最终路径
+	bool closeFile(bool verified);
+
+	fs::path output_path;
+	bool keep_existing;
+	deque<unique_ptr<Block>> in_flight;
+	size_t max_in_flight;
+	bool failed = false;
+
+	State state = State::Header;
+	vector<uint8_t> field; // 正在拼接的定长字段或路径
+	size_t field_size = 0;
+	string path;
+	uint64_t remaining = 0;
+	Checksum crc; // 算法由归档头决定
+	ofstream file;
+	bool skipping = false;
+	fs::path file_path;
+	fs::path temp_path; // 先写到临时文件，完整写出后再 rename 到 file_path
+
+	uint32_t file_count = 0;
+	uint64_t raw_size = 0;
+};
 
 /**
  * 压缩工具类
@@ -17,6 +147,8 @@ public:
 	// 进度回调函数类型
 	// 参数：当前进度（0-100），操作描述
 	using ProgressCallback = std::function<void(int progress, const string &description)>;
+	// 按相对路径读取文件内容，返回false时回退到从 base_path 读取
+	using FileLoader = std::function<bool(const fs::path &relative, vector<uint8_t> &data)>;
 
 	/**
 	 * 压缩文件到字节数组
@@ -63,20 +195,27 @@ public:
 	                           ProgressCallback progress_callback = nullptr);
 
 	/**
-	 * 创建压缩归档包含多个文件
+	 * 流式创建压缩归档包含多个文件
 	 * @param file_paths 文件路径列表（相对路径）
 	 * @param base_path 基础路径
-	 * @param archive_data 输出归档数据
+	 * @param sink 接收压缩数据段，返回false时中止
+	 * @param raw_size 输出归档原始大小
 	 * @param progress_callback 进度回调
+	 * @param loader 可选的文件读取函数（例如从包文件中读取对象）
+	 * @param options 压缩方式
+	 * @param checksum 条目校验和算法
 	 * @return 是否成功
 	 */
-	static bool createCompressedArchive(const vector<fs::path> &file_paths,
+	static bool streamCompressedArchive(const vector<fs::path> &file_paths,
 	                                    const fs::path &base_path,
-	                                    vector<uint8_t> &archive_data, uint32_t &raw_size,
-	                                    ProgressCallback progress_callback = nullptr);
+	                                    const ArchiveWriter::Sink &sink, uint64_t &raw_size,
+	                                    ProgressCallback progress_callback = nullptr,
+	                                    const FileLoader &loader = nullptr,
+	                                    const CompressionOptions &options = {},
+	                                    ChecksumType checksum = ChecksumType::Crc32);
 
 	/**
-	 * 从压缩归档提取文件
+	 * 从压缩归档提取文件（旧的整体压缩格式，流式归档使用 ArchiveExtractor）
 	 * @param archive_data 归档数据
 	 * @param output_path 输出路径
 	 * @param progress_callback 进度回调
@@ -113,5 +252,4 @@ private:
 
 	static const uint32_t ARCHIVE_MAGIC = 0x4D474954; // 'MGIT'
 	static const uint32_t ARCHIVE_VERSION = 1;
-	static const int COMPRESSION_LEVEL = 6;
 };
\ No newline at end of file
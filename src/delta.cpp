@@ -0,0 +1,151 @@
+#include "delta.h"
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+// 基础对象按此大小分块建立索引，也是最短的复制长度
+constexpr size_t BLOCK = 16;
+constexpr uint32_t HASH_MULT = 257;
+constexpr uint8_t COPY_OP = 0x80;
+constexpr size_t MAX_INSERT = 127;
+
+uint32_t hashBlock(const uint8_t *p) {
+	uint32_t h = 0;
+	for (size_t i = 0; i < BLOCK; ++i)
+		h = h * HASH_MULT + p[i];
+	return h;
+}
+
+void putVarint(vector<uint8_t> &out, uint64_t v) {
+	while (v >= 0x80) {
+		out.push_back(static_cast<uint8_t>(v) | 0x80);
+		v >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(v));
+}
+
+bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+	v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (p >= end)
+			return false;
+		uint8_t b = *p++;
+		v |= static_cast<uint64_t>(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void putInsert(vector<uint8_t> &out, const uint8_t *data, size_t len) {
+	while (len > 0) {
+		size_t n = min(len, MAX_INSERT);
+		out.push_back(static_cast<uint8_t>(n));
+		out.insert(out.end(), data, data + n);
+		data += n;
+		len -= n;
+	}
+}
+} // namespace
+
+bool Delta::create(const vector<uint8_t> &base, const vector<uint8_t> &target,
+				   vector<uint8_t> &delta, size_t max_size) {
+	delta.clear();
+	putVarint(delta, base.size());
+	putVarint(delta, target.size());
+
+	// 基础对象每个对齐块的哈希 -> 第一次出现的偏移
+	unordered_map<uint32_t, size_t> blocks;
+	blocks.reserve(base.size() / BLOCK + 1);
+	for (size_t off = 0; off + BLOCK <= base.size(); off += BLOCK)
+		blocks.emplace(hashBlock(base.data() + off), off);
+
+	// 滚动哈希需要移除窗口首字节的权重 HASH_MULT^(BLOCK-1)
+	uint32_t top = 1;
+	for (size_t i = 1; i < BLOCK; ++i)
+		top *= HASH_MULT;
+
+	const uint8_t *t = target.data();
+	size_t n = target.size();
+	size_t i = 0;
+	size_t pending = 0; // 尚未输出的插入字节起点
+	uint32_t h = n >= BLOCK ? hashBlock(t) : 0;
+
+	while (i + BLOCK <= n) {
+		auto it = blocks.find(h);
+		if (it != blocks.end() && memcmp(base.data() + it->second, t + i, BLOCK) == 0) {
+			size_t b = it->second;
+			size_t len = BLOCK;
+			while (i + len < n && b + len < base.size() && base[b + len] == t[i + len])
+				++len;
+			// 向前扩展，把待插入的尾部并入复制
+			while (i > pending && b > 0 && base[b - 1] == t[i - 1]) {
+				--i;
+				--b;
+				++len;
+			}
+
+			putInsert(delta, t + pending, i - pending);
+			delta.push_back(COPY_OP);
+			putVarint(delta, b);
+			putVarint(delta, len);
+			if (delta.size() > max_size)
+				return false;
+
+			i += len;
+			pending = i;
+			if (i + BLOCK <= n)
+				h = hashBlock(t + i);
+			continue;
+		}
+
+		if (i + BLOCK < n)
+			h = (h - t[i] * top) * HASH_MULT + t[i + BLOCK];
+		++i;
+		if (i - pending > max_size)
+			return false;
+	}
+
+	putInsert(delta, t + pending, n - pending);
+	return delta.size() <= max_size;
+}
+
+bool Delta::resultSize(const uint8_t *delta, size_t delta_size, uint64_t &size) {
+	const uint8_t *p = delta;
+	const uint8_t *end = delta + delta_size;
+	uint64_t base_size;
+	return getVarint(p, end, base_size) && getVarint(p, end, size);
+}
+
+bool Delta::apply(const uint8_t *base, size_t base_size, const uint8_t *delta, size_t delta_size,
+				  vector<uint8_t> &out) {
+	const uint8_t *p = delta;
+	const uint8_t *end = delta + delta_size;
+	uint64_t expected_base, result_size;
+	if (!getVarint(p, end, expected_base) || !getVarint(p, end, result_size))
+		return false;
+	if (expected_base != base_size)
+		return false;
+
+	out.clear();
+	out.reserve(result_size);
+	while (p < end) {
+		uint8_t op = *p++;
+		if (op == COPY_OP) {
+			uint64_t off, len;
+			if (!getVarint(p, end, off) || !getVarint(p, end, len))
+				return false;
+			if (off > base_size || len > base_size - off || out.size() + len > result_size)
+				return false;
+			out.insert(out.end(), base + off, base + off + len);
+		} else if (op > 0 && op <= MAX_INSERT) {
+			if (static_cast<size_t>(end - p) < op || out.size() + op > result_size)
+				return false;
+			out.insert(out.end(), p, p + op);
+			p += op;
+		} else {
+			return false;
+		}
+	}
+	return out.size() == result_size;
+}
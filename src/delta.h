@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * 对象差异编码（用于包文件中的delta条目）
+ * 格式：varint(基础对象大小) + varint(结果大小) + 指令序列
+ *   复制指令：0x80 + varint(基础对象中的偏移) + varint(长度)
+ *   插入指令：1..127 表示随后紧跟的字面字节数
+ */
+class Delta {
+public:
+	/**
+	 * 计算把 base 变成 target 的差异指令
+	 * 结果超过 max_size 字节时放弃并返回false（差异没有收益）
+	 */
+	static bool create(const vector<uint8_t> &base, const vector<uint8_t> &target,
+					   vector<uint8_t> &delta, size_t max_size);
+
+	// 从差异指令开头读取结果大小
+	static bool resultSize(const uint8_t *delta, size_t delta_size, uint64_t &size);
+
+	// 把差异指令应用到 base 上，格式错误或大小不符时返回false
+	static bool apply(const uint8_t *base, size_t base_size, const uint8_t *delta,
+					  size_t delta_size, vector<uint8_t> &out);
+};
@@ -1,4 +1,8 @@
 ﻿#include "filesystem_utils.h"
+#include <atomic>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 // 检查字符串是否以指定后缀结尾
 bool FileSystemUtils::endsWith(const std::string &str, const std::string &suffix) {
@@ -37,6 +41,46 @@ fs::path FileSystemUtils::configPath() {
 	return mgDir() / "config";
 }
 
+fs::path FileSystemUtils::objectPath(const string &id) {
+	return objectPath(objectsDir(), id);
+}
+
+fs::path FileSystemUtils::objectPath(const fs::path &objects_dir, const string &id) {
+	if (id.size() <= 2)
+		return objects_dir / id;
+	return objects_dir / id.substr(0, 2) / id.substr(2);
+}
+
+fs::path FileSystemUtils::objectRelativePath(const string &id) {
+	return objectPath(fs::path("objects"), id);
+}
+
+size_t FileSystemUtils::migrateObjectLayout(const fs::path &objects_dir) {
+	// 迁移完成后顶层只剩分片目录，遍历代价很小，因此每次打开仓库时都可以检查
+	size_t moved = 0;
+	error_code ec;
+	vector<fs::path> flat_objects;
+	for (fs::directory_iterator it(objects_dir, ec), end; !ec && it != end; it.increment(ec)) {
+		string name = it->path().filename().string();
+		if (name.size() == 40 && it->is_regular_file(ec) &&
+			name.find_first_not_of("0123456789abcdef") == string::npos) {
+			flat_objects.push_back(it->path());
+		}
+	}
+	for (const auto &src : flat_objects) {
+		fs::path dst = objectPath(objects_dir, src.filename().string());
+		fs::create_directories(dst.parent_path(), ec);
+		if (fs::exists(dst)) {
+			fs::remove(src, ec);
+		} else {
+			fs::rename(src, dst, ec);
+		}
+		if (!ec)
+			moved++;
+	}
+	return moved;
+}
+
 bool FileSystemUtils::isIgnored(const fs::path &p) {
 	// ignore .minigit itself and common build/IDE directories
 	std::string path_str = p.string();
@@ -46,6 +90,7 @@ bool FileSystemUtils::isIgnored(const fs::path &p) {
 void FileSystemUtils::ensureRepo() {
 	if (!fs::exists(mgDir()))
 		throw runtime_error("Not a minigit repo. Run 'minigit init'.");
+	migrateObjectLayout(objectsDir());
 }
 
 void FileSystemUtils::writeText(const fs::path &p, const string &s) {
@@ -68,6 +113,45 @@ void FileSystemUtils::writeBinary(const fs::path &p, const vector<uint8_t> &data
 	f.write(reinterpret_cast<const char *>(data.data()), data.size());
 }
 
+fs::path FileSystemUtils::temporaryPath(const fs::path &p) {
+	// 时间戳区分进程，计数器区分同一进程中的写入者
+	static atomic<uint64_t> counter{0};
+	uint64_t stamp =
+		static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+	fs::path tmp = p;
+	tmp += "." + to_string(stamp) + "-" + to_string(counter++) + ".tmp";
+	return tmp;
+}
+
+bool FileSystemUtils::isTemporaryFile(const fs::path &p) {
+	string name = p.filename().string();
+	return name.rfind("tmp_", 0) == 0 ||
+		   (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0);
+}
+
+bool FileSystemUtils::replaceFile(const fs::path &p, const void *data, size_t size) {
+	error_code ec;
+	fs::create_directories(p.parent_path(), ec);
+	fs::path tmp = temporaryPath(p);
+	{
+		ofstream f(tmp, ios::binary | ios::trunc);
+		if (!f.is_open())
+			return false;
+		f.write(static_cast<const char *>(data), size);
+		if (!f.good()) {
+			f.close();
+			fs::remove(tmp, ec);
+			return false;
+		}
+	}
+	fs::rename(tmp, p, ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		return false;
+	}
+	return true;
+}
+
 vector<uint8_t> FileSystemUtils::readBinary(const fs::path &p) {
 	if (!fs::exists(p)) {
 		return vector<uint8_t>();
@@ -85,3 +169,36 @@ vector<uint8_t> FileSystemUtils::readBinary(const fs::path &p) {
 void FileSystemUtils::useRepo(const string &repo_name) {
 	repo = repo_name;
 }
+
+bool FileSystemUtils::statFile(const fs::path &p, FileStat &st) {
+#ifdef _WIN32
+	// Windows没有inode和ctime，仅使用大小和修改时间
+	error_code ec;
+	auto size = fs::file_size(p, ec);
+	if (ec)
+		return false;
+	auto mtime = fs::last_write_time(p, ec);
+	if (ec)
+		return false;
+	st = FileStat();
+	st.size = size;
+	st.mtime_ns =
+		chrono::duration_cast<chrono::nanoseconds>(mtime.time_since_epoch()).count();
+	return true;
+#else
+	struct stat sb;
+	if (::stat(p.c_str(), &sb) != 0)
+		return false;
+	st.size = (uint64_t)sb.st_size;
+#ifdef __APPLE__
+	st.mtime_ns = (int64_t)sb.st_mtimespec.tv_sec * 1000000000 + sb.st_mtimespec.tv_nsec;
+	st.ctime_ns = (int64_t)sb.st_ctimespec.tv_sec * 1000000000 + sb.st_ctimespec.tv_nsec;
+#else
+	st.mtime_ns = (int64_t)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+	st.ctime_ns = (int64_t)sb.st_ctim.tv_sec * 1000000000 + sb.st_ctim.tv_nsec;
+#endif
+	st.ino = (uint64_t)sb.st_ino;
+	st.mode = (uint32_t)sb.st_mode;
+	return true;
+#endif
+}
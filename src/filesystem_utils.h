@@ -2,6 +2,28 @@
 
 #include "common.h"
 #define MARKNAME ".minigit"
+
+/**
+ * 文件元数据快照
+ * 用于判断工作目录中的文件自上次记录以来是否可能被修改
+ */
+struct FileStat {
+	uint64_t size = 0;
+	int64_t mtime_ns = 0;
+	int64_t ctime_ns = 0;
+	uint64_t ino = 0;
+	uint32_t mode = 0;
+
+	// 全零表示没有可信的stat信息，需要重新计算哈希
+	bool valid() const { return mtime_ns != 0 || size != 0 || ino != 0; }
+
+	bool operator==(const FileStat &o) const {
+		return size == o.size && mtime_ns == o.mtime_ns && ctime_ns == o.ctime_ns &&
+			   ino == o.ino && mode == o.mode;
+	}
+	bool operator!=(const FileStat &o) const { return !(*this == o); }
+};
+
 /**
  * 文件系统工具类
  * 提供MiniGit所需的文件和目录操作
@@ -31,6 +53,14 @@ public:
 	fs::path headPath();
 	fs::path configPath();
 
+	// 对象按哈希前两位分目录存放：objects/ab/cdef...
+	fs::path objectPath(const string &id);
+	static fs::path objectPath(const fs::path &objects_dir, const string &id);
+	// 对象相对于 .minigit 目录的路径（用于打包传输）
+	static fs::path objectRelativePath(const string &id);
+	// 把旧版本平铺存放的对象迁移到分目录布局，返回迁移的对象数量
+	static size_t migrateObjectLayout(const fs::path &objects_dir);
+
 	void useRepo(const string & repo_name);
 
 	// 文件操作
@@ -39,7 +69,17 @@ public:
 	void writeBinary(const fs::path &p, const vector<uint8_t> &data);
 	vector<uint8_t> readBinary(const fs::path &p);
 
+	// 与 p 同目录、进程内唯一的临时文件路径，写完后 rename 到 p，读取方不会看到写了一半的文件
+	static fs::path temporaryPath(const fs::path &p);
+	// 写入中的临时文件（temporaryPath、打包和索引的临时文件），复制仓库时跳过
+	static bool isTemporaryFile(const fs::path &p);
+	// 写入临时文件后原子替换 p，失败时返回false且 p 保持不变
+	static bool replaceFile(const fs::path &p, const void *data, size_t size);
+
+	// 读取文件的stat信息，失败时返回false
+	static bool statFile(const fs::path &p, FileStat &st);
+
 	// 仓库检查
 	void ensureRepo();
-	bool isIgnored(const fs::path &p);
+	static bool isIgnored(const fs::path &p);
 };
\ No newline at end of file
@@ -1,48 +1,378 @@
 #include "index.h"
 #include "objects.h"
+#include <cstring>
 
-Index::IndexMap Index::read() {
-	IndexMap m;
-	if (!fs::exists(FileSystemUtils::getInstance().indexPath()))
-		return m;
-	ifstream f(FileSystemUtils::getInstance().indexPath());
+namespace {
+const char INDEX_MAGIC[4] = {'M', 'G', 'I', 'X'};
+const uint32_t INDEX_VERSION = 2;
+
+#pragma pack(push, 1)
+struct IndexHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t strings_size;
+};
+#pragma pack(pop)
+
+// stagePath 在哈希之前记录的stat信息，由下一次 write 写入暂存区
+map<string, Index::Entry> staged_stats;
+
+template <typename T> bool get(const uint8_t *data, size_t size, size_t &pos, T &value) {
+	if (pos + sizeof(T) > size)
+		return false;
+	memcpy(&value, data + pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+/**
+ * 按路径顺序构建暂存区文件内容
+ */
+class IndexBuilder {
+public:
+	void add(string_view path, const IndexFile::Record &rec) {
+		IndexFile::Record r = rec;
+		r.path_offset = (uint32_t)strings.size();
+		r.path_length = (uint32_t)path.size();
+		records.push_back(r);
+		strings.append(path.data(), path.size());
+	}
+
+	void add(string_view path, const Index::Entry &e) {
+		IndexFile::Record r{};
+		r.size = e.stat.size;
+		r.mtime_ns = e.stat.mtime_ns;
+		r.ctime_ns = e.stat.ctime_ns;
+		r.ino = e.stat.ino;
+		r.mode = e.stat.mode;
+		sha1_from_hex(e.sha, r.sha);
+		add(path, r);
+	}
+
+	vector<uint8_t> finish() const {
+		IndexHeader header;
+		memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+		header.version = INDEX_VERSION;
+		header.count = (uint32_t)records.size();
+		header.strings_size = (uint32_t)strings.size();
+
+		size_t records_bytes = records.size() * sizeof(IndexFile::Record);
+		vector<uint8_t> out(sizeof(header) + records_bytes + strings.size());
+		memcpy(out.data(), &header, sizeof(header));
+		if (records_bytes > 0)
+			memcpy(out.data() + sizeof(header), records.data(), records_bytes);
+		if (!strings.empty())
+			memcpy(out.data() + sizeof(header) + records_bytes, strings.data(), strings.size());
+		return out;
+	}
+
+private:
+	vector<IndexFile::Record> records;
+	string strings;
+};
+
+// 旧版本文本格式：每行 path\tsha
+vector<uint8_t> convertText(const uint8_t *data, size_t size) {
+	map<string, Index::Entry> m;
+	istringstream f(string(reinterpret_cast<const char *>(data), size));
 	string line;
 	while (getline(f, line)) {
 		auto t = line.find('\t');
 		if (t == string::npos)
 			continue;
-		string k = line.substr(0, t);
 		string v = line.substr(t + 1);
-		m[k] = v;
+		if (!v.empty() && v.back() == '\r')
+			v.pop_back();
+		m[line.substr(0, t)].sha = v;
+	}
+	IndexBuilder builder;
+	for (const auto &kv : m)
+		builder.add(kv.first, kv.second);
+	return builder.finish();
+}
+
+// v1二进制格式：变长条目（stat + 原始哈希 + u16路径长度 + 路径）
+bool convertV1(const uint8_t *data, size_t size, vector<uint8_t> &out) {
+	size_t pos = sizeof(INDEX_MAGIC) + sizeof(uint32_t);
+	uint32_t count = 0;
+	if (!get(data, size, pos, count))
+		return false;
+
+	map<string, IndexFile::Record> m;
+	for (uint32_t i = 0; i < count; ++i) {
+		IndexFile::Record r{};
+		uint16_t path_len = 0;
+		if (!get(data, size, pos, r.size) || !get(data, size, pos, r.mtime_ns) ||
+			!get(data, size, pos, r.ctime_ns) || !get(data, size, pos, r.ino) ||
+			!get(data, size, pos, r.mode) || !get(data, size, pos, r.sha) ||
+			!get(data, size, pos, path_len) || pos + path_len > size) {
+			return false;
+		}
+		m[string(reinterpret_cast<const char *>(data + pos), path_len)] = r;
+		pos += path_len;
+	}
+	IndexBuilder builder;
+	for (const auto &kv : m)
+		builder.add(kv.first, kv.second);
+	out = builder.finish();
+	return true;
+}
+
+void writeAtomically(const fs::path &p, const vector<uint8_t> &data) {
+	fs::path tmp = p;
+	tmp += ".tmp";
+	{
+		ofstream f(tmp, ios::binary | ios::trunc);
+		if (!f.is_open())
+			throw runtime_error("Cannot write index: " + tmp.string());
+		f.write(reinterpret_cast<const char *>(data.data()), data.size());
+		if (!f.good())
+			throw runtime_error("Cannot write index: " + tmp.string());
+	}
+	fs::rename(tmp, p);
+}
+} // namespace
+
+void IndexFile::open(const fs::path &p) {
+	close();
+	if (!file.open(p))
+		return; // 不存在：空暂存区
+
+	const uint8_t *data = file.data();
+	size_t size = file.size();
+	if (size < sizeof(INDEX_MAGIC) || memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+		converted = convertText(data, size);
+	} else {
+		uint32_t version = 0;
+		size_t pos = sizeof(INDEX_MAGIC);
+		if (!get(data, size, pos, version))
+			throw runtime_error("Corrupt index file: " + p.string());
+		if (version == 1) {
+			if (!convertV1(data, size, converted))
+				throw runtime_error("Corrupt index file: " + p.string());
+		} else if (version != INDEX_VERSION) {
+			throw runtime_error("Unsupported index version in " + p.string());
+		}
+	}
+	if (!converted.empty()) {
+		file.close();
+		attach(converted.data(), converted.size(), p);
+	} else {
+		attach(data, size, p);
+	}
+
+	// racy条目：文件修改时间不早于暂存区写入时间时，无法通过stat判断内容是否变化
+	FileStat index_stat;
+	if (FileSystemUtils::statFile(p, index_stat))
+		index_mtime_ns = index_stat.mtime_ns;
+}
+
+void IndexFile::attach(const uint8_t *data, size_t size, const fs::path &p) {
+	IndexHeader header;
+	if (size < sizeof(header))
+		throw runtime_error("Corrupt index file: " + p.string());
+	memcpy(&header, data, sizeof(header));
+	size_t records_bytes = (size_t)header.count * sizeof(Record);
+	if (sizeof(header) + records_bytes + header.strings_size > size)
+		throw runtime_error("Corrupt index file: " + p.string());
+
+	count = header.count;
+	records = reinterpret_cast<const Record *>(data + sizeof(header));
+	strings = reinterpret_cast<const char *>(data + sizeof(header) + records_bytes);
+	for (size_t i = 0; i < count; ++i) {
+		if ((uint64_t)records[i].path_offset + records[i].path_length > header.strings_size)
+			throw runtime_error("Corrupt index file: " + p.string());
+	}
+}
+
+void IndexFile::close() {
+	file.close();
+	converted.clear();
+	records = nullptr;
+	strings = nullptr;
+	count = 0;
+	index_mtime_ns = 0;
+}
+
+string_view IndexFile::path(size_t i) const {
+	return string_view(strings + records[i].path_offset, records[i].path_length);
+}
+
+string IndexFile::sha(size_t i) const {
+	return sha1_to_hex(records[i].sha);
+}
+
+const unsigned char *IndexFile::rawSha(size_t i) const {
+	return records[i].sha;
+}
+
+bool IndexFile::isRacy(size_t i) const {
+	return records[i].mtime_ns >= index_mtime_ns;
+}
+
+FileStat IndexFile::stat(size_t i) const {
+	FileStat st;
+	if (isRacy(i))
+		return st;
+	const Record &r = records[i];
+	st.size = r.size;
+	st.mtime_ns = r.mtime_ns;
+	st.ctime_ns = r.ctime_ns;
+	st.ino = r.ino;
+	st.mode = r.mode;
+	return st;
+}
+
+size_t IndexFile::find(string_view p) const {
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int c = path(mid).compare(p);
+		if (c == 0)
+			return mid;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	return npos;
+}
+
+bool Index::isUpToDate(const IndexFile &index, size_t i, const FileStat &st) {
+	FileStat recorded = index.stat(i);
+	return recorded.valid() && recorded == st;
+}
+
+Index::IndexMap Index::read() {
+	return read(RepoContext::current());
+}
+
+Index::IndexMap Index::read(const RepoContext &repo) {
+	IndexMap m;
+	IndexFile index;
+	index.open(repo.indexPath());
+	for (size_t i = 0; i < index.size(); ++i)
+		m.emplace_hint(m.end(), string(index.path(i)), index.sha(i));
 	return m;
 }
 
+void Index::update(const Changes &changes) {
+	update(RepoContext::current(), changes);
+}
+
+void Index::update(const RepoContext &repo, const Changes &changes) {
+	fs::path index_path = repo.indexPath();
+	IndexBuilder builder;
+	{
+		IndexFile index;
+		index.open(index_path);
+
+		// 旧条目与变更都按路径有序，归并即可
+		size_t i = 0;
+		auto it = changes.begin();
+		while (i < index.size() || it != changes.end()) {
+			int c;
+			if (i >= index.size())
+				c = 1;
+			else if (it == changes.end())
+				c = -1;
+			else
+				c = index.path(i).compare(it->first);
+
+			if (c < 0) {
+				IndexFile::Record r = index.record(i);
+				if (index.isRacy(i)) {
+					// racy条目写入新文件后会显得比暂存区更旧，必须清除stat
+					r.size = 0;
+					r.mtime_ns = 0;
+					r.ctime_ns = 0;
+					r.ino = 0;
+					r.mode = 0;
+				}
+				builder.add(index.path(i), r);
+				++i;
+				continue;
+			}
+			if (it->second)
+				builder.add(it->first, *it->second);
+			if (c == 0)
+				++i;
+			++it;
+		}
+	}
+	// 旧文件的映射已关闭，可以安全替换
+	writeAtomically(index_path, builder.finish());
+}
+
 void Index::write(const IndexMap &m) {
-	ofstream f(FileSystemUtils::getInstance().indexPath());
-	for (auto &kv : m)
-		f << kv.first << "\t" << kv.second << "\n";
+	write(RepoContext::current(), m);
+}
+
+void Index::write(const RepoContext &repo, const IndexMap &m) {
+	// 只把哈希变化或有新stat信息的条目作为变更，其余条目沿用旧文件中的记录
+	IndexFile index;
+	index.open(repo.indexPath());
+
+	Changes changes;
+	for (auto &kv : m) {
+		auto staged = staged_stats.find(kv.first);
+		bool has_staged = staged != staged_stats.end() && staged->second.sha == kv.second;
+		size_t pos = index.find(kv.first);
+		if (pos != IndexFile::npos && index.sha(pos) == kv.second && !has_staged)
+			continue;
+
+		Entry e;
+		e.sha = kv.second;
+		if (has_staged)
+			e.stat = staged->second.stat;
+		changes[kv.first] = e;
+	}
+	for (size_t i = 0; i < index.size(); ++i) {
+		string p(index.path(i));
+		if (m.find(p) == m.end())
+			changes[p] = nullopt;
+	}
+	staged_stats.clear();
+	index.close();
+
+	// 没有任何变更时仍然写入，保证暂存区文件存在且为当前格式
+	update(repo, changes);
+}
+
+// 暂存单个文件：先取stat再计算哈希，哈希期间文件若被修改，stat将不再匹配
+static string stageFile(const RepoContext &repo, const fs::path &file, const string &rel) {
+	FileStat st;
+	bool has_stat = FileSystemUtils::statFile(file, st);
+	string h = Objects::storeBlob(repo, file);
+	if (has_stat) {
+		staged_stats[rel] = Index::Entry{h, st};
+	}
+	return h;
 }
 
 void Index::stagePath(const fs::path &p, IndexMap &idx) {
+	stagePath(RepoContext::current(), p, idx);
+}
+
+void Index::stagePath(const RepoContext &repo, const fs::path &p, IndexMap &idx) {
 	if (fs::is_directory(p)) {
 		for (auto &e : fs::recursive_directory_iterator(p)) {
 			if (e.is_directory())
 				continue;
-			if (FileSystemUtils::getInstance().isIgnored(e.path()))
+			if (FileSystemUtils::isIgnored(e.path()))
 				continue;
-			string rel =
-				fs::relative(e.path(), FileSystemUtils::getInstance().repoRoot()).generic_string();
-			string h = Objects::storeBlob(e.path());
+			string rel = fs::relative(e.path(), repo.root()).generic_string();
+			string h = stageFile(repo, e.path(), rel);
 			idx[rel] = h;
 			cout << "add " << rel << " -> " << h.substr(0, 12) << "\n";
 		}
 	} else {
-		string rel = fs::relative(p, FileSystemUtils::getInstance().repoRoot()).generic_string();
-		if (FileSystemUtils::getInstance().isIgnored(p))
+		string rel = fs::relative(p, repo.root()).generic_string();
+		if (FileSystemUtils::isIgnored(p))
 			return;
-		string h = Objects::storeBlob(p);
+		string h = stageFile(repo, p, rel);
 		idx[rel] = h;
 		cout << "add " << rel << " -> " << h.substr(0, 12) << "\n";
 	}
-}
\ No newline at end of file
+}
@@ -2,19 +2,95 @@
 
 #include "common.h"
 #include "filesystem_utils.h"
+#include "mapped_file.h"
+#include "repo_context.h"
+#include <string_view>
+
+/**
+ * 暂存区文件的只读视图
+ * 磁盘格式：文件头 + 按路径排序的定长条目 + 路径字符串表。
+ * 文件通过mmap打开，按路径查找为二分查找，不需要把整个暂存区解析成map。
+ * 旧格式（v1二进制、纯文本 path\tsha）在打开时转换为同样的内存布局。
+ */
+class IndexFile {
+public:
+	static constexpr size_t npos = SIZE_MAX;
+
+	// 打开暂存区文件，文件不存在时视为空暂存区；文件损坏时抛出异常
+	void open(const fs::path &p);
+	void close();
+
+	size_t size() const { return count; }
+	string_view path(size_t i) const;
+	string sha(size_t i) const;
+	const unsigned char *rawSha(size_t i) const;
+	// 条目记录的stat信息；racy条目返回空stat，调用方需要重新计算哈希
+	FileStat stat(size_t i) const;
+	bool isRacy(size_t i) const;
+
+	// 二分查找路径，未找到返回 npos
+	size_t find(string_view p) const;
+
+	// 内部使用的定长条目布局，公开以便 Index 复制未修改的条目
+#pragma pack(push, 1)
+	struct Record {
+		uint64_t size;
+		int64_t mtime_ns;
+		int64_t ctime_ns;
+		uint64_t ino;
+		uint32_t mode;
+		uint32_t path_offset; // 在字符串表中的偏移
+		uint32_t path_length;
+		unsigned char sha[20];
+	};
+#pragma pack(pop)
+	const Record &record(size_t i) const { return records[i]; }
+
+private:
+	MappedFile file;
+	vector<uint8_t> converted; // 旧格式转换后的数据
+	const Record *records = nullptr;
+	const char *strings = nullptr;
+	size_t count = 0;
+	int64_t index_mtime_ns = 0;
+
+	void attach(const uint8_t *data, size_t size, const fs::path &p);
+};
 
 /**
  * 暂存区(Index)管理类
  * 管理文件路径到blob SHA的映射
+ *
+ * 每个条目同时记录暂存时的文件stat信息（大小、mtime/ctime纳秒、inode、mode），
+ * status据此跳过未修改文件的哈希计算。写入时只重新编码发生变化的条目，
+ * 其余条目直接从映射的旧文件复制，并通过临时文件+重命名原子替换。
  */
 class Index {
 public:
 	using IndexMap = map<string, string>;
 
-	// 读取和写入暂存区
+	// 暂存区条目：blob哈希及记录哈希时的文件stat信息
+	struct Entry {
+		string sha;
+		FileStat stat;
+	};
+	// 待写入的变更：值为空表示删除该路径
+	using Changes = map<string, optional<Entry>>;
+
+	// 读取和写入暂存区（需要完整映射的调用方使用），不带仓库参数时使用当前仓库
 	static IndexMap read();
+	static IndexMap read(const RepoContext &repo);
 	static void write(const IndexMap &index);
+	static void write(const RepoContext &repo, const IndexMap &index);
+
+	// 把变更合并进暂存区文件
+	static void update(const Changes &changes);
+	static void update(const RepoContext &repo, const Changes &changes);
+
+	// 文件当前的stat信息与条目记录一致时，可以直接使用条目中的哈希
+	static bool isUpToDate(const IndexFile &index, size_t i, const FileStat &st);
 
 	// 暂存文件操作
 	static void stagePath(const fs::path &p, IndexMap &idx);
-};
\ No newline at end of file
+	static void stagePath(const RepoContext &repo, const fs::path &p, IndexMap &idx);
+};
@@ -0,0 +1,196 @@
+#include "loose_object.h"
+#include <cstring>
+#include <lz4.h>
+#include <lz4hc.h>
+
+namespace {
+const char LOOSE_MAGIC[4] = {'M', 'G', 'L', 'O'};
+const uint8_t LOOSE_VERSION = 1;
+// 每个数据块的原始大小
+constexpr size_t LOOSE_BLOCK_SIZE = 64 * 1024;
+
+enum LooseCodec : uint8_t {
+	LOOSE_CODEC_LZ4 = 1,
+	LOOSE_CODEC_LZ4HC = 2,
+};
+
+#pragma pack(push, 1)
+struct LooseHeader {
+	char magic[4];
+	uint8_t version;
+	uint8_t type;
+	uint8_t codec;
+	uint8_t reserved;
+	uint64_t size;
+};
+
+struct LooseBlockHeader {
+	uint32_t raw_size;
+	uint32_t stored_size;
+};
+#pragma pack(pop)
+
+// 读取并校验文件头，不是新格式时返回false
+bool readHeader(ifstream &in, LooseHeader &header) {
+	in.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if (in.gcount() != sizeof(header))
+		return false;
+	return memcmp(header.magic, LOOSE_MAGIC, 4) == 0 && header.version == LOOSE_VERSION;
+}
+} // namespace
+
+bool LooseObject::peek(const fs::path &path, ObjectInfo &info) {
+	ifstream in(path, ios::binary);
+	if (!in.is_open())
+		return false;
+	LooseHeader header;
+	if (readHeader(in, header)) {
+		info.type = static_cast<ObjectType>(header.type);
+		info.size = header.size;
+		return true;
+	}
+	// 旧格式：文件内容即对象内容
+	error_code ec;
+	info.type = ObjectType::Unknown;
+	info.size = fs::file_size(path, ec);
+	return !ec;
+}
+
+bool LooseObject::decode(const fs::path &path, const function<void(const uint8_t *, size_t)> &sink,
+						 ObjectInfo *info) {
+	ifstream in(path, ios::binary);
+	if (!in.is_open())
+		return false;
+
+	vector<uint8_t> raw(LOOSE_BLOCK_SIZE);
+	LooseHeader header;
+	if (!readHeader(in, header)) {
+		// 旧格式：按原始内容分块输出
+		in.clear();
+		in.seekg(0);
+		uint64_t total = 0;
+		while (in) {
+			in.read(reinterpret_cast<char *>(raw.data()), raw.size());
+			streamsize n = in.gcount();
+			if (n <= 0)
+				break;
+			sink(raw.data(), n);
+			total += n;
+		}
+		if (info) {
+			info->type = ObjectType::Unknown;
+			info->size = total;
+		}
+		return true;
+	}
+
+	vector<char> stored;
+	uint64_t remaining = header.size;
+	while (remaining > 0) {
+		LooseBlockHeader block;
+		in.read(reinterpret_cast<char *>(&block), sizeof(block));
+		if (in.gcount() != sizeof(block) || block.raw_size == 0 ||
+			block.raw_size > LOOSE_BLOCK_SIZE || block.raw_size > remaining ||
+			block.stored_size > (uint32_t)LZ4_compressBound(LOOSE_BLOCK_SIZE))
+			return false;
+
+		stored.resize(block.stored_size);
+		in.read(stored.data(), block.stored_size);
+		if (in.gcount() != block.stored_size)
+			return false;
+
+		if (block.stored_size == block.raw_size) {
+			sink(reinterpret_cast<const uint8_t *>(stored.data()), block.raw_size);
+		} else {
+			int n = LZ4_decompress_safe(stored.data(), reinterpret_cast<char *>(raw.data()),
+										(int)block.stored_size, (int)block.raw_size);
+			if (n < 0 || (uint32_t)n != block.raw_size)
+				return false;
+			sink(raw.data(), block.raw_size);
+		}
+		remaining -= block.raw_size;
+	}
+
+	if (info) {
+		info->type = static_cast<ObjectType>(header.type);
+		info->size = header.size;
+	}
+	return true;
+}
+
+bool LooseObject::read(const fs::path &path, vector<uint8_t> &out, ObjectInfo *info) {
+	out.clear();
+	ObjectInfo peeked;
+	if (peek(path, peeked))
+		out.reserve(peeked.size);
+	return decode(
+		path, [&out](const uint8_t *data, size_t size) { out.insert(out.end(), data, data + size); },
+		info);
+}
+
+void LooseObject::write(const fs::path &path, ObjectType type, const uint8_t *data, size_t size,
+						bool high_compression) {
+	LooseObjectWriter writer(path, type, high_compression);
+	writer.write(data, size);
+	writer.finish();
+}
+
+LooseObjectWriter::LooseObjectWriter(const fs::path &path, ObjectType type, bool high_compression)
+	: path(path), high_compression(high_compression) {
+	out.open(path, ios::binary | ios::trunc);
+	if (!out.is_open())
+		throw runtime_error("Cannot create object file: " + path.string());
+	block.reserve(LOOSE_BLOCK_SIZE);
+	compressed.resize(LZ4_compressBound(LOOSE_BLOCK_SIZE));
+
+	LooseHeader header;
+	memcpy(header.magic, LOOSE_MAGIC, 4);
+	header.version = LOOSE_VERSION;
+	header.type = static_cast<uint8_t>(type);
+	header.codec = high_compression ? LOOSE_CODEC_LZ4HC : LOOSE_CODEC_LZ4;
+	header.reserved = 0;
+	header.size = 0; // finish() 时回填
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void LooseObjectWriter::write(const uint8_t *data, size_t size) {
+	while (size > 0) {
+		size_t n = min(size, LOOSE_BLOCK_SIZE - block.size());
+		block.insert(block.end(), data, data + n);
+		data += n;
+		size -= n;
+		if (block.size() == LOOSE_BLOCK_SIZE)
+			flushBlock();
+	}
+}
+
+void LooseObjectWriter::flushBlock() {
+	if (block.empty())
+		return;
+	const char *src = reinterpret_cast<const char *>(block.data());
+	int n = high_compression
+				? LZ4_compress_HC(src, compressed.data(), (int)block.size(), (int)compressed.size(),
+								  LZ4HC_CLEVEL_DEFAULT)
+				: LZ4_compress_default(src, compressed.data(), (int)block.size(),
+									   (int)compressed.size());
+
+	LooseBlockHeader header;
+	header.raw_size = (uint32_t)block.size();
+	// 压缩没有收益时原样存放
+	bool use_compressed = n > 0 && (size_t)n < block.size();
+	header.stored_size = use_compressed ? (uint32_t)n : header.raw_size;
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.write(use_compressed ? compressed.data() : src, header.stored_size);
+
+	total += block.size();
+	block.clear();
+}
+
+void LooseObjectWriter::finish() {
+	flushBlock();
+	out.seekp(offsetof(LooseHeader, size));
+	out.write(reinterpret_cast<const char *>(&total), sizeof(total));
+	out.close();
+	if (!out.good())
+		throw runtime_error("Failed to write object file: " + path.string());
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.h"
+#include <functional>
+
+/**
+ * 对象类型（记录在松散对象的文件头中）
+ * 旧版本写入的松散对象没有文件头，类型为 Unknown
+ */
+enum class ObjectType : uint8_t {
+	Unknown = 0,
+	Blob = 1,
+	Commit = 2,
+	Tree = 3,
+};
+
+struct ObjectInfo {
+	ObjectType type = ObjectType::Unknown;
+	uint64_t size = 0; // 原始内容大小
+};
+
+/**
+ * 松散对象编码
+ * 文件头（魔数 "MGLO"、版本、类型、编码方式、原始大小）之后是若干数据块，
+ * 每块为 u32原始大小 + u32存储大小 + 数据；存储大小等于原始大小时该块未压缩。
+ * 块按 LZ4 或 LZ4HC 压缩，解码格式相同，可以逐块流式解压；
+ * 没有文件头的旧对象按原始内容读取。
+ */
+class LooseObject {
+public:
+	// 只读取文件头得到类型和大小，不解压数据
+	static bool peek(const fs::path &path, ObjectInfo &info);
+
+	// 逐块解压，每块解压后交给 sink
+	static bool decode(const fs::path &path, const function<void(const uint8_t *, size_t)> &sink,
+					   ObjectInfo *info = nullptr);
+
+	// 读取完整内容
+	static bool read(const fs::path &path, vector<uint8_t> &out, ObjectInfo *info = nullptr);
+
+	// 一次写入完整内容
+	static void write(const fs::path &path, ObjectType type, const uint8_t *data, size_t size,
+					  bool high_compression = false);
+};
+
+/**
+ * 流式写入松散对象
+ * 内容按块缓冲并压缩，finish() 时回填文件头中的原始大小
+ */
+class LooseObjectWriter {
+public:
+	LooseObjectWriter(const fs::path &path, ObjectType type, bool high_compression = false);
+
+	void write(const uint8_t *data, size_t size);
+	void finish();
+
+private:
+	ofstream out;
+	fs::path path;
+	bool high_compression;
+	uint64_t total = 0;
+	vector<uint8_t> block;
+	vector<char> compressed;
+
+	void flushBlock();
+};
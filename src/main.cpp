@@ -6,8 +6,8 @@ int main(int argc, char **argv) {
 	ios::sync_with_stdio(false);
 	if (argc < 2) {
 		cerr << "Usage: minigit "
-				"<init|add|commit|push|pull|status|checkout|reset|log|diff|set-remote|server|"
-				"connect|clone> [args]\n";
+				"<init|add|commit|push|pull|status|checkout|reset|log|diff|repack|set-remote|"
+				"server|connect|clone> [args]\n";
 		return 1;
 	}
 
@@ -40,6 +40,8 @@ int main(int argc, char **argv) {
 			return Commands::status();
 		else if (cmd == "checkout")
 			return Commands::checkout();
+		else if (cmd == "repack")
+			return Commands::repack();
 		else if (cmd == "reset") {
 			vector<string> a;
 			for (int i = 2; i < argc; ++i)
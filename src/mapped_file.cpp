@@ -0,0 +1,112 @@
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+	moveFrom(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	if (this != &other) {
+		close();
+		moveFrom(other);
+	}
+	return *this;
+}
+
+void MappedFile::moveFrom(MappedFile &other) noexcept {
+	ptr = other.ptr;
+	len = other.len;
+	opened = other.opened;
+#ifdef _WIN32
+	file = other.file;
+	mapping = other.mapping;
+	other.file = INVALID_HANDLE_VALUE;
+	other.mapping = nullptr;
+#else
+	fd = other.fd;
+	other.fd = -1;
+#endif
+	other.ptr = nullptr;
+	other.len = 0;
+	other.opened = false;
+}
+
+bool MappedFile::open(const fs::path &p) {
+	close();
+#ifdef _WIN32
+	file = CreateFileW(p.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+					   nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		close();
+		return false;
+	}
+	len = (size_t)file_size.QuadPart;
+	if (len > 0) {
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) {
+			close();
+			return false;
+		}
+		ptr = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!ptr) {
+			close();
+			return false;
+		}
+	}
+#else
+	fd = ::open(p.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat sb;
+	if (fstat(fd, &sb) != 0) {
+		close();
+		return false;
+	}
+	len = (size_t)sb.st_size;
+	if (len > 0) {
+		void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			close();
+			return false;
+		}
+		ptr = (const uint8_t *)addr;
+	}
+#endif
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (ptr)
+		UnmapViewOfFile(ptr);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (ptr)
+		munmap((void *)ptr, len);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	ptr = nullptr;
+	len = 0;
+	opened = false;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * 只读内存映射文件
+ * POSIX 使用 mmap，Windows 使用 CreateFileMapping/MapViewOfFile；
+ * 空文件不做映射，data() 返回 nullptr、size() 返回0
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	// 映射整个文件，文件不存在或无法映射时返回false
+	bool open(const fs::path &p);
+	void close();
+
+	bool isOpen() const { return opened; }
+	const uint8_t *data() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	const uint8_t *ptr = nullptr;
+	size_t len = 0;
+	bool opened = false;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+	void moveFrom(MappedFile &other) noexcept;
+};
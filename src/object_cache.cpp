@@ -0,0 +1,62 @@
+#include "object_cache.h"
+#include "commit.h"
+
+namespace {
+mutex caches_mutex;
+unordered_map<string, shared_ptr<ObjectCache>> caches;
+
+// 提交在缓存中的代价：字符串内容加上固定开销
+size_t commitCost(const Commit &c) {
+	return sizeof(Commit) + c.id.size() + c.parent.size() + c.message.size() +
+		   c.timestamp.size() + c.root_tree.size();
+}
+} // namespace
+
+shared_ptr<ObjectCache> ObjectCache::forDirectory(const fs::path &objects_dir) {
+	string key = fs::absolute(objects_dir).lexically_normal().string();
+	lock_guard<mutex> lock(caches_mutex);
+	auto &cache = caches[key];
+	if (!cache)
+		cache.reset(new ObjectCache());
+	return cache;
+}
+
+shared_ptr<const Commit> ObjectCache::getCommit(const string &id) {
+	lock_guard<mutex> lock(m);
+	auto c = commits.get(id);
+	++(c ? hits : misses);
+	return c;
+}
+
+void ObjectCache::putCommit(const string &id, shared_ptr<const Commit> commit) {
+	size_t cost = commitCost(*commit);
+	lock_guard<mutex> lock(m);
+	commits.put(id, std::move(commit), cost);
+}
+
+bool ObjectCache::getObject(const string &id, vector<uint8_t> &out) {
+	shared_ptr<const vector<uint8_t>> data;
+	{
+		lock_guard<mutex> lock(m);
+		data = objects.get(id);
+	}
+	++(data ? hits : misses);
+	if (!data)
+		return false;
+	out.assign(data->begin(), data->end());
+	return true;
+}
+
+void ObjectCache::putObject(const string &id, const vector<uint8_t> &data) {
+	if (data.size() > MAX_OBJECT_SIZE)
+		return;
+	auto copy = make_shared<const vector<uint8_t>>(data);
+	lock_guard<mutex> lock(m);
+	objects.put(id, std::move(copy), data.size() + id.size());
+}
+
+void ObjectCache::clear() {
+	lock_guard<mutex> lock(m);
+	commits.clear();
+	objects.clear();
+}
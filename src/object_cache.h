@@ -0,0 +1,108 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct Commit;
+
+/**
+ * 按对象哈希缓存的LRU表
+ * 每个条目带有代价（字节数），总代价超过上限时淘汰最久未使用的条目；
+ * 对象按内容寻址、不会被修改，因此缓存不需要失效
+ */
+template <typename V> class LruCache {
+public:
+	explicit LruCache(size_t limit) : limit(limit) {}
+
+	shared_ptr<const V> get(const string &key) {
+		auto it = index.find(key);
+		if (it == index.end())
+			return nullptr;
+		lru.splice(lru.begin(), lru, it->second);
+		return it->second->value;
+	}
+
+	void put(const string &key, shared_ptr<const V> value, size_t cost) {
+		if (cost > limit || index.count(key))
+			return;
+		used += cost;
+		lru.push_front({key, std::move(value), cost});
+		index[key] = lru.begin();
+		while (used > limit) {
+			used -= lru.back().cost;
+			index.erase(lru.back().key);
+			lru.pop_back();
+		}
+	}
+
+	// 删除键满足条件的条目
+	template <typename Pred> void eraseIf(Pred pred) {
+		for (auto it = lru.begin(); it != lru.end();) {
+			if (pred(it->key)) {
+				used -= it->cost;
+				index.erase(it->key);
+				it = lru.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void clear() {
+		lru.clear();
+		index.clear();
+		used = 0;
+	}
+
+private:
+	struct Entry {
+		string key;
+		shared_ptr<const V> value;
+		size_t cost;
+	};
+
+	size_t limit;
+	size_t used = 0;
+	list<Entry> lru; // 表头为最近使用
+	unordered_map<string, typename list<Entry>::iterator> index;
+};
+
+/**
+ * 仓库级对象缓存
+ * 缓存解析后的提交（不含展开的文件树）和较小对象（树对象、小文件）的内容，
+ * 同一个对象目录共享一个实例，服务器上同一仓库的所有会话共用；线程安全
+ */
+class ObjectCache {
+public:
+	// 超过此大小的对象不缓存，避免大文件挤掉提交和树对象
+	static constexpr size_t MAX_OBJECT_SIZE = 64 * 1024;
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+
+	static shared_ptr<ObjectCache> forDirectory(const fs::path &objects_dir);
+
+	shared_ptr<const Commit> getCommit(const string &id);
+	void putCommit(const string &id, shared_ptr<const Commit> commit);
+
+	bool getObject(const string &id, vector<uint8_t> &out);
+	void putObject(const string &id, const vector<uint8_t> &data);
+
+	Stats stats() const { return {hits.load(), misses.load()}; }
+	void clear();
+
+private:
+	ObjectCache() = default;
+
+	mutex m;
+	LruCache<Commit> commits{4 * 1024 * 1024};
+	LruCache<vector<uint8_t>> objects{32 * 1024 * 1024};
+	atomic<uint64_t> hits{0};
+	atomic<uint64_t> misses{0};
+};
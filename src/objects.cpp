@@ -1,30 +1,321 @@
 #include "objects.h"
+#include "commit.h"
+#include "delta.h"
+#include "loose_object.h"
+#include "object_cache.h"
+#include "pack.h"
+#include <atomic>
+#include <deque>
+
+namespace {
+// 寻找delta基础对象时比较的最近对象数
+constexpr size_t DELTA_WINDOW = 10;
+// delta链的最大长度，限制还原对象时的递归层数
+constexpr int DELTA_MAX_DEPTH = 10;
+// 太小的对象不值得做差异
+constexpr size_t DELTA_MIN_SIZE = 64;
+// storeBlob 每次读取的块大小
+constexpr size_t STORE_BLOCK_SIZE = 64 * 1024;
+
+// 生成对象目录内唯一的临时文件名（并行暂存时也不会冲突）
+fs::path tempObjectPath(const fs::path &objects_dir) {
+	static atomic<uint64_t> counter{0};
+	auto stamp = chrono::steady_clock::now().time_since_epoch().count();
+	return objects_dir / ("tmp_obj_" + to_string(stamp) + "_" + to_string(counter++));
+}
+
+struct PackCandidate {
+	string id;
+	string name; // 对象在提交中的路径，用于把同一文件的各个版本排在一起
+	vector<uint8_t> data;
+	int depth = 0;
+};
+
+// 沿HEAD的提交历史为blob记录路径（取最新提交中的路径）
+map<string, string> collectNameHints(const fs::path &objects_dir) {
+	map<string, string> names;
+	ifstream head_file(objects_dir.parent_path() / "HEAD");
+	string commit_id;
+	getline(head_file, commit_id);
+
+	set<string> seen;
+	while (!commit_id.empty() && seen.insert(commit_id).second) {
+		auto c = CommitManager::readCommit(objects_dir, commit_id, true);
+		if (!c)
+			break;
+		for (const auto &kv : c->tree)
+			names.emplace(kv.second, kv.first);
+		commit_id = c->parent;
+	}
+	return names;
+}
+
+bool readObjectFrom(const fs::path &objects_dir, ObjectCache &cache, PackStore &packs,
+					const string &id, vector<uint8_t> &out) {
+	// 树对象和小文件在同一命令（或服务器的多个请求）中会被反复读取
+	if (cache.getObject(id, out))
+		return true;
+	fs::path loose = FileSystemUtils::objectPath(objects_dir, id);
+	bool found = fs::exists(loose) ? LooseObject::read(loose, out) : packs.read(id, out);
+	if (found)
+		cache.putObject(id, out);
+	return found;
+}
+
+bool objectInfoFrom(const fs::path &objects_dir, PackStore &packs, const string &id,
+					ObjectInfo &info) {
+	fs::path loose = FileSystemUtils::objectPath(objects_dir, id);
+	if (fs::exists(loose))
+		return LooseObject::peek(loose, info);
+	// 包中的条目没有记录类型
+	info.type = ObjectType::Unknown;
+	return packs.objectSize(id, info.size);
+}
+} // namespace
 
 string Objects::storeBlob(const fs::path &file) {
+	return storeBlob(RepoContext::current(), file);
+}
+
+string Objects::storeBlob(const RepoContext &repo, const fs::path &file) {
+	// 分块读取，同时计算哈希并写入临时文件，内存占用与文件大小无关
+	const fs::path &objects_dir = repo.objectsDir();
+	fs::path tmp = tempObjectPath(objects_dir);
 	ifstream in(file, ios::binary);
-	vector<unsigned char> data((istreambuf_iterator<char>(in)), {});
-	string id = sha256_bytes(data);
-	fs::create_directories(FileSystemUtils::getInstance().objectsDir());
-	fs::path dst = FileSystemUtils::getInstance().objectsDir() / id;
-	if (!fs::exists(dst)) {
-		ofstream out(dst, ios::binary);
-		out.write((char *)data.data(), data.size());
+
+	SHA1 hasher;
+	hasher.init();
+	error_code ec;
+	try {
+		LooseObjectWriter out(tmp, ObjectType::Blob);
+		vector<char> buf(STORE_BLOCK_SIZE);
+		while (in) {
+			in.read(buf.data(), buf.size());
+			streamsize n = in.gcount();
+			if (n <= 0)
+				break;
+			hasher.update(reinterpret_cast<const unsigned char *>(buf.data()), n);
+			out.write(reinterpret_cast<const uint8_t *>(buf.data()), n);
+		}
+		out.finish();
+	} catch (...) {
+		fs::remove(tmp, ec);
+		throw;
+	}
+
+	unsigned char raw[20];
+	hasher.finalize(raw);
+	string id = sha1_to_hex(raw);
+
+	// 对象已存在（松散或已打包）时丢弃临时文件，否则重命名到位
+	if (hasObject(repo, id)) {
+		fs::remove(tmp, ec);
+		return id;
+	}
+	fs::path dst = repo.objectPath(id);
+	fs::create_directories(dst.parent_path());
+	fs::rename(tmp, dst, ec);
+	if (ec) {
+		// 并发写入同一对象时另一方可能已经放好
+		fs::remove(tmp, ec);
+		if (!fs::exists(dst))
+			throw runtime_error("Failed to store object: " + id);
 	}
 	return id;
 }
 
 bool Objects::hasObject(const string &id) {
-	return fs::exists(FileSystemUtils::getInstance().objectsDir() / id);
+	return hasObject(RepoContext::current(), id);
+}
+
+bool Objects::hasObject(const fs::path &objects_dir, const string &id) {
+	if (fs::exists(FileSystemUtils::objectPath(objects_dir, id)))
+		return true;
+	return PackStore::forDirectory(objects_dir)->contains(id);
+}
+
+bool Objects::hasObject(const RepoContext &repo, const string &id) {
+	return fs::exists(repo.objectPath(id)) || repo.packs().contains(id);
+}
+
+bool Objects::readObject(const string &id, vector<uint8_t> &out) {
+	return readObject(RepoContext::current(), id, out);
+}
+
+bool Objects::readObject(const fs::path &objects_dir, const string &id, vector<uint8_t> &out) {
+	return readObjectFrom(objects_dir, *ObjectCache::forDirectory(objects_dir),
+						  *PackStore::forDirectory(objects_dir), id, out);
+}
+
+bool Objects::readObject(const RepoContext &repo, const string &id, vector<uint8_t> &out) {
+	return readObjectFrom(repo.objectsDir(), repo.cache(), repo.packs(), id, out);
+}
+
+bool Objects::objectInfo(const string &id, ObjectInfo &info) {
+	return objectInfo(RepoContext::current(), id, info);
+}
+
+bool Objects::objectInfo(const fs::path &objects_dir, const string &id, ObjectInfo &info) {
+	return objectInfoFrom(objects_dir, *PackStore::forDirectory(objects_dir), id, info);
+}
+
+bool Objects::objectInfo(const RepoContext &repo, const string &id, ObjectInfo &info) {
+	return objectInfoFrom(repo.objectsDir(), repo.packs(), id, info);
+}
+
+void Objects::restoreFile(const string &id, const fs::path &dst) {
+	fs::path loose = FileSystemUtils::getInstance().objectPath(id);
+	if (fs::exists(loose)) {
+		// 逐块解压写出，不把整个对象读入内存
+		ofstream out(dst, ios::binary | ios::trunc);
+		bool ok = out.is_open() && LooseObject::decode(loose, [&out](const uint8_t *p, size_t n) {
+					  out.write(reinterpret_cast<const char *>(p), n);
+				  });
+		out.close();
+		if (!ok || !out.good())
+			throw runtime_error("Cannot restore object " + id + " to " + dst.string());
+		return;
+	}
+	vector<uint8_t> data;
+	if (!readObject(id, data))
+		throw runtime_error("Object not found: " + id);
+	FileSystemUtils::getInstance().writeBinary(dst, data);
+}
+
+size_t Objects::repack(const fs::path &objects_dir) {
+	// 收集松散对象（objects/ab/cdef...）
+	vector<pair<string, fs::path>> loose;
+	error_code ec;
+	for (fs::directory_iterator it(objects_dir, ec), end; !ec && it != end; it.increment(ec)) {
+		string shard = it->path().filename().string();
+		if (!it->is_directory() || shard.size() != 2)
+			continue;
+		for (auto &entry : fs::directory_iterator(it->path())) {
+			string id = shard + entry.path().filename().string();
+			unsigned char raw[20];
+			if (entry.is_regular_file() && sha1_from_hex(id, raw))
+				loose.emplace_back(id, entry.path());
+		}
+	}
+
+	auto store = PackStore::forDirectory(objects_dir);
+	vector<string> packed = store->listObjects();
+	fs::path pack_dir = PackStore::packDir(objects_dir);
+	vector<fs::path> old_packs;
+	for (fs::directory_iterator it(pack_dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (it->path().extension() == ".idx")
+			old_packs.push_back(it->path());
+	}
+
+	// 已经只有一个包时无需重写
+	if (loose.empty() && old_packs.size() <= 1)
+		return packed.size();
+
+	// 同一对象可能同时存在于松散对象和包中，只写入一次
+	set<string> ids;
+	for (const auto &l : loose)
+		ids.insert(l.first);
+	ids.insert(packed.begin(), packed.end());
+
+	map<string, string> names = collectNameHints(objects_dir);
+	vector<PackCandidate> objects;
+	objects.reserve(ids.size());
+	for (const auto &id : ids) {
+		PackCandidate obj;
+		obj.id = id;
+		auto it = names.find(id);
+		if (it != names.end())
+			obj.name = it->second;
+		if (!readObject(objects_dir, id, obj.data))
+			throw runtime_error("Cannot read object for repack: " + id);
+		objects.push_back(std::move(obj));
+	}
+
+	// 同一路径的版本相邻且大的在前，窗口内较大的版本作为较小版本的基础
+	sort(objects.begin(), objects.end(), [](const PackCandidate &a, const PackCandidate &b) {
+		if (a.name != b.name)
+			return a.name < b.name;
+		if (a.data.size() != b.data.size())
+			return a.data.size() > b.data.size();
+		return a.id < b.id;
+	});
+
+	PackWriter writer(pack_dir, static_cast<uint32_t>(objects.size()));
+	deque<size_t> window;
+	vector<uint8_t> delta, best_delta;
+	for (size_t k = 0; k < objects.size(); ++k) {
+		PackCandidate &obj = objects[k];
+		size_t best = SIZE_MAX;
+		// 差异至少要把对象缩小一半才采用
+		size_t limit = obj.data.size() / 2;
+		if (obj.data.size() >= DELTA_MIN_SIZE) {
+			for (size_t j : window) {
+				const PackCandidate &base = objects[j];
+				if (base.depth >= DELTA_MAX_DEPTH || obj.data.size() > base.data.size() + limit)
+					continue;
+				if (Delta::create(base.data, obj.data, delta, limit)) {
+					best = j;
+					limit = delta.size() - 1;
+					swap(best_delta, delta);
+				}
+			}
+		}
+
+		if (best != SIZE_MAX) {
+			writer.addDelta(obj.id, objects[best].id, best_delta);
+			obj.depth = objects[best].depth + 1;
+		} else {
+			writer.add(obj.id, obj.data);
+		}
+
+		window.push_back(k);
+		if (window.size() > DELTA_WINDOW) {
+			// 移出窗口的对象不再需要内容
+			vector<uint8_t>().swap(objects[window.front()].data);
+			window.pop_front();
+		}
+	}
+	string name = writer.finish();
+
+	// 删除旧包之前先释放映射
+	store->close();
+	for (const auto &idx : old_packs) {
+		if (idx.stem().string() == name)
+			continue;
+		fs::path pack = idx;
+		pack.replace_extension(".pack");
+		fs::remove(idx, ec);
+		fs::remove(pack, ec);
+	}
+	for (const auto &l : loose) {
+		fs::remove(l.second, ec);
+		fs::remove(l.second.parent_path(), ec); // 仅在目录为空时成功
+	}
+	return objects.size();
+}
+
+function<bool(const fs::path &, vector<uint8_t> &)>
+Objects::archiveLoader(const fs::path &objects_dir) {
+	return [objects_dir](const fs::path &relative, vector<uint8_t> &out) {
+		// objects/ab/cdef... -> abcdef...
+		fs::path shard = relative.parent_path();
+		string id = shard.filename().string() + relative.filename().string();
+		if (shard.parent_path().filename() != "objects" || id.size() != 40)
+			return false;
+		return readObject(objects_dir, id, out);
+	};
 }
 
 void Objects::copyObjectTo(const string &id, const fs::path &to) {
-	fs::create_directories(to);
-	fs::copy_file(FileSystemUtils::getInstance().objectsDir() / id, to / id,
+	fs::path dst = FileSystemUtils::objectPath(to, id);
+	fs::create_directories(dst.parent_path());
+	fs::copy_file(FileSystemUtils::getInstance().objectPath(id), dst,
 				  fs::copy_options::overwrite_existing);
 }
 
 void Objects::copyObjectFrom(const fs::path &from, const string &id) {
-	fs::create_directories(FileSystemUtils::getInstance().objectsDir());
-	fs::copy_file(from / id, FileSystemUtils::getInstance().objectsDir() / id,
+	fs::path dst = FileSystemUtils::getInstance().objectPath(id);
+	fs::create_directories(dst.parent_path());
+	fs::copy_file(FileSystemUtils::objectPath(from, id), dst,
 				  fs::copy_options::overwrite_existing);
 }
\ No newline at end of file
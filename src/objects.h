@@ -2,7 +2,10 @@
 
 #include "common.h"
 #include "filesystem_utils.h"
+#include "loose_object.h"
+#include "repo_context.h"
 #include "sha256.h"
+#include <functional>
 
 /**
  * Git对象管理类
@@ -10,9 +13,38 @@
  */
 class Objects {
 public:
-	// Blob对象操作
+	// Blob对象操作，不带仓库参数时使用当前仓库
 	static string storeBlob(const fs::path &file);
+	static string storeBlob(const RepoContext &repo, const fs::path &file);
 	static bool hasObject(const string &id);
+	static bool hasObject(const fs::path &objects_dir, const string &id);
+	static bool hasObject(const RepoContext &repo, const string &id);
+
+	// 读取对象内容：先查找松散对象，再查找包文件
+	static bool readObject(const string &id, vector<uint8_t> &out);
+	static bool readObject(const fs::path &objects_dir, const string &id, vector<uint8_t> &out);
+	static bool readObject(const RepoContext &repo, const string &id, vector<uint8_t> &out);
+
+	// 读取对象的类型和大小，松散对象只读取文件头
+	static bool objectInfo(const string &id, ObjectInfo &info);
+	static bool objectInfo(const fs::path &objects_dir, const string &id, ObjectInfo &info);
+	static bool objectInfo(const RepoContext &repo, const string &id, ObjectInfo &info);
+
+	// 把对象内容写到工作目录中的文件
+	static void restoreFile(const string &id, const fs::path &dst);
+
+	/**
+	 * 把所有松散对象和已有的包合并成一个新的包，并删除被打包的松散对象和旧包
+	 * 返回新包中的对象数量
+	 */
+	static size_t repack(const fs::path &objects_dir);
+
+	/**
+	 * 供归档使用的读取函数：把 objects/ab/cdef 形式的相对路径解析成对象后读取，
+	 * 这样位于包文件中的对象也能直接加入传输归档
+	 */
+	static function<bool(const fs::path &, vector<uint8_t> &)>
+	archiveLoader(const fs::path &objects_dir);
 
 	// 对象复制操作（用于push/pull）
 	static void copyObjectTo(const string &id, const fs::path &to);
@@ -0,0 +1,489 @@
+#include "pack.h"
+#include "delta.h"
+#include <array>
+#include <cstring>
+#include <lz4.h>
+
+namespace {
+const char PACK_MAGIC[4] = {'M', 'G', 'P', 'K'};
+const char IDX_MAGIC[4] = {'M', 'G', 'P', 'I'};
+const uint32_t PACK_VERSION = 1;
+
+// 条目存储方式
+enum PackEntryType : uint8_t {
+	PACK_ENTRY_STORED = 1, // 原样存放
+	PACK_ENTRY_LZ4 = 2,	   // LZ4压缩
+	PACK_ENTRY_DELTA = 3,	  // 差异指令，原样存放
+	PACK_ENTRY_DELTA_LZ4 = 4, // 差异指令，LZ4压缩
+};
+
+// 读取时允许的最大delta链长度，防止损坏的包造成无限递归
+constexpr int MAX_READ_DEPTH = 64;
+
+#pragma pack(push, 1)
+struct PackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+};
+
+struct PackEntryHeader {
+	uint8_t type;
+	uint64_t size;		  // 原始大小
+	uint64_t stored_size; // 包中数据的大小
+};
+#pragma pack(pop)
+
+const size_t IDX_FANOUT_OFFSET = sizeof(PackHeader);
+const size_t IDX_SHAS_OFFSET = IDX_FANOUT_OFFSET + 256 * sizeof(uint32_t);
+
+mutex stores_mutex;
+map<string, shared_ptr<PackStore>> stores;
+} // namespace
+
+bool PackFile::open(const fs::path &path) {
+	close();
+	idx_path = path;
+	pack_path = path;
+	pack_path.replace_extension(".pack");
+	if (!idx.open(idx_path) || !pack.open(pack_path))
+		return false;
+
+	PackHeader header;
+	if (idx.size() < IDX_SHAS_OFFSET)
+		return false;
+	memcpy(&header, idx.data(), sizeof(header));
+	if (memcmp(header.magic, IDX_MAGIC, 4) != 0 || header.version != PACK_VERSION)
+		return false;
+	if (idx.size() < IDX_SHAS_OFFSET + (size_t)header.count * (20 + sizeof(uint64_t)))
+		return false;
+
+	PackHeader pack_header;
+	if (pack.size() < sizeof(pack_header) + 20)
+		return false;
+	memcpy(&pack_header, pack.data(), sizeof(pack_header));
+	if (memcmp(pack_header.magic, PACK_MAGIC, 4) != 0 || pack_header.count != header.count)
+		return false;
+
+	count = header.count;
+	fanout = idx.data() + IDX_FANOUT_OFFSET;
+	shas = idx.data() + IDX_SHAS_OFFSET;
+	offsets = shas + count * 20;
+	return true;
+}
+
+shared_ptr<const vector<uint8_t>> DeltaBaseCache::get(uint64_t offset) {
+	auto it = index.find(offset);
+	if (it == index.end())
+		return nullptr;
+	lru.splice(lru.begin(), lru, it->second);
+	return it->second->second;
+}
+
+void DeltaBaseCache::put(uint64_t offset, shared_ptr<const vector<uint8_t>> data) {
+	if (data->size() > limit || index.count(offset))
+		return;
+	used += data->size();
+	lru.emplace_front(offset, std::move(data));
+	index[offset] = lru.begin();
+	while (used > limit) {
+		used -= lru.back().second->size();
+		index.erase(lru.back().first);
+		lru.pop_back();
+	}
+}
+
+void DeltaBaseCache::clear() {
+	lru.clear();
+	index.clear();
+	used = 0;
+}
+
+void PackFile::close() {
+	idx.close();
+	pack.close();
+	base_cache.clear();
+	count = 0;
+	fanout = nullptr;
+	shas = nullptr;
+	offsets = nullptr;
+}
+
+uint32_t PackFile::fanoutAt(int b) const {
+	uint32_t v;
+	memcpy(&v, fanout + b * sizeof(uint32_t), sizeof(v));
+	return v;
+}
+
+uint64_t PackFile::offsetAt(size_t i) const {
+	uint64_t v;
+	memcpy(&v, offsets + i * sizeof(uint64_t), sizeof(v));
+	return v;
+}
+
+const unsigned char *PackFile::rawSha(size_t i) const {
+	return shas + i * 20;
+}
+
+size_t PackFile::find(const unsigned char raw[20]) const {
+	if (count == 0)
+		return npos;
+	// fanout[b] 为首字节不大于 b 的对象数量
+	size_t lo = raw[0] == 0 ? 0 : fanoutAt(raw[0] - 1);
+	size_t hi = fanoutAt(raw[0]);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int c = memcmp(rawSha(mid), raw, 20);
+		if (c == 0)
+			return mid;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return npos;
+}
+
+bool PackFile::read(size_t i, vector<uint8_t> &out) {
+	return readEntry(offsetAt(i), out, 0);
+}
+
+shared_ptr<const vector<uint8_t>> PackFile::readBase(const unsigned char raw[20], int depth) {
+	size_t i = find(raw);
+	if (i == npos)
+		return nullptr;
+	uint64_t offset = offsetAt(i);
+	auto cached = base_cache.get(offset);
+	if (cached)
+		return cached;
+
+	auto data = make_shared<vector<uint8_t>>();
+	if (!readEntry(offset, *data, depth))
+		return nullptr;
+	base_cache.put(offset, data);
+	return data;
+}
+
+bool PackFile::objectSize(size_t i, uint64_t &size) const {
+	uint64_t offset = offsetAt(i);
+	if (offset + sizeof(PackEntryHeader) > pack.size() - 20)
+		return false;
+	PackEntryHeader entry;
+	memcpy(&entry, pack.data() + offset, sizeof(entry));
+	if (entry.type == PACK_ENTRY_STORED || entry.type == PACK_ENTRY_LZ4) {
+		size = entry.size;
+		return true;
+	}
+
+	// 差异指令开头为 varint(基础大小) + varint(结果大小)
+	vector<uint8_t> delta;
+	bool is_delta;
+	const unsigned char *base_raw;
+	if (!readPayload(offset, delta, is_delta, base_raw))
+		return false;
+	return Delta::resultSize(delta.data(), delta.size(), size);
+}
+
+bool PackFile::readEntry(uint64_t offset, vector<uint8_t> &out, int depth) {
+	if (depth > MAX_READ_DEPTH)
+		return false;
+	vector<uint8_t> decoded;
+	bool is_delta;
+	const unsigned char *base_raw;
+	if (!readPayload(offset, decoded, is_delta, base_raw))
+		return false;
+	if (!is_delta) {
+		out.swap(decoded);
+		return true;
+	}
+
+	auto base = readBase(base_raw, depth + 1);
+	if (!base)
+		return false;
+	return Delta::apply(base->data(), base->size(), decoded.data(), decoded.size(), out);
+}
+
+bool PackFile::readPayload(uint64_t offset, vector<uint8_t> &payload, bool &is_delta,
+						   const unsigned char *&base_raw) const {
+	size_t data_end = pack.size() - 20; // 末尾为校验和
+	if (offset + sizeof(PackEntryHeader) > data_end)
+		return false;
+
+	PackEntryHeader entry;
+	memcpy(&entry, pack.data() + offset, sizeof(entry));
+	const uint8_t *data = pack.data() + offset + sizeof(entry);
+	size_t available = data_end - offset - sizeof(entry);
+
+	is_delta = entry.type == PACK_ENTRY_DELTA || entry.type == PACK_ENTRY_DELTA_LZ4;
+	base_raw = nullptr;
+	if (is_delta) {
+		if (available < 20)
+			return false;
+		base_raw = data;
+		data += 20;
+		available -= 20;
+	}
+	if (entry.stored_size > available)
+		return false;
+
+	// 取出条目数据（对象内容或差异指令）
+	if (entry.type == PACK_ENTRY_STORED || entry.type == PACK_ENTRY_DELTA) {
+		if (entry.stored_size != entry.size)
+			return false;
+		payload.assign(data, data + entry.size);
+	} else if (entry.type == PACK_ENTRY_LZ4 || entry.type == PACK_ENTRY_DELTA_LZ4) {
+		if (entry.size > LZ4_MAX_INPUT_SIZE)
+			return false;
+		payload.resize(entry.size);
+		int n = LZ4_decompress_safe(reinterpret_cast<const char *>(data),
+									reinterpret_cast<char *>(payload.data()),
+									(int)entry.stored_size, (int)entry.size);
+		if (n < 0 || (uint64_t)n != entry.size) {
+			payload.clear();
+			return false;
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+PackWriter::PackWriter(const fs::path &pack_dir, uint32_t object_count)
+	: pack_dir(pack_dir), expected(object_count) {
+	fs::create_directories(pack_dir);
+	auto stamp = chrono::steady_clock::now().time_since_epoch().count();
+	tmp_path = pack_dir / ("tmp_pack_" + to_string(stamp));
+	out.open(tmp_path, ios::binary | ios::trunc);
+	if (!out.is_open())
+		throw runtime_error("Cannot create pack file: " + tmp_path.string());
+	hasher.init();
+
+	PackHeader header;
+	memcpy(header.magic, PACK_MAGIC, 4);
+	header.version = PACK_VERSION;
+	header.count = object_count;
+	write(&header, sizeof(header));
+}
+
+PackWriter::~PackWriter() {
+	if (!finished) {
+		out.close();
+		error_code ec;
+		fs::remove(tmp_path, ec);
+	}
+}
+
+void PackWriter::write(const void *data, size_t size) {
+	out.write(reinterpret_cast<const char *>(data), size);
+	hasher.update(reinterpret_cast<const unsigned char *>(data), size);
+	offset += size;
+}
+
+void PackWriter::add(const string &id, const vector<uint8_t> &data) {
+	if (entries.size() >= expected)
+		throw runtime_error("Too many objects for pack");
+	entries.emplace_back(id, offset);
+	writeEntry(false, nullptr, data);
+}
+
+void PackWriter::addDelta(const string &id, const string &base_id, const vector<uint8_t> &delta) {
+	if (entries.size() >= expected)
+		throw runtime_error("Too many objects for pack");
+	unsigned char base_raw[20];
+	if (!sha1_from_hex(base_id, base_raw))
+		throw runtime_error("Invalid delta base id: " + base_id);
+	entries.emplace_back(id, offset);
+	writeEntry(true, base_raw, delta);
+}
+
+void PackWriter::writeEntry(bool is_delta, const unsigned char *base_raw,
+							const vector<uint8_t> &data) {
+	PackEntryHeader entry;
+	entry.size = data.size();
+
+	// 压缩后没有变小的对象原样存放
+	vector<uint8_t> compressed;
+	if (!data.empty() && data.size() <= LZ4_MAX_INPUT_SIZE) {
+		compressed.resize(LZ4_compressBound((int)data.size()));
+		int n = LZ4_compress_default(reinterpret_cast<const char *>(data.data()),
+									 reinterpret_cast<char *>(compressed.data()), (int)data.size(),
+									 (int)compressed.size());
+		compressed.resize(n > 0 ? n : 0);
+	}
+	bool use_lz4 = !compressed.empty() && compressed.size() < data.size();
+	const vector<uint8_t> &stored = use_lz4 ? compressed : data;
+	if (is_delta)
+		entry.type = use_lz4 ? PACK_ENTRY_DELTA_LZ4 : PACK_ENTRY_DELTA;
+	else
+		entry.type = use_lz4 ? PACK_ENTRY_LZ4 : PACK_ENTRY_STORED;
+	entry.stored_size = stored.size();
+	write(&entry, sizeof(entry));
+	if (is_delta)
+		write(base_raw, 20);
+	write(stored.data(), stored.size());
+}
+
+string PackWriter::finish() {
+	if (entries.size() != expected)
+		throw runtime_error("Pack object count mismatch");
+
+	unsigned char checksum[20];
+	hasher.finalize(checksum);
+	out.write(reinterpret_cast<const char *>(checksum), 20);
+	out.close();
+	if (!out.good())
+		throw runtime_error("Failed to write pack file: " + tmp_path.string());
+
+	// 按哈希排序，构建fanout表
+	vector<pair<array<unsigned char, 20>, uint64_t>> sorted;
+	sorted.reserve(entries.size());
+	for (const auto &e : entries) {
+		array<unsigned char, 20> raw;
+		if (!sha1_from_hex(e.first, raw.data()))
+			throw runtime_error("Invalid object id in pack: " + e.first);
+		sorted.emplace_back(raw, e.second);
+	}
+	sort(sorted.begin(), sorted.end());
+
+	vector<uint8_t> idx_data(IDX_SHAS_OFFSET + sorted.size() * (20 + sizeof(uint64_t)));
+	PackHeader header;
+	memcpy(header.magic, IDX_MAGIC, 4);
+	header.version = PACK_VERSION;
+	header.count = (uint32_t)sorted.size();
+	memcpy(idx_data.data(), &header, sizeof(header));
+
+	uint32_t fanout[256] = {0};
+	for (const auto &e : sorted)
+		fanout[e.first[0]]++;
+	for (int b = 1; b < 256; ++b)
+		fanout[b] += fanout[b - 1];
+	memcpy(idx_data.data() + IDX_FANOUT_OFFSET, fanout, sizeof(fanout));
+
+	uint8_t *sha_out = idx_data.data() + IDX_SHAS_OFFSET;
+	uint8_t *offset_out = sha_out + sorted.size() * 20;
+	SHA1 name_hasher;
+	name_hasher.init();
+	for (size_t i = 0; i < sorted.size(); ++i) {
+		memcpy(sha_out + i * 20, sorted[i].first.data(), 20);
+		memcpy(offset_out + i * sizeof(uint64_t), &sorted[i].second, sizeof(uint64_t));
+		name_hasher.update(sorted[i].first.data(), 20);
+	}
+
+	// 包名由其中的对象集合决定
+	unsigned char name_raw[20];
+	name_hasher.finalize(name_raw);
+	string name = "pack-" + sha1_to_hex(name_raw);
+
+	// 先放好包文件再写索引，读取方看到索引时包文件一定已经完整
+	fs::path pack_path = pack_dir / (name + ".pack");
+	fs::path idx_path = pack_dir / (name + ".idx");
+	fs::rename(tmp_path, pack_path);
+	fs::path idx_tmp = pack_dir / (name + ".idx.tmp");
+	{
+		ofstream f(idx_tmp, ios::binary | ios::trunc);
+		f.write(reinterpret_cast<const char *>(idx_data.data()), idx_data.size());
+		if (!f.good())
+			throw runtime_error("Failed to write pack index: " + idx_tmp.string());
+	}
+	fs::rename(idx_tmp, idx_path);
+	finished = true;
+	return name;
+}
+
+shared_ptr<PackStore> PackStore::forDirectory(const fs::path &objects_dir) {
+	string key = fs::absolute(objects_dir).lexically_normal().string();
+	lock_guard<mutex> lock(stores_mutex);
+	auto &store = stores[key];
+	if (!store)
+		store.reset(new PackStore(objects_dir));
+	return store;
+}
+
+bool PackStore::refresh() {
+	fs::path dir = packDir(objects_dir);
+	error_code ec;
+	auto mtime = fs::last_write_time(dir, ec);
+	if (ec) {
+		// 没有包目录
+		bool had_packs = !packs.empty();
+		packs.clear();
+		scanned = true;
+		return had_packs;
+	}
+	if (scanned && mtime == scanned_time)
+		return false;
+
+	packs.clear();
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (it->path().extension() != ".idx")
+			continue;
+		auto pack = make_unique<PackFile>();
+		if (pack->open(it->path()))
+			packs.push_back(std::move(pack));
+	}
+	scanned_time = mtime;
+	scanned = true;
+	return true;
+}
+
+PackFile *PackStore::locate(const unsigned char raw[20], size_t &index) {
+	if (!scanned)
+		refresh();
+	for (int pass = 0; pass < 2; ++pass) {
+		for (const auto &pack : packs) {
+			index = pack->find(raw);
+			if (index != PackFile::npos)
+				return pack.get();
+		}
+		// 未命中时检查是否有新的包
+		if (!refresh())
+			break;
+	}
+	return nullptr;
+}
+
+bool PackStore::contains(const string &id) {
+	unsigned char raw[20];
+	if (!sha1_from_hex(id, raw))
+		return false;
+	lock_guard<mutex> lock(m);
+	size_t i;
+	return locate(raw, i) != nullptr;
+}
+
+bool PackStore::read(const string &id, vector<uint8_t> &out) {
+	unsigned char raw[20];
+	if (!sha1_from_hex(id, raw))
+		return false;
+	lock_guard<mutex> lock(m);
+	size_t i;
+	PackFile *pack = locate(raw, i);
+	return pack && pack->read(i, out);
+}
+
+bool PackStore::objectSize(const string &id, uint64_t &size) {
+	unsigned char raw[20];
+	if (!sha1_from_hex(id, raw))
+		return false;
+	lock_guard<mutex> lock(m);
+	size_t i;
+	PackFile *pack = locate(raw, i);
+	return pack && pack->objectSize(i, size);
+}
+
+vector<string> PackStore::listObjects() {
+	lock_guard<mutex> lock(m);
+	refresh();
+	vector<string> ids;
+	for (const auto &pack : packs) {
+		for (size_t i = 0; i < pack->size(); ++i)
+			ids.push_back(sha1_to_hex(pack->rawSha(i)));
+	}
+	return ids;
+}
+
+void PackStore::close() {
+	lock_guard<mutex> lock(m);
+	packs.clear();
+	scanned = false;
+}
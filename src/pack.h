@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.h"
+#include "mapped_file.h"
+#include "sha256.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * delta基础对象缓存
+ * 按包内偏移缓存还原后的对象内容，总大小超过上限时淘汰最久未使用的条目
+ */
+class DeltaBaseCache {
+public:
+	explicit DeltaBaseCache(size_t limit) : limit(limit) {}
+
+	shared_ptr<const vector<uint8_t>> get(uint64_t offset);
+	void put(uint64_t offset, shared_ptr<const vector<uint8_t>> data);
+	void clear();
+
+private:
+	using Entry = pair<uint64_t, shared_ptr<const vector<uint8_t>>>;
+
+	size_t limit;
+	size_t used = 0;
+	list<Entry> lru; // 表头为最近使用
+	unordered_map<uint64_t, list<Entry>::iterator> index;
+};
+
+/**
+ * 打包对象文件
+ * objects/pack/pack-<sha>.pack：文件头 + 连续的对象条目 + 20字节SHA-1校验和，
+ *   每个条目为条目头 + 数据（LZ4压缩，压缩无收益时原样存放）；
+ *   delta条目在条目头之后先写20字节的基础对象哈希，数据为相对基础对象的差异指令，
+ *   基础对象总是位于同一个包中
+ * objects/pack/pack-<sha>.idx ：文件头 + fanout[256] + 排序的20字节对象哈希 + 对应的u64偏移
+ * 两个文件都通过mmap读取，查找先用fanout缩小范围再二分查找
+ */
+class PackFile {
+public:
+	static constexpr size_t npos = SIZE_MAX;
+
+	// 打开索引文件及对应的包文件
+	bool open(const fs::path &idx_path);
+	void close();
+
+	size_t size() const { return count; }
+	const unsigned char *rawSha(size_t i) const;
+	size_t find(const unsigned char raw[20]) const;
+
+	// 读取第 i 个对象的完整内容（delta条目沿基础对象链还原）
+	// 不是线程安全的，由 PackStore 的锁保护
+	bool read(size_t i, vector<uint8_t> &out);
+
+	// 只解析条目头得到对象大小（delta条目读取差异指令开头记录的结果大小）
+	bool objectSize(size_t i, uint64_t &size) const;
+
+	const fs::path &idxPath() const { return idx_path; }
+	const fs::path &packPath() const { return pack_path; }
+
+private:
+	MappedFile idx;
+	MappedFile pack;
+	fs::path idx_path;
+	fs::path pack_path;
+	size_t count = 0;
+	const uint8_t *fanout = nullptr;
+	const unsigned char *shas = nullptr;
+	const uint8_t *offsets = nullptr;
+	DeltaBaseCache base_cache{32 * 1024 * 1024};
+
+	uint32_t fanoutAt(int b) const;
+	uint64_t offsetAt(size_t i) const;
+	bool readEntry(uint64_t offset, vector<uint8_t> &out, int depth);
+	bool readPayload(uint64_t offset, vector<uint8_t> &payload, bool &is_delta,
+					 const unsigned char *&base_raw) const;
+	shared_ptr<const vector<uint8_t>> readBase(const unsigned char raw[20], int depth);
+};
+
+/**
+ * 顺序写入一个新的包文件
+ * 先写入临时文件，finish() 时写入校验和与索引，再按内容哈希重命名
+ */
+class PackWriter {
+public:
+	PackWriter(const fs::path &pack_dir, uint32_t object_count);
+	~PackWriter();
+
+	void add(const string &id, const vector<uint8_t> &data);
+	// 以 base_id（必须写入同一个包）为基础写入差异指令
+	void addDelta(const string &id, const string &base_id, const vector<uint8_t> &delta);
+
+	// 完成写入并返回包名（pack-<sha>）
+	string finish();
+
+private:
+	fs::path pack_dir;
+	fs::path tmp_path;
+	ofstream out;
+	uint32_t expected;
+	uint64_t offset = 0;
+	vector<pair<string, uint64_t>> entries;
+	bool finished = false;
+
+	SHA1 hasher; // 包内容的校验和
+
+	void write(const void *data, size_t size);
+	void writeEntry(bool is_delta, const unsigned char *base_raw, const vector<uint8_t> &data);
+};
+
+/**
+ * 一个对象目录下所有包文件的集合
+ * 按目录缓存，包目录发生变化（例如repack或clone）时在查找未命中时重新扫描
+ */
+class PackStore {
+public:
+	static shared_ptr<PackStore> forDirectory(const fs::path &objects_dir);
+
+	bool contains(const string &id);
+	bool read(const string &id, vector<uint8_t> &out);
+	bool objectSize(const string &id, uint64_t &size);
+
+	// 列出所有包中的对象哈希
+	vector<string> listObjects();
+
+	// 关闭所有映射（删除包文件之前调用）
+	void close();
+
+	static fs::path packDir(const fs::path &objects_dir) { return objects_dir / "pack"; }
+
+private:
+	explicit PackStore(const fs::path &objects_dir) : objects_dir(objects_dir) {}
+
+	mutex m;
+	fs::path objects_dir;
+	vector<unique_ptr<PackFile>> packs;
+	fs::file_time_type scanned_time{};
+	bool scanned = false;
+
+	// 包目录有变化时重新加载，返回是否重新加载过
+	bool refresh();
+	// 查找对象所在的包及其下标，未命中时重新扫描一次包目录
+	PackFile *locate(const unsigned char raw[20], size_t &index);
+};
@@ -13,17 +13,41 @@
 #else
 #include <arpa/inet.h>
 #include <cerrno>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #endif
 #include <client.h>
 #include <crypto.h>
 
+#ifndef _WIN32
+namespace {
+// 非阻塞socket的发送缓冲区已满时等待可写
+const int SEND_WAIT_MS = 30 * 1000;
+
+bool waitWritable(int socket) {
+	pollfd pfd{};
+	pfd.fd = socket;
+	pfd.events = POLLOUT;
+	int n;
+	do {
+		n = poll(&pfd, 1, SEND_WAIT_MS);
+	} while (n < 0 && errno == EINTR);
+	return n > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+} // namespace
+#endif
+
 // 构造函数
 ProtocolMessage::ProtocolMessage(MessageType type, const vector<uint8_t> &data) {
 	header.type = type;
+	header.checksum = static_cast<uint8_t>(Config::getInstance().checksum);
 	setPayload(data);
 }
 
@@ -66,6 +90,9 @@ bool ProtocolMessage::deserialize(const vector<uint8_t> &data, ProtocolMessage &
 		msg.payload.insert(msg.payload.end(), data.begin() + sizeof(MessageHeader),
 						   data.begin() + sizeof(MessageHeader) + msg.header.payload_size);
 	}
+	if (msg.header.flags & MESSAGE_FLAG_PLAINTEXT) {
+		return true;
+	}
 	Crypto cp;
 	vector<uint8_t> enc_data = cp.decryptAES(msg.payload);
 	msg.header.payload_size = enc_data.size();
@@ -75,11 +102,36 @@ bool ProtocolMessage::deserialize(const vector<uint8_t> &data, ProtocolMessage &
 
 // 验证消息头
 bool ProtocolMessage::validateHeader() const {
-	return header.magic == 0x4D474954 && header.version == PROTOCOL_VERSION;
+	return header.magic == 0x4D474954 && header.version == PROTOCOL_VERSION &&
+		   Checksum::supported(header.checksum);
+}
+
+namespace {
+// 当前线程的明文覆盖：-1 未覆盖，0 加密，1 明文
+thread_local int plaintext_override = -1;
+} // namespace
+
+PlaintextScope::PlaintextScope(bool plaintext) : previous(plaintext_override) {
+	plaintext_override = plaintext ? 1 : 0;
+}
+
+PlaintextScope::~PlaintextScope() {
+	plaintext_override = previous;
+}
+
+bool PlaintextScope::active() {
+	return plaintext_override < 0 ? Config::getInstance().plaintext : plaintext_override == 1;
 }
 
 // 设置负载数据
 void ProtocolMessage::setPayload(const vector<uint8_t> &data) {
+	if (PlaintextScope::active()) {
+		payload = data;
+		header.flags |= MESSAGE_FLAG_PLAINTEXT;
+		header.payload_size = static_cast<uint32_t>(data.size());
+		return;
+	}
+	header.flags &= ~MESSAGE_FLAG_PLAINTEXT;
 	Crypto cp;
 	vector<uint8_t> enc_data = cp.encryptAES(data);
 	payload = enc_data;
@@ -213,7 +265,7 @@ ProtocolMessage ProtocolMessage::createCloneFile(const string &file_path,
 	CloneFilePayload payload;
 	payload.file_path_length = static_cast<uint32_t>(file_path.size());
 	payload.file_size = static_cast<uint64_t>(file_data.size());
-	payload.checksum = calculateCRC32(file_data);
+	payload.checksum = Checksum::compute(Config::getInstance().checksum, file_data);
 	payload.file_type = file_type;
 
 	vector<uint8_t> data;
@@ -236,6 +288,32 @@ ProtocolMessage ProtocolMessage::createCloneDataEnd() {
 	return ProtocolMessage(MessageType::CLONE_DATA_END);
 }
 
+// 创建克隆原始文件分段消息的前缀
+vector<uint8_t> ProtocolMessage::createCloneFileRawPrefix(const string &file_path,
+														  uint64_t file_size, uint64_t offset,
+														  uint32_t chunk_size) {
+	CloneFileRawPayload payload;
+	payload.file_path_length = static_cast<uint32_t>(file_path.size());
+	payload.file_size = file_size;
+	payload.offset = offset;
+	payload.chunk_size = chunk_size;
+
+	MessageHeader header;
+	header.type = MessageType::CLONE_FILE_RAW;
+	header.flags = MESSAGE_FLAG_PLAINTEXT;
+	header.payload_size =
+		static_cast<uint32_t>(sizeof(CloneFileRawPayload) + file_path.size() + chunk_size);
+
+	vector<uint8_t> data(sizeof(MessageHeader) + sizeof(CloneFileRawPayload) + file_path.size());
+	size_t offset_in_data = 0;
+	memcpy(data.data(), &header, sizeof(MessageHeader));
+	offset_in_data += sizeof(MessageHeader);
+	memcpy(data.data() + offset_in_data, &payload, sizeof(CloneFileRawPayload));
+	offset_in_data += sizeof(CloneFileRawPayload);
+	memcpy(data.data() + offset_in_data, file_path.data(), file_path.size());
+	return data;
+}
+
 // 创建推送检查请求消息
 ProtocolMessage ProtocolMessage::createPushCheckRequest(const string &local_head,
 														const string &new_commit_id,
@@ -308,7 +386,7 @@ ProtocolMessage ProtocolMessage::createPushObjectData(const string &object_id,
 	PushObjectDataPayload payload;
 	payload.object_id_length = static_cast<uint32_t>(object_id.size());
 	payload.object_data_length = static_cast<uint32_t>(object_data.size());
-	payload.checksum = calculateCRC32(object_data);
+	payload.checksum = Checksum::compute(Config::getInstance().checksum, object_data);
 
 	vector<uint8_t> data;
 	data.resize(sizeof(PushObjectDataPayload) + object_id.size() + object_data.size());
@@ -325,16 +403,106 @@ ProtocolMessage ProtocolMessage::createPushObjectData(const string &object_id,
 	return ProtocolMessage(MessageType::PUSH_OBJECT_DATA, data);
 }
 
+// 创建对象协商请求消息
+ProtocolMessage ProtocolMessage::createPushHaveRequest(const vector<string> &object_ids) {
+	PushHaveRequestPayload payload;
+	payload.object_count = static_cast<uint32_t>(object_ids.size());
+
+	vector<uint8_t> data(sizeof(PushHaveRequestPayload) + object_ids.size() * 20);
+	memcpy(data.data(), &payload, sizeof(PushHaveRequestPayload));
+	uint8_t *p = data.data() + sizeof(PushHaveRequestPayload);
+	for (const auto &id : object_ids) {
+		sha1_from_hex(id, p);
+		p += 20;
+	}
+	return ProtocolMessage(MessageType::PUSH_HAVE_REQUEST, data);
+}
+
+// 创建对象协商响应消息
+ProtocolMessage ProtocolMessage::createPushHaveResponse(const vector<bool> &missing) {
+	PushHaveResponsePayload payload;
+	payload.object_count = static_cast<uint32_t>(missing.size());
+
+	vector<uint8_t> data(sizeof(PushHaveResponsePayload) + (missing.size() + 7) / 8, 0);
+	memcpy(data.data(), &payload, sizeof(PushHaveResponsePayload));
+	uint8_t *bits = data.data() + sizeof(PushHaveResponsePayload);
+	for (size_t i = 0; i < missing.size(); ++i) {
+		if (missing[i])
+			bits[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+	}
+	return ProtocolMessage(MessageType::PUSH_HAVE_RESPONSE, data);
+}
+
+// 创建浅克隆请求消息
+ProtocolMessage ProtocolMessage::createShallowCloneRequest(const string &repo_name,
+														   uint32_t depth) {
+	ShallowCloneRequestPayload payload;
+	payload.depth = depth;
+	payload.repo_name_length = static_cast<uint32_t>(repo_name.size());
+
+	vector<uint8_t> data(sizeof(ShallowCloneRequestPayload) + repo_name.size());
+	memcpy(data.data(), &payload, sizeof(ShallowCloneRequestPayload));
+	memcpy(data.data() + sizeof(ShallowCloneRequestPayload), repo_name.data(), repo_name.size());
+	return ProtocolMessage(MessageType::SHALLOW_CLONE_REQUEST, data);
+}
+
+// 创建加深请求消息
+ProtocolMessage ProtocolMessage::createDeepenRequest(uint32_t depth,
+													 const vector<string> &boundaries) {
+	DeepenRequestPayload payload;
+	payload.depth = depth;
+	payload.boundary_count = static_cast<uint32_t>(boundaries.size());
+
+	vector<uint8_t> data(sizeof(DeepenRequestPayload) + boundaries.size() * 20);
+	memcpy(data.data(), &payload, sizeof(DeepenRequestPayload));
+	uint8_t *p = data.data() + sizeof(DeepenRequestPayload);
+	for (const auto &id : boundaries) {
+		sha1_from_hex(id, p);
+		p += 20;
+	}
+	return ProtocolMessage(MessageType::DEEPEN_REQUEST, data);
+}
+
+// 创建加深响应消息
+ProtocolMessage ProtocolMessage::createDeepenResponse(uint32_t commits_count,
+													  const vector<string> &boundaries) {
+	DeepenResponsePayload payload;
+	payload.commits_count = commits_count;
+	payload.boundary_count = static_cast<uint32_t>(boundaries.size());
+
+	vector<uint8_t> data(sizeof(DeepenResponsePayload) + boundaries.size() * 20);
+	memcpy(data.data(), &payload, sizeof(DeepenResponsePayload));
+	uint8_t *p = data.data() + sizeof(DeepenResponsePayload);
+	for (const auto &id : boundaries) {
+		sha1_from_hex(id, p);
+		p += 20;
+	}
+	return ProtocolMessage(MessageType::DEEPEN_RESPONSE, data);
+}
+
+// 创建压缩方式协商消息
+ProtocolMessage ProtocolMessage::createCompressionMessage(MessageType type, uint8_t codec,
+														  int32_t level) {
+	CompressionPayload payload;
+	payload.codec = codec;
+	payload.level = level;
+
+	vector<uint8_t> data(sizeof(CompressionPayload));
+	memcpy(data.data(), &payload, sizeof(CompressionPayload));
+	return ProtocolMessage(type, data);
+}
+
 // 创建推送压缩对象数据消息
 ProtocolMessage
 ProtocolMessage::createPushObjectDataCompressed(MessageType type, uint32_t operation_type,
 												const vector<uint8_t> &compressed_data,
-												uint64_t original_size, uint32_t file_count) {
+												uint64_t original_size, uint32_t file_count,
+												ChecksumType checksum) {
 	PushObjectDataPayloadCompressed payload;
 	payload.operation_type = operation_type;
 	payload.original_size = original_size;
 	payload.compressed_size = static_cast<uint64_t>(compressed_data.size());
-	payload.checksum = calculateCRC32(compressed_data); // 对压缩数据计算校验和
+	payload.checksum = Checksum::compute(checksum, compressed_data); // 对压缩数据计算校验和
 	payload.file_count = file_count;
 
 	// 组装完整数据
@@ -348,7 +516,9 @@ ProtocolMessage::createPushObjectDataCompressed(MessageType type, uint32_t opera
 	memcpy(data.data() + sizeof(PushObjectDataPayloadCompressed), compressed_data.data(),
 		   compressed_data.size());
 
-	return ProtocolMessage(type, data);
+	ProtocolMessage msg(type, data);
+	msg.header.checksum = static_cast<uint8_t>(checksum);
+	return msg;
 }
 
 // 创建推送请求处理 更新远程HEAD
@@ -366,7 +536,8 @@ ProtocolMessage ProtocolMessage::createPushRequest(const string &remote_head) {
 }
 
 // 创建拉取检查请求消息
-ProtocolMessage ProtocolMessage::createPullCheckRequest(const string &local_head) {
+ProtocolMessage ProtocolMessage::createPullCheckRequest(const string &local_head,
+														const vector<string> &boundaries) {
 	PullCheckRequestPayload payload;
 	payload.local_head_length = static_cast<uint32_t>(local_head.size());
 
@@ -376,6 +547,18 @@ ProtocolMessage ProtocolMessage::createPullCheckRequest(const string &local_head
 	memcpy(data.data(), &payload, sizeof(PullCheckRequestPayload));
 	memcpy(data.data() + sizeof(PullCheckRequestPayload), local_head.c_str(), local_head.size());
 
+	if (!boundaries.empty()) {
+		uint32_t boundary_count = static_cast<uint32_t>(boundaries.size());
+		size_t offset = data.size();
+		data.resize(offset + sizeof(boundary_count) + boundaries.size() * 20);
+		memcpy(data.data() + offset, &boundary_count, sizeof(boundary_count));
+		uint8_t *p = data.data() + offset + sizeof(boundary_count);
+		for (const auto &id : boundaries) {
+			sha1_from_hex(id, p);
+			p += 20;
+		}
+	}
+
 	return ProtocolMessage(MessageType::PULL_CHECK_REQUEST, data);
 }
 
@@ -424,7 +607,7 @@ ProtocolMessage ProtocolMessage::createPullObjectData(const string &object_id,
 	PullObjectDataPayload payload;
 	payload.object_id_length = static_cast<uint32_t>(object_id.size());
 	payload.object_data_length = static_cast<uint32_t>(object_data.size());
-	payload.checksum = calculateCRC32(object_data);
+	payload.checksum = Checksum::compute(Config::getInstance().checksum, object_data);
 
 	vector<uint8_t> data;
 	data.resize(sizeof(PullObjectDataPayload) + object_id.size() + object_data.size());
@@ -445,12 +628,13 @@ ProtocolMessage ProtocolMessage::createPullObjectData(const string &object_id,
 ProtocolMessage
 ProtocolMessage::createPullObjectDataCompressed(uint32_t operation_type,
 												const vector<uint8_t> &compressed_data,
-												uint64_t original_size, uint32_t file_count) {
+												uint64_t original_size, uint32_t file_count,
+												ChecksumType checksum) {
 	PullObjectDataPayloadCompressed payload;
 	payload.operation_type = operation_type;
 	payload.original_size = original_size;
 	payload.compressed_size = static_cast<uint64_t>(compressed_data.size());
-	payload.checksum = calculateCRC32(compressed_data);
+	payload.checksum = Checksum::compute(checksum, compressed_data);
 	payload.file_count = file_count;
 
 	// 组装完整数据
@@ -464,19 +648,22 @@ ProtocolMessage::createPullObjectDataCompressed(uint32_t operation_type,
 	memcpy(data.data() + sizeof(PullObjectDataPayloadCompressed), compressed_data.data(),
 		   compressed_data.size());
 
-	return ProtocolMessage(MessageType::PULL_OBJECT_DATA_COMPRESSED, data);
+	ProtocolMessage msg(MessageType::PULL_OBJECT_DATA_COMPRESSED, data);
+	msg.header.checksum = static_cast<uint8_t>(checksum);
+	return msg;
 }
 
 // 创建克隆压缩数据消息
 ProtocolMessage ProtocolMessage::createCloneDataCompressed(uint32_t operation_type,
 														   const vector<uint8_t> &compressed_data,
 														   uint64_t original_size,
-														   uint32_t file_count) {
+														   uint32_t file_count,
+														   ChecksumType checksum) {
 	CloneDataCompressedPayload payload;
 	payload.operation_type = operation_type;
 	payload.original_size = original_size;
 	payload.compressed_size = static_cast<uint64_t>(compressed_data.size());
-	payload.checksum = calculateCRC32(compressed_data);
+	payload.checksum = Checksum::compute(checksum, compressed_data);
 	payload.file_count = file_count;
 
 	// 组装完整数据
@@ -490,7 +677,9 @@ ProtocolMessage ProtocolMessage::createCloneDataCompressed(uint32_t operation_ty
 	memcpy(data.data() + sizeof(CloneDataCompressedPayload), compressed_data.data(),
 		   compressed_data.size());
 
-	return ProtocolMessage(MessageType::CLONE_DATA_COMPRESSED, data);
+	ProtocolMessage msg(MessageType::CLONE_DATA_COMPRESSED, data);
+	msg.header.checksum = static_cast<uint8_t>(checksum);
+	return msg;
 }
 
 // 创建日志请求消息
@@ -546,22 +735,9 @@ ProtocolMessage ProtocolMessage::createLogResponse(const vector<pair<string, str
 	return ProtocolMessage(MessageType::LOG_RESPONSE, data);
 }
 
-// CRC32计算（简单实现）
-uint32_t ProtocolMessage::calculateCRC32(const vector<uint8_t> &data) {
-	uint32_t crc = 0xFFFFFFFF;
-
-	for (uint8_t byte : data) {
-		crc ^= byte;
-		for (int i = 0; i < 8; i++) {
-			if (crc & 1) {
-				crc = (crc >> 1) ^ 0xEDB88320;
-			} else {
-				crc >>= 1;
-			}
-		}
-	}
-
-	return ~crc;
+// 按消息头中的算法计算校验和
+uint32_t ProtocolMessage::checksumOf(const vector<uint8_t> &data) const {
+	return Checksum::compute(static_cast<ChecksumType>(header.checksum), data);
 }
 
 // NetworkUtils实现
@@ -634,8 +810,11 @@ bool NetworkUtils::sendData(int socket, const void *data, size_t size,
 #else
 		ssize_t sent = send(socket, ptr, chunk_size, MSG_NOSIGNAL);
 		if (sent < 0) {
-			if ((errno == EAGAIN || errno == EWOULDBLOCK) && retry_count < MAX_RETRY_COUNT) {
-				usleep(10000);
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && retry_count < MAX_RETRY_COUNT &&
+				waitWritable(socket)) {
 				retry_count++;
 				continue;
 			}
@@ -655,6 +834,58 @@ bool NetworkUtils::sendData(int socket, const void *data, size_t size,
 	return true;
 }
 
+// 直接从磁盘发送文件内容
+bool NetworkUtils::sendFile(int socket, const fs::path &file, uint64_t offset, uint64_t size) {
+#ifdef __linux__
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	off_t pos = static_cast<off_t>(offset);
+	uint64_t remaining = size;
+	int retry_count = 0;
+	while (remaining > 0) {
+		size_t chunk_size = static_cast<size_t>(min<uint64_t>(remaining, RAW_CHUNK_SIZE));
+		ssize_t sent = sendfile(socket, fd, &pos, chunk_size);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && retry_count < MAX_RETRY_COUNT &&
+				waitWritable(socket)) {
+				retry_count++;
+				continue;
+			}
+			close(fd);
+			return false;
+		}
+		if (sent == 0) {
+			break; // 文件被截断
+		}
+		remaining -= static_cast<uint64_t>(sent);
+		retry_count = 0;
+	}
+	close(fd);
+	return remaining == 0;
+#else
+	// 其他平台没有 sendfile，分段读取后发送
+	ifstream in(file, ios::binary);
+	if (!in.is_open() || !in.seekg(static_cast<streamoff>(offset))) {
+		return false;
+	}
+	vector<char> buffer(CHUNK_SIZE);
+	uint64_t remaining = size;
+	while (remaining > 0) {
+		size_t n = static_cast<size_t>(min<uint64_t>(remaining, buffer.size()));
+		if (!in.read(buffer.data(), n) || !sendData(socket, buffer.data(), n)) {
+			return false;
+		}
+		remaining -= n;
+	}
+	return true;
+#endif
+}
+
 // 接收原始数据
 bool NetworkUtils::receiveData(int socket, void *buffer, size_t size,
 							   const receiveMessageProgressCallback &progress_callback) {
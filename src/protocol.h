@@ -1,5 +1,6 @@
 #pragma once
 
+#include "checksum.h"
 #include "common.h"
 
 /**
@@ -40,6 +41,10 @@ enum class MessageType : uint8_t {
 	PUSH_COMMIT_DATA = 0x38, // 推送提交数据
 	PUSH_OBJECT_DATA = 0x39, // 推送对象数据
 	PUSH_OBJECT_DATA_COMPRESSED = 0x45, // 推送压缩数据 包含一个commit的全部obj
+	PUSH_HAVE_REQUEST = 0x47, // 推送前询问服务器已有哪些对象
+	PUSH_HAVE_RESPONSE = 0x48, // 返回服务器缺少的对象位图
+	COMPRESSION_REQUEST = 0x49, // 协商本会话传输归档使用的压缩方式
+	COMPRESSION_RESPONSE = 0x4A, // 返回服务器采用的压缩方式
 	PULL_REQUEST = 0x32, // 拉取请求
 	PULL_RESPONSE = 0x33, // 拉取响应
 	PULL_CHECK_REQUEST = 0x3A, // 拉取检查请求（获取远程HEAD）
@@ -59,6 +64,10 @@ enum class MessageType : uint8_t {
 	CLONE_DATA_END = 0x43, // 克隆数据结束
 	CLONE_FILE = 0x44, // 克隆文件
 	CLONE_DATA_COMPRESSED = 0x46, // 克隆压缩数据
+	CLONE_FILE_RAW = 0x4B, // 克隆文件的一段原始数据（明文模式下直接从磁盘发送）
+	SHALLOW_CLONE_REQUEST = 0x4C, // 浅克隆请求（只传输最近若干个提交），响应与克隆相同
+	DEEPEN_REQUEST = 0x4D, // 加深浅克隆的历史
+	DEEPEN_RESPONSE = 0x4E, // 加深完成，返回新的浅克隆边界
 
 	// 控制消息
 	HEARTBEAT = 0x60, // 心跳
@@ -87,16 +96,21 @@ struct MessageHeader {
 	uint32_t magic; // 魔法数字 0x4D474954 ("MGIT")
 	uint32_t version; // 协议版本
 	MessageType type; // 消息类型
-	uint8_t flags; // 标志位（保留）
-	uint16_t reserved; // 保留字段
+	uint8_t flags; // 标志位
+	uint8_t checksum; // 负载中校验和使用的算法（ChecksumType），旧版本为0
+	uint8_t reserved; // 保留字段
 	uint32_t payload_size; // 负载大小
 
 	MessageHeader() : magic(0x4D474954), version(PROTOCOL_VERSION),
-	                  type(MessageType::NONE), flags(0), reserved(0), payload_size(0) {
+	                  type(MessageType::NONE), flags(0), checksum(0), reserved(0),
+	                  payload_size(0) {
 	}
 };
 #pragma pack(pop)
 
+// 消息头标志位
+const uint8_t MESSAGE_FLAG_PLAINTEXT = 0x01; // 负载未加密
+
 // 认证请求负载
 #pragma pack(push, 1)
 struct AuthRequestPayload {
@@ -154,6 +168,22 @@ struct CloneFilePayload {
 };
 #pragma pack(pop)
 
+// 克隆原始文件分段负载（仅明文模式，数据不经过加密和压缩，可以直接从磁盘发送）
+#pragma pack(push, 1)
+struct CloneFileRawPayload {
+	uint32_t file_path_length; // 文件路径长度
+	uint64_t file_size; // 文件总大小
+	uint64_t offset; // 本段在文件中的偏移
+	uint32_t chunk_size; // 本段数据长度
+	// 接下来是文件路径，然后是 chunk_size 字节文件数据
+};
+#pragma pack(pop)
+
+// 压缩数据负载的 operation_type
+const uint32_t ARCHIVE_WHOLE = 0; // 整个归档在一条消息中（旧格式）
+const uint32_t ARCHIVE_STREAM_CHUNK = 1; // 流式归档的一段，file_count 为预计文件数
+const uint32_t ARCHIVE_STREAM_END = 2; // 流式归档结束，不带数据，original_size 为归档原始大小
+
 // 克隆压缩数据负载
 #pragma pack(push, 1)
 struct CloneDataCompressedPayload {
@@ -233,11 +263,63 @@ struct PushObjectDataPayloadCompressed {
 };
 #pragma pack(pop)
 
+// 对象协商请求负载（客户端分批发送候选对象）
+#pragma pack(push, 1)
+struct PushHaveRequestPayload {
+	uint32_t object_count; // 对象数量
+	// 接下来是 object_count 个20字节对象哈希
+};
+#pragma pack(pop)
+
+// 对象协商响应负载
+#pragma pack(push, 1)
+struct PushHaveResponsePayload {
+	uint32_t object_count; // 与请求中的对象数量相同
+	// 接下来是 (object_count + 7) / 8 字节位图，第i位为1表示服务器缺少请求中的第i个对象
+};
+#pragma pack(pop)
+
+// 压缩方式协商负载（请求和响应相同）
+#pragma pack(push, 1)
+struct CompressionPayload {
+	uint8_t codec; // 0=不压缩，1=LZ4，2=LZ4HC
+	int32_t level; // LZ4 为加速倍数，LZ4HC 为压缩级别
+};
+#pragma pack(pop)
+
+// 浅克隆请求负载
+#pragma pack(push, 1)
+struct ShallowCloneRequestPayload {
+	uint32_t depth; // 从HEAD开始传输的提交数
+	uint32_t repo_name_length; // 仓库名长度
+	// 接下来是仓库名
+};
+#pragma pack(pop)
+
+// 加深请求负载（客户端发送本地的浅克隆边界）
+#pragma pack(push, 1)
+struct DeepenRequestPayload {
+	uint32_t depth; // 每个边界之前再传输的提交数
+	uint32_t boundary_count; // 边界提交数量
+	// 接下来是 boundary_count 个20字节提交哈希
+};
+#pragma pack(pop)
+
+// 加深响应负载
+#pragma pack(push, 1)
+struct DeepenResponsePayload {
+	uint32_t commits_count; // 本次传输的提交数量
+	uint32_t boundary_count; // 新的边界提交数量，0表示历史已经完整
+	// 接下来是 boundary_count 个20字节提交哈希
+};
+#pragma pack(pop)
+
 // 拉取检查请求负载（客户端发送本地HEAD）
 #pragma pack(push, 1)
 struct PullCheckRequestPayload {
 	uint32_t local_head_length; // 本地HEAD提交ID长度
 	// 接下来是本地HEAD提交ID字符串
+	// 浅克隆还会附带 uint32_t 边界数量和对应个数的20字节提交哈希，旧服务器忽略这部分
 };
 #pragma pack(pop)
 
@@ -333,6 +415,9 @@ public:
 	// 获取负载数据
 	string getStringPayload() const;
 
+	// 按消息头中的算法计算数据的校验和，用于验证负载中的校验和字段
+	uint32_t checksumOf(const vector<uint8_t> &data) const;
+
 	// 创建特定类型的消息
 	static ProtocolMessage createAuthRequest(bool use_rsa, const vector<uint8_t> &auth_data);
 	static ProtocolMessage createAuthResponse(StatusCode status, const string &session_id,
@@ -345,6 +430,9 @@ public:
 	static ProtocolMessage createCloneFile(const string &file_path,
 	                                       const vector<uint8_t> &file_data, uint8_t file_type);
 	static ProtocolMessage createCloneDataEnd();
+	// 原始文件分段消息中数据之前的部分（消息头 + 负载头 + 路径），数据由调用方直接发送
+	static vector<uint8_t> createCloneFileRawPrefix(const string &file_path, uint64_t file_size,
+	                                                uint64_t offset, uint32_t chunk_size);
 
 	// 新增：智能push相关消息
 	static ProtocolMessage createPushCheckRequest(const string &local_head,
@@ -357,14 +445,25 @@ public:
 	static ProtocolMessage createPushObjectData(const string &object_id,
 	                                            const vector<uint8_t> &object_data);
 
+	static ProtocolMessage createPushHaveRequest(const vector<string> &object_ids);
+	static ProtocolMessage createPushHaveResponse(const vector<bool> &missing);
+	static ProtocolMessage createCompressionMessage(MessageType type, uint8_t codec, int32_t level);
+
 	static ProtocolMessage createPushObjectDataCompressed(MessageType type,
 	                                                      uint32_t operation_type,
 	                                                      const vector<uint8_t> &compressed_data,
 	                                                      uint64_t original_size,
-	                                                      uint32_t file_count);
+	                                                      uint32_t file_count,
+	                                                      ChecksumType checksum);
+
+	static ProtocolMessage createShallowCloneRequest(const string &repo_name, uint32_t depth);
+	static ProtocolMessage createDeepenRequest(uint32_t depth, const vector<string> &boundaries);
+	static ProtocolMessage createDeepenResponse(uint32_t commits_count,
+	                                            const vector<string> &boundaries);
 
 	// 新增：智能pull相关消息
-	static ProtocolMessage createPullCheckRequest(const string &local_head);
+	static ProtocolMessage createPullCheckRequest(const string &local_head,
+												  const vector<string> &boundaries = {});
 	static ProtocolMessage createPullCheckResponse(const string &remote_head, bool has_updates,
 	                                               uint32_t commits_count);
 	static ProtocolMessage createPullCommitData(const string &commit_id,
@@ -374,19 +473,18 @@ public:
 	static ProtocolMessage createPullObjectDataCompressed(uint32_t operation_type,
 	                                                      const vector<uint8_t> &compressed_data,
 	                                                      uint64_t original_size,
-	                                                      uint32_t file_count);
+	                                                      uint32_t file_count,
+	                                                      ChecksumType checksum);
 
 	// 新增：clone压缩相关消息
 	static ProtocolMessage createCloneDataCompressed(uint32_t operation_type,
 	                                                 const vector<uint8_t> &compressed_data,
-	                                                 uint64_t original_size, uint32_t file_count);
+	                                                 uint64_t original_size, uint32_t file_count,
+	                                                 ChecksumType checksum);
 
 	// 新增：日志相关消息
 	static ProtocolMessage createLogRequest(int max_count, bool line);
 	static ProtocolMessage createLogResponse(const vector<pair<string, string>> &commits);
-
-	// 工具方法
-	static uint32_t calculateCRC32(const vector<uint8_t> &data);
 };
 
 #include <functional>
@@ -408,6 +506,12 @@ public:
 	// 发送原始数据
 	static bool sendData(int socket, const void* data, size_t size, const sendMessageProgressCallback& progress_callback = nullptr);
 
+	// 把文件的 [offset, offset + size) 直接发送到socket，Linux 上使用 sendfile 避免复制到用户态
+	static bool sendFile(int socket, const fs::path &file, uint64_t offset, uint64_t size);
+
+	// 原始文件每条消息携带的数据量
+	static const uint32_t RAW_CHUNK_SIZE = 8 * 1024 * 1024;
+
 	// 接收原始数据
 	static bool receiveData(int socket, void* buffer, size_t size, const receiveMessageProgressCallback& progress_callback = nullptr);
 
@@ -446,6 +550,31 @@ public:
 	string root_path;
 	string public_key;
 	string private_key;
+	bool plaintext = false; // 命令行：以明文发送负载并接受明文回应（部署在TLS终结代理之后时使用）
+	bool allow_plaintext = false; // 服务器：允许客户端在连接时协商明文会话
+	string compression; // 传输压缩方式（none、lz4[:加速倍数]、lz4hc[:级别]），为空时使用默认
+	ChecksumType checksum = ChecksumType::Crc32; // 客户端使用的校验和算法，服务器按请求头回应
+	int workers = 0; // 服务器处理请求的工作线程数，0为自动
+	int clone_cache_mb = 256; // 服务器克隆包缓存上限（MB），0为不缓存
+	int depth = 0; // 浅克隆（clone --depth）或加深（pull --deepen）的提交数，0为完整历史
 	int port = 8080;
 	bool use_ssl = false;
+};
+
+/**
+ * 当前线程创建的消息是否使用明文负载
+ * 默认取 Config::plaintext；服务器处理一条消息期间按该会话协商的结果覆盖，
+ * 同一进程中加密和明文的会话互不影响
+ */
+class PlaintextScope {
+public:
+	explicit PlaintextScope(bool plaintext);
+	~PlaintextScope();
+	PlaintextScope(const PlaintextScope &) = delete;
+	PlaintextScope &operator=(const PlaintextScope &) = delete;
+
+	static bool active();
+
+private:
+	int previous;
 };
\ No newline at end of file
@@ -0,0 +1,443 @@
+#include "reachability.h"
+#include "commit.h"
+#include "commit_graph.h"
+#include "mapped_file.h"
+#include "pack.h"
+#include "sha256.h"
+#include <bitset>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+const char BITMAP_MAGIC[4] = {'M', 'G', 'B', 'M'};
+const uint8_t BITMAP_VERSION = 1;
+// 每隔多少个提交保存一个位图
+constexpr size_t BITMAP_INTERVAL = 16;
+// 没有位图的连续提交超过此数时重新生成位图文件
+constexpr size_t MAX_GAP = 4 * BITMAP_INTERVAL;
+
+constexpr uint64_t RUN_BIT = 1ull << 63;
+constexpr int RUN_SHIFT = 30;
+constexpr uint64_t LITERAL_MASK = (1ull << RUN_SHIFT) - 1;
+constexpr uint64_t RUN_MASK = (1ull << 33) - 1;
+
+#pragma pack(push, 1)
+struct BitmapHeader {
+	char magic[4];
+	uint8_t version;
+	uint8_t reserved[3];
+	uint32_t object_count;
+	uint32_t bitmap_count;
+};
+#pragma pack(pop)
+
+// 生成和替换位图文件时串行化
+mutex build_mutex;
+
+uint32_t readU32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+void appendU32(string &s, uint32_t v) {
+	s.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+/**
+ * 映射后的位图文件
+ */
+struct LoadedIndex {
+	MappedFile file;
+	uint32_t object_count = 0;
+	const unsigned char *table = nullptr;
+	const uint8_t *fanout = nullptr;
+	const uint8_t *sorted = nullptr;
+	unordered_map<string, pair<const uint8_t *, uint32_t>> bitmaps; // 提交哈希 -> 压缩位图
+
+	bool open(const fs::path &path) {
+		close();
+		if (!file.open(path) || file.size() < sizeof(BitmapHeader))
+			return false;
+		BitmapHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+		if (memcmp(header.magic, BITMAP_MAGIC, 4) != 0 || header.version != BITMAP_VERSION)
+			return false;
+
+		const uint8_t *p = file.data() + sizeof(header);
+		const uint8_t *end = file.data() + file.size();
+		uint64_t fixed = (uint64_t)header.object_count * (20 + 4) + 256 * 4;
+		if ((uint64_t)(end - p) < fixed)
+			return false;
+		object_count = header.object_count;
+		table = p;
+		fanout = table + (size_t)object_count * 20;
+		sorted = fanout + 256 * 4;
+		p = sorted + (size_t)object_count * 4;
+
+		// 文件截断或损坏时 fanout、位号和位图可能越界，发现后放弃位图，调用方退回逐个提交计算
+		uint32_t previous = 0;
+		for (size_t i = 0; i < 256; ++i) {
+			uint32_t bound = readU32(fanout + i * 4);
+			if (bound < previous || bound > object_count)
+				return fail();
+			previous = bound;
+		}
+		if (previous != object_count)
+			return fail();
+		for (uint32_t i = 0; i < object_count; ++i) {
+			if (readU32(sorted + (size_t)i * 4) >= object_count)
+				return fail();
+		}
+
+		uint64_t max_words = ((uint64_t)object_count + 63) / 64;
+		for (uint32_t i = 0; i < header.bitmap_count; ++i) {
+			if (end - p < 24)
+				return fail();
+			uint32_t len = readU32(p + 20);
+			if ((uint64_t)(end - p - 24) < len)
+				return fail();
+			// 位图开头是字数，超过对象表能容纳的字数说明位号越界
+			if (len < 4 || readU32(p + 24) > max_words)
+				return fail();
+			bitmaps[sha1_to_hex(p)] = {p + 24, len};
+			p += 24 + len;
+		}
+		return true;
+	}
+
+	bool fail() {
+		close();
+		return false;
+	}
+
+	void close() {
+		file.close();
+		object_count = 0;
+		table = nullptr;
+		bitmaps.clear();
+	}
+
+	string idAt(uint32_t pos) const { return sha1_to_hex(table + (size_t)pos * 20); }
+
+	// 先用fanout缩小范围，再在排序的位号中二分查找
+	bool find(const string &id, uint32_t &pos) const {
+		unsigned char raw[20];
+		if (!table || !sha1_from_hex(id, raw))
+			return false;
+		uint32_t lo = raw[0] == 0 ? 0 : readU32(fanout + (raw[0] - 1) * 4);
+		uint32_t hi = readU32(fanout + raw[0] * 4);
+		while (lo < hi) {
+			uint32_t mid = lo + (hi - lo) / 2;
+			uint32_t candidate = readU32(sorted + (size_t)mid * 4);
+			int c = memcmp(table + (size_t)candidate * 20, raw, 20);
+			if (c == 0) {
+				pos = candidate;
+				return true;
+			}
+			if (c < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return false;
+	}
+
+	bool bitmapOf(const string &commit, Bitmap &bits) const {
+		auto it = bitmaps.find(commit);
+		return it != bitmaps.end() &&
+			   bits.decode(it->second.first, it->second.second, object_count);
+	}
+};
+
+/**
+ * 计算提交可达的对象：最近的带位图祖先的位图，加上中间提交新增的对象；
+ * 不在对象表中的新对象放入 extra。中间提交过多（位图过旧）时返回false
+ */
+bool collectReachable(const LoadedIndex &index, const fs::path &objects_dir, const string &commit,
+					  Bitmap &bits, set<string> &extra) {
+	bits = Bitmap();
+	extra.clear();
+	auto ids = CommitGraph::forDirectory(objects_dir)->history(commit, "", MAX_GAP + 1);
+	size_t gap = 0;
+	while (gap < ids.size() && !index.bitmapOf(ids[gap], bits))
+		++gap;
+	if (gap == ids.size() && ids.size() > MAX_GAP)
+		return false;
+
+	auto add = [&](const string &id) {
+		uint32_t pos;
+		if (index.find(id, pos))
+			bits.set(pos);
+		else
+			extra.insert(id);
+	};
+	for (size_t i = gap; i-- > 0;) {
+		add(ids[i]);
+		for (const auto &id : CommitManager::objectsIntroduced(objects_dir, ids[i]))
+			add(id);
+	}
+	return true;
+}
+} // namespace
+
+void Bitmap::set(size_t i) {
+	if (i / 64 >= words.size())
+		words.resize(i / 64 + 1, 0);
+	words[i / 64] |= 1ull << (i % 64);
+}
+
+bool Bitmap::test(size_t i) const {
+	return i / 64 < words.size() && (words[i / 64] >> (i % 64)) & 1;
+}
+
+void Bitmap::orWith(const Bitmap &other) {
+	if (other.words.size() > words.size())
+		words.resize(other.words.size(), 0);
+	for (size_t i = 0; i < other.words.size(); ++i)
+		words[i] |= other.words[i];
+}
+
+void Bitmap::andNot(const Bitmap &other) {
+	size_t n = min(words.size(), other.words.size());
+	for (size_t i = 0; i < n; ++i)
+		words[i] &= ~other.words[i];
+}
+
+size_t Bitmap::count() const {
+	size_t n = 0;
+	for (uint64_t w : words)
+		n += bitset<64>(w).count();
+	return n;
+}
+
+void Bitmap::forEach(const function<void(size_t)> &fn) const {
+	for (size_t i = 0; i < words.size(); ++i) {
+		uint64_t w = words[i];
+		for (size_t bit = 0; w != 0; ++bit, w >>= 1) {
+			if (w & 1)
+				fn(i * 64 + bit);
+		}
+	}
+}
+
+void Bitmap::encode(string &out) const {
+	appendU32(out, static_cast<uint32_t>(words.size()));
+	size_t i = 0;
+	while (i < words.size()) {
+		// 连续的全0或全1字
+		uint64_t run_value = words[i] == ~0ull ? ~0ull : 0;
+		size_t run = 0;
+		while (i + run < words.size() && words[i + run] == run_value && run < RUN_MASK)
+			++run;
+		size_t literal_start = i + run;
+		size_t literal = 0;
+		while (literal_start + literal < words.size() && literal < LITERAL_MASK) {
+			uint64_t w = words[literal_start + literal];
+			if (w == 0 || w == ~0ull)
+				break;
+			++literal;
+		}
+
+		uint64_t marker = (run_value ? RUN_BIT : 0) | ((uint64_t)run << RUN_SHIFT) | literal;
+		out.append(reinterpret_cast<const char *>(&marker), sizeof(marker));
+		out.append(reinterpret_cast<const char *>(words.data() + literal_start),
+				   literal * sizeof(uint64_t));
+		i = literal_start + literal;
+	}
+}
+
+bool Bitmap::decode(const uint8_t *data, size_t size, size_t max_bits) {
+	words.clear();
+	if (size < 4)
+		return false;
+	uint32_t total = readU32(data);
+	if (max_bits != SIZE_MAX && total > (max_bits + 63) / 64)
+		return false;
+	const uint8_t *p = data + 4;
+	const uint8_t *end = data + size;
+	words.reserve(total);
+	while (words.size() < total) {
+		uint64_t marker;
+		if (end - p < (ptrdiff_t)sizeof(marker))
+			return false;
+		memcpy(&marker, p, sizeof(marker));
+		p += sizeof(marker);
+		uint64_t run = (marker >> RUN_SHIFT) & RUN_MASK;
+		uint64_t literal = marker & LITERAL_MASK;
+		if (run + literal == 0 || run + literal > total - words.size() ||
+			(uint64_t)(end - p) < literal * sizeof(uint64_t))
+			return false;
+		words.insert(words.end(), run, (marker & RUN_BIT) ? ~0ull : 0);
+		for (uint64_t k = 0; k < literal; ++k) {
+			uint64_t w;
+			memcpy(&w, p, sizeof(w));
+			p += sizeof(w);
+			words.push_back(w);
+		}
+	}
+	// 最后一个字中超出 max_bits 的位必须为0
+	if (max_bits != SIZE_MAX && words.size() * 64 > max_bits &&
+		(words.back() >> (max_bits % 64)) != 0)
+		return false;
+	return true;
+}
+
+fs::path ReachabilityIndex::indexPath(const fs::path &objects_dir) {
+	return PackStore::packDir(objects_dir) / "reachability.bitmap";
+}
+
+bool ReachabilityIndex::update(const fs::path &objects_dir, const string &head) {
+	if (head.empty())
+		return false;
+	lock_guard<mutex> lock(build_mutex);
+	fs::path path = indexPath(objects_dir);
+	LoadedIndex old;
+	bool has_old = old.open(path);
+
+	// 由新到旧，找到已有位图覆盖的最近祖先
+	auto ids = CommitGraph::forDirectory(objects_dir)->history(head);
+	size_t base = ids.size();
+	Bitmap bits;
+	if (has_old) {
+		for (size_t i = 0; i < ids.size(); ++i) {
+			if (old.bitmapOf(ids[i], bits)) {
+				base = i;
+				break;
+			}
+		}
+	}
+	if (base == 0)
+		return false; // 已经是最新的
+
+	vector<string> objects;
+	unordered_map<string, uint32_t> positions;
+	vector<pair<string, string>> bitmaps; // 提交哈希 -> 压缩位图
+	if (base < ids.size()) {
+		// 沿用已有的编号和位图，只追加新的对象
+		objects.reserve(old.object_count);
+		for (uint32_t pos = 0; pos < old.object_count; ++pos) {
+			objects.push_back(old.idAt(pos));
+			positions.emplace(objects.back(), pos);
+		}
+		for (const auto &kv : old.bitmaps)
+			bitmaps.emplace_back(kv.first, string(reinterpret_cast<const char *>(kv.second.first),
+												  kv.second.second));
+	} else {
+		bits = Bitmap();
+	}
+	old.close();
+
+	auto add = [&](const string &id) {
+		auto inserted = positions.emplace(id, static_cast<uint32_t>(objects.size()));
+		if (inserted.second)
+			objects.push_back(id);
+		bits.set(inserted.first->second);
+	};
+	// 由旧到新累积可达对象，每隔 BITMAP_INTERVAL 个提交以及 head 保存一个位图
+	for (size_t i = base, done = 1; i-- > 0; ++done) {
+		add(ids[i]);
+		for (const auto &id : CommitManager::objectsIntroduced(objects_dir, ids[i]))
+			add(id);
+		if (done % BITMAP_INTERVAL == 0 || i == 0) {
+			string encoded;
+			bits.encode(encoded);
+			bitmaps.emplace_back(ids[i], std::move(encoded));
+		}
+	}
+
+	// 对象表 + fanout + 按哈希排序的位号
+	string table;
+	table.reserve(objects.size() * 20);
+	unsigned char raw[20];
+	for (const auto &id : objects) {
+		sha1_from_hex(id, raw);
+		table.append(reinterpret_cast<const char *>(raw), 20);
+	}
+	vector<uint32_t> sorted(objects.size());
+	for (uint32_t i = 0; i < sorted.size(); ++i)
+		sorted[i] = i;
+	sort(sorted.begin(), sorted.end(), [&table](uint32_t a, uint32_t b) {
+		return memcmp(table.data() + (size_t)a * 20, table.data() + (size_t)b * 20, 20) < 0;
+	});
+	uint32_t fanout[256] = {};
+	for (uint32_t pos : sorted)
+		++fanout[static_cast<unsigned char>(table[(size_t)pos * 20])];
+	for (int b = 1; b < 256; ++b)
+		fanout[b] += fanout[b - 1];
+
+	BitmapHeader header{};
+	memcpy(header.magic, BITMAP_MAGIC, 4);
+	header.version = BITMAP_VERSION;
+	header.object_count = static_cast<uint32_t>(objects.size());
+	header.bitmap_count = static_cast<uint32_t>(bitmaps.size());
+
+	// 写入临时文件后替换，正在读取旧文件的请求不受影响
+	fs::path tmp = path;
+	tmp += ".tmp";
+	error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	{
+		ofstream out(tmp, ios::binary | ios::trunc);
+		if (!out.is_open())
+			return false;
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(table.data(), table.size());
+		out.write(reinterpret_cast<const char *>(fanout), sizeof(fanout));
+		out.write(reinterpret_cast<const char *>(sorted.data()), sorted.size() * sizeof(uint32_t));
+		for (const auto &bm : bitmaps) {
+			sha1_from_hex(bm.first, raw);
+			out.write(reinterpret_cast<const char *>(raw), 20);
+			uint32_t len = static_cast<uint32_t>(bm.second.size());
+			out.write(reinterpret_cast<const char *>(&len), sizeof(len));
+			out.write(bm.second.data(), bm.second.size());
+		}
+		if (!out.good()) {
+			out.close();
+			fs::remove(tmp, ec);
+			return false;
+		}
+	}
+	fs::rename(tmp, path, ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		return false;
+	}
+	return true;
+}
+
+bool ReachabilityIndex::missingObjects(const fs::path &objects_dir, const string &want,
+									   const string &have, vector<string> &ids) {
+	ids.clear();
+	fs::path path = indexPath(objects_dir);
+	LoadedIndex index;
+	Bitmap want_bits;
+	set<string> want_extra;
+	if (!index.open(path) || !collectReachable(index, objects_dir, want, want_bits, want_extra)) {
+		// 没有位图文件或位图过旧：先为 want 的历史生成位图
+		index.close();
+		update(objects_dir, want);
+		if (!index.open(path) ||
+			!collectReachable(index, objects_dir, want, want_bits, want_extra))
+			return false;
+	}
+
+	Bitmap have_bits;
+	set<string> have_extra;
+	// have 不在位图覆盖的历史中（例如分叉）时按空处理，发送 want 可达的全部对象
+	if (!have.empty() &&
+		!collectReachable(index, objects_dir, have, have_bits, have_extra)) {
+		have_bits = Bitmap();
+		have_extra.clear();
+	}
+
+	want_bits.andNot(have_bits);
+	ids.reserve(want_bits.count() + want_extra.size());
+	want_bits.forEach([&](size_t pos) { ids.push_back(index.idAt(static_cast<uint32_t>(pos))); });
+	for (const auto &id : want_extra) {
+		if (!have_extra.count(id))
+			ids.push_back(id);
+	}
+	return true;
+}
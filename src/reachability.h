@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+#include <functional>
+
+/**
+ * 位图
+ * 序列化时按64位字做行程压缩：标记字（最高位为连续字的取值，
+ * 30..62位为连续全0或全1字的个数，低30位为其后直接存放的字数）+ 若干原样存放的字
+ */
+class Bitmap {
+public:
+	void set(size_t i);
+	bool test(size_t i) const;
+	void orWith(const Bitmap &other);
+	void andNot(const Bitmap &other);
+	size_t count() const;
+	void forEach(const function<void(size_t)> &fn) const;
+
+	void encode(string &out) const;
+	// 位图中有不小于 max_bits 的位时返回false（数据损坏）
+	bool decode(const uint8_t *data, size_t size, size_t max_bits = SIZE_MAX);
+
+private:
+	vector<uint64_t> words;
+};
+
+/**
+ * 可达性位图
+ * objects/pack/reachability.bitmap：文件头 + 对象表（20字节哈希，下标即位号）
+ *   + fanout[256] + 按哈希排序的u32位号 + 选定提交的位图（20字节提交哈希 + u32长度 + 压缩位图）
+ * 对象按首次出现的提交从旧到新编号，越新的提交位图越接近"前缀全1"，压缩效果好；
+ * 提交图中每隔若干个提交保存一个位图，没有位图的提交从最近的带位图祖先补上中间提交新增的对象
+ */
+class ReachabilityIndex {
+public:
+	static fs::path indexPath(const fs::path &objects_dir);
+
+	/**
+	 * 为 head 的历史生成位图文件；已有文件覆盖 head 的祖先时只追加新的对象和位图
+	 * 返回是否写入了文件
+	 */
+	static bool update(const fs::path &objects_dir, const string &head);
+
+	/**
+	 * 从 want 可达、从 have 不可达的对象（包括提交、树对象和文件）
+	 * have 为空或未知时返回 want 可达的全部对象；位图过旧时先更新位图文件
+	 */
+	static bool missingObjects(const fs::path &objects_dir, const string &want,
+							   const string &have, vector<string> &ids);
+};
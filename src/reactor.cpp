@@ -0,0 +1,312 @@
+#include "reactor.h"
+
+#ifdef __linux__
+#include "protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+constexpr int MAX_EVENTS = 256;
+} // namespace
+
+struct Reactor::Connection {
+	int socket;
+	chrono::steady_clock::time_point last_activity = chrono::steady_clock::now();
+	// 正在拼接的消息，只由事件线程访问
+	vector<uint8_t> frame;
+	size_t frame_size = sizeof(MessageHeader);
+	bool closed = false; // 已从 connections 移除，只由事件线程访问
+
+	// 以下字段受 m 保护
+	mutex m;
+	deque<vector<uint8_t>> pending;
+	size_t pending_bytes = 0;
+	bool busy = false;		  // 有工作线程正在处理本连接的消息
+	bool read_paused = false; // 积压过多，暂停读取
+	bool eof = false;		  // 对端已关闭或读取出错
+	bool failed = false;	  // 处理消息失败，需要关闭连接
+
+	explicit Connection(int socket) : socket(socket) {}
+};
+
+Reactor::Reactor(int listen_socket, size_t worker_count, int idle_timeout_seconds,
+				 Handlers handlers)
+	: listen_socket(listen_socket), idle_timeout(idle_timeout_seconds),
+	  handlers(std::move(handlers)), read_buffer(READ_BUFFER_SIZE),
+	  workers(make_unique<ThreadPool>(worker_count)) {}
+
+Reactor::~Reactor() {
+	// 唤醒阻塞在发送上的工作线程，等它们结束后再关闭socket
+	for (auto &entry : connections)
+		shutdown(entry.first, SHUT_RDWR);
+	workers.reset();
+	for (auto &entry : connections) {
+		if (handlers.closed)
+			handlers.closed(entry.first);
+		close(entry.first);
+	}
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+	if (wake_fd >= 0)
+		close(wake_fd);
+}
+
+bool Reactor::run(const function<bool()> &keep_running) {
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epoll_fd < 0 || wake_fd < 0)
+		return false;
+
+	int flags = fcntl(listen_socket, F_GETFL, 0);
+	fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK);
+
+	epoll_event ev{};
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.fd = listen_socket;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &ev) < 0)
+		return false;
+	ev.events = EPOLLIN;
+	ev.data.fd = wake_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+		return false;
+
+	epoll_event events[MAX_EVENTS];
+	while (keep_running()) {
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 1000);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		for (int i = 0; i < n; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == listen_socket) {
+				acceptAll();
+			} else if (fd == wake_fd) {
+				handlePosted();
+			} else {
+				auto it = connections.find(fd);
+				if (it == connections.end())
+					continue;
+				auto conn = it->second;
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+					readAvailable(conn);
+				checkConnection(conn);
+			}
+		}
+		closeIdle();
+	}
+	return true;
+}
+
+void Reactor::acceptAll() {
+	for (;;) {
+		int client = accept4(listen_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return; // EAGAIN，或文件描述符耗尽时等下一次事件
+		}
+		// 发送超时由 NetworkUtils::sendData 等待可写时控制
+		NetworkUtils::setSocketTimeout(client, 30);
+
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+		ev.data.fd = client;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &ev) < 0) {
+			close(client);
+			continue;
+		}
+		auto conn = make_shared<Connection>(client);
+		connections[client] = conn;
+		if (handlers.opened)
+			handlers.opened(client);
+		// 边沿触发：连接建立前已到达的数据不会再产生事件
+		readAvailable(conn);
+		checkConnection(conn);
+	}
+}
+
+void Reactor::readAvailable(const shared_ptr<Connection> &conn) {
+	for (;;) {
+		{
+			lock_guard<mutex> lock(conn->m);
+			if (conn->eof || conn->failed)
+				return;
+			if (conn->pending_bytes >= MAX_PENDING_BYTES) {
+				conn->read_paused = true;
+				return;
+			}
+		}
+		ssize_t n = recv(conn->socket, read_buffer.data(), read_buffer.size(), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0) {
+			lock_guard<mutex> lock(conn->m);
+			conn->eof = true;
+			return;
+		}
+		conn->last_activity = chrono::steady_clock::now();
+		if (!appendData(*conn, read_buffer.data(), static_cast<size_t>(n))) {
+			lock_guard<mutex> lock(conn->m);
+			conn->failed = true;
+			return;
+		}
+		dispatch(conn);
+	}
+}
+
+bool Reactor::appendData(Connection &conn, const uint8_t *data, size_t size) {
+	while (size > 0) {
+		size_t n = min(conn.frame_size - conn.frame.size(), size);
+		conn.frame.insert(conn.frame.end(), data, data + n);
+		data += n;
+		size -= n;
+		if (conn.frame.size() < conn.frame_size)
+			break;
+
+		if (conn.frame_size == sizeof(MessageHeader)) {
+			// 消息头完整，确定整条消息的长度
+			MessageHeader header;
+			memcpy(&header, conn.frame.data(), sizeof(header));
+			if (header.magic != 0x4D474954 || header.version != PROTOCOL_VERSION ||
+				header.payload_size > MAX_FRAME_BYTES - sizeof(MessageHeader))
+				return false;
+			conn.frame_size = sizeof(MessageHeader) + header.payload_size;
+			if (conn.frame.size() < conn.frame_size) {
+				conn.frame.reserve(conn.frame_size);
+				continue;
+			}
+		}
+
+		size_t bytes = conn.frame.size();
+		{
+			lock_guard<mutex> lock(conn.m);
+			conn.pending.push_back(std::move(conn.frame));
+			conn.pending_bytes += bytes;
+		}
+		conn.frame.clear();
+		conn.frame_size = sizeof(MessageHeader);
+	}
+	return true;
+}
+
+void Reactor::dispatch(const shared_ptr<Connection> &conn) {
+	{
+		lock_guard<mutex> lock(conn->m);
+		if (conn->busy || conn->failed || conn->pending.empty())
+			return;
+		conn->busy = true;
+	}
+	workers->submit([this, conn]() { drain(conn); });
+}
+
+void Reactor::drain(shared_ptr<Connection> conn) {
+	for (;;) {
+		vector<uint8_t> frame;
+		{
+			lock_guard<mutex> lock(conn->m);
+			if (conn->failed || conn->pending.empty()) {
+				conn->busy = false;
+				break;
+			}
+			frame = std::move(conn->pending.front());
+			conn->pending.pop_front();
+			conn->pending_bytes -= frame.size();
+			if (conn->read_paused && conn->pending_bytes < MAX_PENDING_BYTES / 2) {
+				conn->read_paused = false;
+				post(conn);
+			}
+		}
+
+		bool ok = false;
+		try {
+			ok = handlers.message(conn->socket, frame);
+		} catch (const exception &e) {
+			cerr << "Client handler error: " << e.what() << "\n";
+		}
+		if (!ok) {
+			lock_guard<mutex> lock(conn->m);
+			conn->failed = true;
+			conn->pending.clear();
+			conn->pending_bytes = 0;
+		}
+	}
+	post(std::move(conn));
+}
+
+void Reactor::post(shared_ptr<Connection> conn) {
+	{
+		lock_guard<mutex> lock(posted_mutex);
+		posted.push_back(std::move(conn));
+	}
+	uint64_t one = 1;
+	ssize_t written = write(wake_fd, &one, sizeof(one));
+	(void)written;
+}
+
+void Reactor::handlePosted() {
+	uint64_t value;
+	while (read(wake_fd, &value, sizeof(value)) > 0) {
+	}
+	vector<shared_ptr<Connection>> list;
+	{
+		lock_guard<mutex> lock(posted_mutex);
+		list.swap(posted);
+	}
+	for (auto &conn : list) {
+		if (conn->closed)
+			continue;
+		conn->last_activity = chrono::steady_clock::now();
+		readAvailable(conn);
+		checkConnection(conn);
+	}
+}
+
+void Reactor::checkConnection(const shared_ptr<Connection> &conn) {
+	if (conn->closed)
+		return;
+	bool close_now;
+	{
+		lock_guard<mutex> lock(conn->m);
+		// 对端关闭前发来的消息仍然按顺序处理完
+		close_now = !conn->busy && (conn->failed || (conn->eof && conn->pending.empty()));
+	}
+	if (close_now)
+		closeConnection(conn);
+	else
+		dispatch(conn);
+}
+
+void Reactor::closeConnection(const shared_ptr<Connection> &conn) {
+	conn->closed = true;
+	connections.erase(conn->socket);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->socket, nullptr);
+	if (handlers.closed)
+		handlers.closed(conn->socket);
+	close(conn->socket);
+}
+
+void Reactor::closeIdle() {
+	auto now = chrono::steady_clock::now();
+	vector<shared_ptr<Connection>> idle;
+	for (auto &entry : connections) {
+		auto &conn = entry.second;
+		if (now - conn->last_activity < chrono::seconds(idle_timeout))
+			continue;
+		lock_guard<mutex> lock(conn->m);
+		if (!conn->busy)
+			idle.push_back(conn);
+	}
+	for (auto &conn : idle)
+		closeConnection(conn);
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common.h"
+
+#ifdef __linux__
+#include "thread_pool.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * 基于 epoll 的服务器事件循环（仅 Linux，其他平台仍为每个连接一个线程）
+ * 监听socket和客户端socket均为非阻塞、边沿触发；事件线程接受连接并按消息头拼出完整消息，
+ * 完整消息交给有界的工作线程池处理。同一连接的消息按到达顺序逐条处理，
+ * 处理期间事件线程继续读取后续消息，积压超过 MAX_PENDING_BYTES 时暂停读取该连接。
+ * 空闲和正在发送请求的慢速客户端不占用工作线程
+ */
+class Reactor {
+public:
+	struct Handlers {
+		function<void(int socket)> opened;
+		// 处理一条完整消息（消息头 + 未解密的负载），返回false时关闭连接
+		function<bool(int socket, const vector<uint8_t> &frame)> message;
+		// 连接关闭前调用，之后socket才会被关闭
+		function<void(int socket)> closed;
+	};
+
+	// 单个连接已读取未处理的消息总量上限
+	static constexpr size_t MAX_PENDING_BYTES = 32 * 1024 * 1024;
+	// 单条消息（消息头 + 负载）的上限，消息头声明更大的负载时关闭连接；
+	// 流式归档每段只有几MB，拼装中的消息因此也受积压上限约束
+	static constexpr size_t MAX_FRAME_BYTES = MAX_PENDING_BYTES;
+
+	Reactor(int listen_socket, size_t worker_count, int idle_timeout_seconds, Handlers handlers);
+	~Reactor();
+
+	Reactor(const Reactor &) = delete;
+	Reactor &operator=(const Reactor &) = delete;
+
+	// 运行事件循环，至少每秒调用一次 keep_running，返回false时退出
+	bool run(const function<bool()> &keep_running);
+
+private:
+	struct Connection;
+
+	void acceptAll();
+	// 读到 EAGAIN、连接关闭或积压达到上限为止
+	void readAvailable(const shared_ptr<Connection> &conn);
+	bool appendData(Connection &conn, const uint8_t *data, size_t size);
+	void dispatch(const shared_ptr<Connection> &conn);
+	void drain(shared_ptr<Connection> conn);
+	// 工作线程通知事件线程检查连接（处理完成、可以恢复读取）
+	void post(shared_ptr<Connection> conn);
+	void handlePosted();
+	void checkConnection(const shared_ptr<Connection> &conn);
+	void closeConnection(const shared_ptr<Connection> &conn);
+	void closeIdle();
+
+	int listen_socket;
+	int epoll_fd = -1;
+	int wake_fd = -1;
+	int idle_timeout;
+	Handlers handlers;
+	unordered_map<int, shared_ptr<Connection>> connections;
+	vector<uint8_t> read_buffer;
+
+	mutex posted_mutex;
+	vector<shared_ptr<Connection>> posted;
+
+	// 最后声明、最先析构：先等待工作线程结束，再释放连接
+	unique_ptr<ThreadPool> workers;
+};
+#endif
@@ -0,0 +1,80 @@
+#include "refs.h"
+#include "filesystem_utils.h"
+#include <unordered_map>
+
+namespace {
+mutex stores_mutex;
+unordered_map<string, shared_ptr<RefStore>> stores;
+
+string readHeadFile(const fs::path &path) {
+	string id;
+	ifstream in(path);
+	if (in.is_open())
+		getline(in, id);
+	while (!id.empty() && (id.back() == '\n' || id.back() == '\r' || id.back() == ' '))
+		id.pop_back();
+	return id;
+}
+
+fs::file_time_type headTime(const fs::path &path) {
+	error_code ec;
+	auto t = fs::last_write_time(path, ec);
+	return ec ? fs::file_time_type::min() : t;
+}
+} // namespace
+
+RefStore::RefStore(const fs::path &mg_dir) : head_path(mg_dir / "HEAD"), current(load()) {}
+
+shared_ptr<const RefStore::Snapshot> RefStore::load() const {
+	// 先取修改时间再读内容，两者之间被改写时下次读取会因时间不一致再次加载
+	auto mtime = headTime(head_path);
+	return make_shared<const Snapshot>(Snapshot{readHeadFile(head_path), mtime});
+}
+
+shared_ptr<RefStore> RefStore::forDirectory(const fs::path &mg_dir) {
+	fs::path dir = fs::absolute(mg_dir).lexically_normal();
+	lock_guard<mutex> lock(stores_mutex);
+	auto &store = stores[dir.string()];
+	if (!store)
+		store.reset(new RefStore(dir));
+	return store;
+}
+
+string RefStore::head() const {
+	auto snapshot = atomic_load(&current);
+	if (headTime(head_path) == snapshot->mtime)
+		return snapshot->id;
+	// 文件被其他途径改写，重新读取
+	lock_guard<mutex> lock(write_mutex);
+	snapshot = load();
+	atomic_store(&current, snapshot);
+	return snapshot->id;
+}
+
+bool RefStore::compareAndSwapHead(const string &expected, const string &desired) {
+	lock_guard<mutex> lock(write_mutex);
+	// 以文件为准，缓存的快照可能落后于外部写入
+	auto snapshot = load();
+	atomic_store(&current, snapshot);
+	if (snapshot->id != expected)
+		return false;
+	writeHead(desired);
+	return true;
+}
+
+void RefStore::setHead(const string &id) {
+	lock_guard<mutex> lock(write_mutex);
+	writeHead(id);
+}
+
+void RefStore::reload() {
+	lock_guard<mutex> lock(write_mutex);
+	atomic_store(&current, load());
+}
+
+void RefStore::writeHead(const string &id) {
+	// 先替换文件再发布，其他线程读到新 HEAD 时文件已经是新内容
+	if (!FileSystemUtils::replaceFile(head_path, id.data(), id.size()))
+		throw runtime_error("Failed to write HEAD: " + head_path.string());
+	atomic_store(&current, make_shared<const Snapshot>(Snapshot{id, headTime(head_path)}));
+}
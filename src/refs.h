@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include <memory>
+#include <mutex>
+
+/**
+ * 仓库的 HEAD 引用和维护锁，同一仓库在进程内共享一个实例
+ * HEAD 连同文件修改时间保存为不可变快照，读取时只比较修改时间，文件被本地提交或手工改写后
+ * 重新读取；更新先写临时文件再 rename，成功后原子替换快照。比较并交换在写锁内以文件内容为准，
+ * 不会覆盖外部写入。
+ * 服务器上拉取、克隆只读取一次 HEAD 快照，之后按快照发送不可变的对象，传输期间不加锁；
+ * 推送写对象时不加锁（对象写临时文件后 rename），交换 HEAD 只依靠比较并交换，不等待读操作。
+ * 维护锁只串行化迁移对象布局和删除仓库，读操作不加锁：迁移只移动旧客户端上传的平铺对象，
+ * 读取只访问分片路径，对象 rename 到位后才可见；删除仓库时正在进行的传输会因对象缺失而失败
+ */
+class RefStore {
+public:
+	// mg_dir 为仓库的 MARKNAME 目录
+	static shared_ptr<RefStore> forDirectory(const fs::path &mg_dir);
+
+	// 当前 HEAD，没有提交时为空
+	string head() const;
+
+	// HEAD 等于 expected 时改为 desired 并返回true，否则不修改并返回false；写文件失败时抛出异常
+	bool compareAndSwapHead(const string &expected, const string &desired);
+	// 无条件更新 HEAD（本地提交）
+	void setHead(const string &id);
+	// HEAD 文件被其他途径改写（删除、重建仓库）后立即重新读取
+	void reload();
+
+	mutex &lock() { return maintenance; }
+
+private:
+	explicit RefStore(const fs::path &mg_dir);
+
+	struct Snapshot {
+		string id;
+		fs::file_time_type mtime; // 读取时 HEAD 文件的修改时间，文件不存在时为最小值
+	};
+
+	shared_ptr<const Snapshot> load() const;
+	void writeHead(const string &id);
+
+	fs::path head_path;
+	mutable shared_ptr<const Snapshot> current; // 通过 atomic_load / atomic_store 访问
+	mutable mutex write_mutex;					// 串行化 HEAD 更新和重新读取
+	mutex maintenance;							// 迁移、删除仓库之间互斥
+};
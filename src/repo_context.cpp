@@ -0,0 +1,15 @@
+#include "repo_context.h"
+#include "commit_graph.h"
+#include "object_cache.h"
+#include "pack.h"
+
+RepoContext::RepoContext(const fs::path &root)
+	: root_path(fs::absolute(root).lexically_normal()), mg_dir(root_path / MARKNAME),
+	  objects_dir(mg_dir / "objects"), object_cache(ObjectCache::forDirectory(objects_dir)),
+	  pack_store(PackStore::forDirectory(objects_dir)),
+	  commit_graph(CommitGraph::forDirectory(objects_dir)),
+	  ref_store(RefStore::forDirectory(mg_dir)) {}
+
+RepoContext RepoContext::current() {
+	return RepoContext(FileSystemUtils::getInstance().repoRoot());
+}
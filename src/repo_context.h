@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+#include "filesystem_utils.h"
+#include "refs.h"
+#include <memory>
+
+class ObjectCache;
+class PackStore;
+class CommitGraph;
+
+/**
+ * 仓库上下文
+ * 保存一个仓库解析后的绝对路径，以及该仓库共享的对象缓存、包文件和提交图，
+ * 显式传给 Objects、Index、CommitManager，不依赖进程级的当前仓库和工作目录；
+ * 服务器每个会话持有所用仓库的上下文，多个仓库可以在同一进程中并行读写
+ */
+class RepoContext {
+public:
+	// root 为仓库根目录（包含 MARKNAME 的目录）
+	explicit RepoContext(const fs::path &root);
+
+	// 命令行当前所在的仓库
+	static RepoContext current();
+
+	const fs::path &root() const { return root_path; }
+	const fs::path &mgDir() const { return mg_dir; }
+	const fs::path &objectsDir() const { return objects_dir; }
+	fs::path indexPath() const { return mg_dir / "index"; }
+	fs::path headPath() const { return mg_dir / "HEAD"; }
+	fs::path configPath() const { return mg_dir / "config"; }
+	fs::path objectPath(const string &id) const {
+		return FileSystemUtils::objectPath(objects_dir, id);
+	}
+
+	// HEAD 中的提交哈希，没有提交时为空；不加锁
+	string head() const { return ref_store->head(); }
+
+	ObjectCache &cache() const { return *object_cache; }
+	PackStore &packs() const { return *pack_store; }
+	CommitGraph &graph() const { return *commit_graph; }
+	RefStore &refs() const { return *ref_store; }
+
+private:
+	fs::path root_path;
+	fs::path mg_dir;
+	fs::path objects_dir;
+	shared_ptr<ObjectCache> object_cache;
+	shared_ptr<PackStore> pack_store;
+	shared_ptr<CommitGraph> commit_graph;
+	shared_ptr<RefStore> ref_store;
+};
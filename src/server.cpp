@@ -1,9 +1,15 @@
 #include "server.h"
+#include "clone_cache.h"
 #include "commit.h"
+#include "commit_graph.h"
 #include "crypto.h"
 #include "filesystem_utils.h"
 #include "objects.h"
 #include "protocol.h"
+#include "reachability.h"
+#include "reactor.h"
+#include "repo_context.h"
+#include "shallow.h"
 #include <chrono>
 #include <cstring>
 #include <map>
@@ -30,6 +36,25 @@
 #define INVALID_SOCKET_VALUE -1
 #endif
 
+// 会话空闲超时（秒）
+const int SESSION_TIMEOUT = 300;
+
+// 明文模式下克隆时不小于此大小的文件（主要是包文件）直接从磁盘发送，不再打包压缩
+const uint64_t RAW_FILE_MIN_SIZE = 256 * 1024;
+
+// 克隆归档中 HEAD 文件的路径（相对仓库根目录）
+const string HEAD_RELATIVE_PATH = string(MARKNAME) + "/HEAD";
+
+// 克隆归档的 HEAD 使用请求开始时的快照，推送在传输期间改写磁盘上的 HEAD 不影响本次克隆
+static CompressionUtils::FileLoader headLoader(const string &head) {
+	return [head](const fs::path &relative, vector<uint8_t> &data) {
+		if (relative.generic_string() != HEAD_RELATIVE_PATH)
+			return false;
+		data.assign(head.begin(), head.end());
+		return true;
+	};
+}
+
 // 前向声明
 class ClientSession;
 class RepositoryManager;
@@ -42,8 +67,19 @@ class ClientSession {
 	string session_id;
 	bool authenticated;
 	string current_repo;
+	// 当前仓库的上下文，所有对象、提交和HEAD的读写都经过它，与其他会话互不影响
+	shared_ptr<RepoContext> repo;
 	chrono::time_point<chrono::steady_clock> last_activity;
 	int socket;
+	// 正在接收的流式推送归档
+	unique_ptr<ArchiveExtractor> push_archive;
+	// 本会话下发归档（拉取、克隆）使用的压缩方式
+	CompressionOptions compression;
+	// 客户端在请求头中声明的校验和算法，回应时使用相同算法
+	ChecksumType checksum = ChecksumType::Crc32;
+	// 连接的第一条消息协商本会话是否使用明文负载，之后不能改变
+	bool plaintext = false;
+	bool transport_negotiated = false;
 
 	ClientSession(int sock) : socket(sock), authenticated(false) {
 		session_id = generateSessionId();
@@ -159,6 +195,24 @@ class RepositoryManager {
 		return root_path_ / repo_name;
 	}
 
+	fs::path getObjectsPath(const string &repo_name) const {
+		return root_path_ / repo_name / MARKNAME / "objects";
+	}
+
+	shared_ptr<RepoContext> openRepository(const string &repo_name) const {
+		return make_shared<RepoContext>(getRepositoryPath(repo_name));
+	}
+
+	// 仓库中对象的分片存储路径
+	fs::path getObjectPath(const string &repo_name, const string &id) const {
+		return FileSystemUtils::objectPath(getObjectsPath(repo_name), id);
+	}
+
+	// 把旧版本平铺存放的对象迁移为分片布局
+	size_t migrateObjectLayout(const string &repo_name) const {
+		return FileSystemUtils::migrateObjectLayout(getObjectsPath(repo_name));
+	}
+
   private:
 	fs::path root_path_;
 };
@@ -169,6 +223,7 @@ class Server::Impl {
 	bool running;
 	map<int, shared_ptr<ClientSession>> sessions;
 	unique_ptr<RepositoryManager> repo_manager;
+	unique_ptr<CloneBundleCache> clone_cache;
 	Crypto::SymmetricKey symmetric_key;
 	Crypto::RSAKeyPair rsa_keypair;
 	mutex sessions_mutex;
@@ -181,6 +236,8 @@ class Server::Impl {
 
 	Impl() : running(false) {
 		repo_manager = make_unique<RepositoryManager>(Config::getInstance().root_path);
+		clone_cache = make_unique<CloneBundleCache>(
+			static_cast<size_t>(max(Config::getInstance().clone_cache_mb, 0)) * 1024 * 1024);
 
 		if (!Config::getInstance().password.empty()) {
 			symmetric_key = Crypto::generateKeyFromPassword(Config::getInstance().password);
@@ -227,9 +284,68 @@ int Server::run() {
 		cout << "Authentication: None (WARNING: Insecure!)\n";
 	}
 
+	// 迁移旧版本的平铺对象布局
+	for (const auto &repo : impl_->repo_manager->listRepositories()) {
+		size_t moved = impl_->repo_manager->migrateObjectLayout(repo);
+		if (moved > 0) {
+			cout << "Migrated " << moved << " object(s) in " << repo << " to sharded layout\n";
+		}
+	}
+
 	running_ = true;
+#ifdef __linux__
+	runEventLoop();
+#else
+	runThreadPerClient();
+#endif
 
-	// 主服务循环
+	cleanupNetwork();
+	return 0;
+}
+
+#ifdef __linux__
+// epoll 事件循环：连接由事件线程管理，消息交给有界的工作线程池处理
+void Server::runEventLoop() {
+	size_t workers = Config::getInstance().workers > 0
+						 ? static_cast<size_t>(Config::getInstance().workers)
+						 : max<size_t>(8, 2 * ThreadPool::defaultWorkerCount());
+	cout << "Worker threads: " << workers << "\n";
+
+	Reactor::Handlers handlers;
+	handlers.opened = [this](int client_socket) {
+		lock_guard<mutex> lock(impl_->sessions_mutex);
+		impl_->sessions[client_socket] = make_shared<ClientSession>(client_socket);
+		cout << "Client connected: " << client_socket << "\n";
+	};
+	handlers.message = [this](int client_socket, const vector<uint8_t> &frame) {
+		shared_ptr<ClientSession> session;
+		{
+			lock_guard<mutex> lock(impl_->sessions_mutex);
+			auto it = impl_->sessions.find(client_socket);
+			if (it == impl_->sessions.end())
+				return false;
+			session = it->second;
+		}
+		ProtocolMessage msg;
+		if (!ProtocolMessage::deserialize(frame, msg))
+			return false;
+		return handleMessage(client_socket, session, msg);
+	};
+	handlers.closed = [this](int client_socket) {
+		lock_guard<mutex> lock(impl_->sessions_mutex);
+		impl_->sessions.erase(client_socket);
+		cout << "Client disconnected: " << client_socket << "\n";
+	};
+
+	Reactor reactor(server_socket_, workers, SESSION_TIMEOUT, std::move(handlers));
+	if (!reactor.run([this]() { return running_; }) && running_) {
+		cerr << "Event loop error\n";
+	}
+}
+#endif
+
+// 每个连接一个线程（没有 epoll 的平台）
+void Server::runThreadPerClient() {
 	while (running_) {
 		fd_set read_fds;
 		FD_ZERO(&read_fds);
@@ -277,9 +393,6 @@ int Server::run() {
 		// 清理过期会话
 		cleanupExpiredSessions();
 	}
-
-	cleanupNetwork();
-	return 0;
 }
 
 // 停止服务器
@@ -343,7 +456,7 @@ bool Server::createServerSocket() {
 	}
 
 	// 开始监听
-	if (::listen(server_socket_, 10) < 0) {
+	if (::listen(server_socket_, SOMAXCONN) < 0) {
 		return false;
 	}
 
@@ -392,12 +505,7 @@ void Server::handleClient(int client_socket) {
 			if (!NetworkUtils::receiveMessage(client_socket, msg)) {
 				break;
 			}
-
-			session->updateActivity();
-			FileSystemUtils::getInstance().useRepo(session->current_repo);
-
-			// 处理消息
-			if (!processMessage(client_socket, session, msg)) {
+			if (!handleMessage(client_socket, session, msg)) {
 				break;
 			}
 		}
@@ -420,6 +528,33 @@ void Server::handleClient(int client_socket) {
 	cout << "Client disconnected: " << client_socket << "\n";
 }
 
+// 处理一条已接收的消息，返回false时关闭连接
+bool Server::handleMessage(int client_socket, shared_ptr<ClientSession> session,
+						   const ProtocolMessage &msg) {
+	// 未允许明文时拒绝未加密的消息
+	bool plaintext = msg.header.flags & MESSAGE_FLAG_PLAINTEXT;
+	if (plaintext && !Config::getInstance().allow_plaintext) {
+		sendErrorResponse(client_socket, StatusCode::PERMISSION_DENIED,
+						  "Plaintext transfers are disabled on this server");
+		return false;
+	}
+	if (!session->transport_negotiated) {
+		session->plaintext = plaintext;
+		session->transport_negotiated = true;
+	}
+	// 本会话的回应使用协商的模式，不受其他会话影响
+	PlaintextScope scope(session->plaintext);
+	if (plaintext != session->plaintext) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+						  "Encryption mode cannot change within a session");
+		return false;
+	}
+
+	session->updateActivity();
+	session->checksum = static_cast<ChecksumType>(msg.header.checksum);
+	return processMessage(client_socket, session, msg);
+}
+
 // 处理协议消息
 bool Server::processMessage(int client_socket, shared_ptr<ClientSession> session,
 							const ProtocolMessage &msg) {
@@ -448,6 +583,12 @@ bool Server::processMessage(int client_socket, shared_ptr<ClientSession> session
 	case MessageType::PUSH_CHECK_REQUEST:
 		return handlePushCheckRequest(client_socket, session, msg);
 
+	case MessageType::PUSH_HAVE_REQUEST:
+		return handlePushHaveRequest(client_socket, session, msg);
+
+	case MessageType::COMPRESSION_REQUEST:
+		return handleCompressionRequest(client_socket, session, msg);
+
 	case MessageType::PUSH_COMMIT_DATA:
 		return handlePushCommitData(client_socket, session, msg);
 
@@ -465,6 +606,12 @@ bool Server::processMessage(int client_socket, shared_ptr<ClientSession> session
 	case MessageType::CLONE_REQUEST:
 		return handleCloneRequest(client_socket, session, msg);
 
+	case MessageType::SHALLOW_CLONE_REQUEST:
+		return handleShallowCloneRequest(client_socket, session, msg);
+
+	case MessageType::DEEPEN_REQUEST:
+		return handleDeepenRequest(client_socket, session, msg);
+
 	case MessageType::LOG_REQUEST:
 		return handleLogRequest(client_socket, session, msg);
 
@@ -483,8 +630,7 @@ void Server::cleanupExpiredSessions() {
 
 	vector<int> expired_sockets;
 	for (const auto &pair : impl_->sessions) {
-		if (pair.second->isExpired(300)) {
-			// 5分钟超时
+		if (pair.second->isExpired(SESSION_TIMEOUT)) {
 			expired_sockets.push_back(pair.first);
 		}
 	}
@@ -527,6 +673,24 @@ bool Server::sendCloneFile(int client_socket, const string &relative_path,
 	}
 }
 
+// 分段发送克隆文件的原始数据，每段的数据部分直接从磁盘发送到socket
+bool Server::sendCloneFileRaw(int client_socket, const string &relative_path,
+							  const fs::path &file_path, uint64_t file_size) {
+	uint64_t offset = 0;
+	do {
+		uint32_t chunk_size = static_cast<uint32_t>(
+			min<uint64_t>(file_size - offset, NetworkUtils::RAW_CHUNK_SIZE));
+		vector<uint8_t> prefix =
+			ProtocolMessage::createCloneFileRawPrefix(relative_path, file_size, offset, chunk_size);
+		if (!NetworkUtils::sendData(client_socket, prefix.data(), prefix.size()) ||
+			!NetworkUtils::sendFile(client_socket, file_path, offset, chunk_size)) {
+			return false;
+		}
+		offset += chunk_size;
+	} while (offset < file_size);
+	return true;
+}
+
 // 认证请求处理
 bool Server::handleAuthRequest(int client_socket, shared_ptr<ClientSession> session,
 							   const ProtocolMessage &msg) {
@@ -647,6 +811,7 @@ bool Server::handleUseRepoRequest(int client_socket, shared_ptr<ClientSession> s
 	}
 
 	session->current_repo = repo_name;
+	session->repo = impl_->repo_manager->openRepository(repo_name);
 
 	auto response = ProtocolMessage::createStringMessage(MessageType::USE_REPO_RESPONSE,
 														 "Using repository: " + repo_name);
@@ -701,10 +866,17 @@ bool Server::handleRemoveRepoRequest(int client_socket, shared_ptr<ClientSession
 		return false;
 	}
 
-	if (impl_->repo_manager->removeRepository(repo_name)) {
+	auto repo = impl_->repo_manager->openRepository(repo_name);
+	unique_lock<mutex> repo_lock(repo->refs().lock());
+	bool removed = impl_->repo_manager->removeRepository(repo_name);
+	repo->refs().reload();
+	impl_->clone_cache->invalidate(repo->root());
+	repo_lock.unlock();
+	if (removed) {
 		// 如果删除的是当前使用的仓库，清除会话中的当前仓库
 		if (session->current_repo == repo_name) {
 			session->current_repo.clear();
+			session->repo.reset();
 		}
 
 		auto response = ProtocolMessage::createStringMessage(MessageType::REMOVE_REPO_RESPONSE,
@@ -735,26 +907,8 @@ bool Server::handlePushRequest(int client_socket, shared_ptr<ClientSession> sess
 		sendErrorResponse(client_socket, StatusCode::REPO_NOT_FOUND, "Repository not found");
 		return false;
 	}
-	// 获取当前远程HEAD用于验证
-	string current_remote_head;
-	fs::path remote_head_path = repo_path / MARKNAME / "HEAD";
-	if (fs::exists(remote_head_path)) {
-		try {
-			ifstream head_file(remote_head_path);
-			if (head_file.is_open()) {
-				getline(head_file, current_remote_head);
-				head_file.close();
-				// 移除尾部的换行符
-				while (!current_remote_head.empty() &&
-					   (current_remote_head.back() == '\n' || current_remote_head.back() == '\r')) {
-					current_remote_head.pop_back();
-				}
-			}
-		} catch (const exception &e) {
-			// 如果读取失败，视为空仓库
-			current_remote_head.clear();
-		}
-	}
+	// 获取当前远程HEAD用于验证，更新时以它作为比较并交换的期望值
+	string current_remote_head = session->repo->head();
 
 	// 解析客户端的HEAD
 	if (msg.payload.size() < sizeof(PushRequestPayload)) {
@@ -782,21 +936,14 @@ bool Server::handlePushRequest(int client_socket, shared_ptr<ClientSession> sess
 	if (!new_remote_head.empty()) {
 		// 从服务器的objects目录中读取客户端提交的commit数据来获取其父节点
 		string client_commit_parent;
-		fs::path commit_obj_path = repo_path / MARKNAME / "objects" / new_remote_head;
-		cout << "commit_obj_path " << commit_obj_path << endl;
-		if (fs::exists(commit_obj_path)) {
+		vector<uint8_t> commit_data;
+		if (Objects::readObject(*session->repo, new_remote_head, commit_data)) {
 			try {
-				ifstream commit_file(commit_obj_path, ios::binary);
-				if (commit_file.is_open()) {
-					vector<uint8_t> commit_data((istreambuf_iterator<char>(commit_file)), {});
-					commit_file.close();
-
-					// 解析commit数据获取父节点
-					string commit_content = string(commit_data.begin(), commit_data.end());
-					Commit commit =
-						CommitManager::deserializeCommit(new_remote_head + "\n" + commit_content);
-					client_commit_parent = commit.parent;
-				}
+				// 解析commit数据获取父节点
+				string commit_content = string(commit_data.begin(), commit_data.end());
+				Commit commit =
+					CommitManager::deserializeCommit(new_remote_head + "\n" + commit_content);
+				client_commit_parent = commit.parent;
 			} catch (const exception &e) {
 				// 如果无法解析commit，拒绝push
 				sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
@@ -823,11 +970,18 @@ bool Server::handlePushRequest(int client_socket, shared_ptr<ClientSession> sess
 	// 检查提交的commit是不是最新的版本 - 验证通过，更新HEAD
 	if (!new_remote_head.empty()) {
 		try {
-			ofstream head_file(remote_head_path);
-			if (head_file.is_open()) {
-				head_file << new_remote_head;
-				head_file.close();
+			// HEAD 交换是一次比较并交换，不等待进行中的拉取和克隆：
+			// 它们发送的是各自读到的 HEAD 快照，快照可达的对象不会被推送修改
+			session->repo->graph().add(new_remote_head);
+			if (!session->repo->refs().compareAndSwapHead(current_remote_head,
+														 new_remote_head)) {
+				// 验证之后其他客户端先完成了推送
+				sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+								  "Push rejected: remote HEAD changed during push. Please "
+								  "pull the latest changes first.");
+				return false;
 			}
+			impl_->clone_cache->invalidate(session->repo->root());
 		} catch (const exception &e) {
 			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
 							  "Failed to update remote HEAD");
@@ -907,24 +1061,9 @@ bool Server::handlePushCheckRequest(int client_socket, shared_ptr<ClientSession>
 		} else {
 			cout << "create new repo failed " << session->current_repo << endl;
 		}
+		session->repo->refs().reload();
 	}
-	if (fs::exists(remote_head_path)) {
-		try {
-			ifstream head_file(remote_head_path);
-			if (head_file.is_open()) {
-				getline(head_file, remote_head);
-				head_file.close();
-				// 移除尾部的换行符
-				while (!remote_head.empty() &&
-					   (remote_head.back() == '\n' || remote_head.back() == '\r')) {
-					remote_head.pop_back();
-				}
-			}
-		} catch (const exception &e) {
-			// 如果读取失败，视为空仓库
-			remote_head.clear();
-		}
-	}
+	remote_head = session->repo->head();
 
 	// 检查是否需要更新
 	if (!remote_head.empty() && remote_head == local_head) {
@@ -946,6 +1085,67 @@ bool Server::handlePushCheckRequest(int client_socket, shared_ptr<ClientSession>
 	return NetworkUtils::sendMessage(client_socket, response);
 }
 
+// 压缩方式协商：记录客户端选择的压缩方式，返回实际采用的方式（级别限制在支持范围内）
+bool Server::handleCompressionRequest(int client_socket, shared_ptr<ClientSession> session,
+									  const ProtocolMessage &msg) {
+	if (!session->authenticated) {
+		sendErrorResponse(client_socket, StatusCode::AUTH_REQUIRED, "Authentication required");
+		return false;
+	}
+
+	if (msg.payload.size() < sizeof(CompressionPayload)) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+						  "Invalid compression request");
+		return false;
+	}
+	CompressionPayload payload;
+	memcpy(&payload, msg.payload.data(), sizeof(CompressionPayload));
+
+	CompressionOptions options;
+	options.codec = static_cast<CompressionCodec>(payload.codec);
+	options.level = payload.level;
+	session->compression = options.clamped();
+
+	auto response = ProtocolMessage::createCompressionMessage(
+		MessageType::COMPRESSION_RESPONSE, static_cast<uint8_t>(session->compression.codec),
+		session->compression.level);
+	return NetworkUtils::sendMessage(client_socket, response);
+}
+
+// 对象协商处理：返回客户端候选对象中服务器缺少的部分
+bool Server::handlePushHaveRequest(int client_socket, shared_ptr<ClientSession> session,
+								   const ProtocolMessage &msg) {
+	if (!session->authenticated) {
+		sendErrorResponse(client_socket, StatusCode::AUTH_REQUIRED, "Authentication required");
+		return false;
+	}
+
+	if (session->current_repo.empty()) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "No repository selected");
+		return false;
+	}
+
+	if (msg.payload.size() < sizeof(PushHaveRequestPayload)) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "Invalid have request");
+		return false;
+	}
+	PushHaveRequestPayload have_payload;
+	memcpy(&have_payload, msg.payload.data(), sizeof(PushHaveRequestPayload));
+	if (msg.payload.size() <
+		sizeof(PushHaveRequestPayload) + (size_t)have_payload.object_count * 20) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "Incomplete have request");
+		return false;
+	}
+
+	const unsigned char *raw = msg.payload.data() + sizeof(PushHaveRequestPayload);
+	vector<bool> missing(have_payload.object_count);
+	for (uint32_t i = 0; i < have_payload.object_count; ++i)
+		missing[i] = !Objects::hasObject(*session->repo, sha1_to_hex(raw + (size_t)i * 20));
+
+	auto response = ProtocolMessage::createPushHaveResponse(missing);
+	return NetworkUtils::sendMessage(client_socket, response);
+}
+
 // 推送提交数据处理
 bool Server::handlePushCommitData(int client_socket, shared_ptr<ClientSession> session,
 								  const ProtocolMessage &msg) {
@@ -985,22 +1185,9 @@ bool Server::handlePushCommitData(int client_socket, shared_ptr<ClientSession> s
 		msg.payload.begin() + sizeof(PushCommitDataPayload) + commit_payload.commit_id_length +
 			commit_payload.commit_data_length);
 
-	// 将commit保存到远程仓库
-	fs::path repo_path = impl_->repo_manager->getRepositoryPath(session->current_repo);
-	fs::path objects_dir = repo_path / MARKNAME / "objects";
-	fs::create_directories(objects_dir);
-
-	fs::path commit_file = objects_dir / commit_id;
-	try {
-		ofstream outfile(commit_file, ios::binary);
-		if (!outfile.is_open()) {
-			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
-							  "Failed to create commit file");
-			return false;
-		}
-		outfile.write(reinterpret_cast<const char *>(commit_data.data()), commit_data.size());
-		outfile.close();
-	} catch (const exception &e) {
+	// 将commit保存到远程仓库，写完整后再出现在对象目录中
+	fs::path commit_file = session->repo->objectPath(commit_id);
+	if (!FileSystemUtils::replaceFile(commit_file, commit_data.data(), commit_data.size())) {
 		sendErrorResponse(client_socket, StatusCode::SERVER_ERROR, "Failed to write commit data");
 		return false;
 	}
@@ -1039,19 +1226,46 @@ bool Server::handlePushObjectDataCompressed(int client_socket, shared_ptr<Client
 									object_payload.compressed_size);
 
 	// 验证数据校验和
-	uint32_t calculated_checksum = ProtocolMessage::calculateCRC32(object_data);
+	uint32_t calculated_checksum = msg.checksumOf(object_data);
 	if (calculated_checksum != object_payload.checksum) {
 		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
 						  "Object data checksum mismatch");
 		return false;
 	}
-	fs::path local_repo_path = fs::current_path() / session->current_repo;
+	fs::path local_repo_path = session->repo->root();
 	fs::create_directories(local_repo_path);
+	if (object_payload.operation_type != ARCHIVE_WHOLE) {
+		// 流式归档：每段数据到达后立即解压写出对象
+		if (!session->push_archive)
+			session->push_archive = make_unique<ArchiveExtractor>(local_repo_path, true);
+		if (!session->push_archive->feed(object_data.data(), object_data.size())) {
+			session->push_archive.reset();
+			sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+							  "Failed to extract object data");
+			return false;
+		}
+		if (object_payload.operation_type == ARCHIVE_STREAM_END) {
+			bool complete = session->push_archive->finish();
+			session->push_archive.reset();
+			if (!complete) {
+				sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+								  "Incomplete object archive");
+				return false;
+			}
+			// 迁移只移动读操作不会访问的平铺对象，加锁只避免与其他迁移或删除仓库交错
+			lock_guard<mutex> lock(session->repo->refs().lock());
+			impl_->repo_manager->migrateObjectLayout(session->current_repo);
+		}
+		return true;
+	}
 	bool extraction_success = CompressionUtils::extractCompressedArchive(
 		object_data, local_repo_path, [](int progress, const string &description) {
 			cout << "Extracting: " << progress << "% - " << description << "\r";
 			cout.flush();
 		});
+	// 旧版本客户端上传的是平铺布局的对象
+	lock_guard<mutex> lock(session->repo->refs().lock());
+	impl_->repo_manager->migrateObjectLayout(session->current_repo);
 	return 1;
 }
 
@@ -1094,7 +1308,7 @@ bool Server::handlePushObjectData(int client_socket, shared_ptr<ClientSession> s
 			object_payload.object_data_length);
 
 	// 验证数据校验和
-	uint32_t calculated_checksum = ProtocolMessage::calculateCRC32(object_data);
+	uint32_t calculated_checksum = msg.checksumOf(object_data);
 	if (calculated_checksum != object_payload.checksum) {
 		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
 						  "Object data checksum mismatch");
@@ -1102,26 +1316,13 @@ bool Server::handlePushObjectData(int client_socket, shared_ptr<ClientSession> s
 	}
 
 	// 将对象保存到远程仓库
-	fs::path repo_path = impl_->repo_manager->getRepositoryPath(session->current_repo);
-	fs::path objects_dir = repo_path / MARKNAME / "objects";
-	fs::create_directories(objects_dir);
-
-	fs::path object_file = objects_dir / object_id;
+	fs::path object_file = session->repo->objectPath(object_id);
 	// 如果对象已存在，跳过
 	if (fs::exists(object_file)) {
 		return true;
 	}
 
-	try {
-		ofstream outfile(object_file, ios::binary);
-		if (!outfile.is_open()) {
-			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
-							  "Failed to create object file");
-			return false;
-		}
-		outfile.write(reinterpret_cast<const char *>(object_data.data()), object_data.size());
-		outfile.close();
-	} catch (const exception &e) {
+	if (!FileSystemUtils::replaceFile(object_file, object_data.data(), object_data.size())) {
 		sendErrorResponse(client_socket, StatusCode::SERVER_ERROR, "Failed to write object data");
 		return false;
 	}
@@ -1181,25 +1382,28 @@ bool Server::handlePullCheckRequest(int client_socket, shared_ptr<ClientSession>
 			reinterpret_cast<const char *>(msg.payload.data() + sizeof(PullCheckRequestPayload)),
 			check_payload.local_head_length);
 	}
+	// 浅克隆客户端附带的边界提交
+	vector<string> boundaries;
+	size_t boundary_offset = sizeof(PullCheckRequestPayload) + check_payload.local_head_length;
+	if (msg.payload.size() >= boundary_offset + sizeof(uint32_t)) {
+		uint32_t boundary_count;
+		memcpy(&boundary_count, msg.payload.data() + boundary_offset, sizeof(boundary_count));
+		const uint8_t *raw = msg.payload.data() + boundary_offset + sizeof(boundary_count);
+		if (msg.payload.size() - boundary_offset - sizeof(boundary_count) <
+			(size_t)boundary_count * 20) {
+			sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+							  "Invalid shallow boundary data");
+			return false;
+		}
+		for (uint32_t i = 0; i < boundary_count; ++i)
+			boundaries.push_back(sha1_to_hex(raw + (size_t)i * 20));
+	}
 	cout << "pull check head " << local_head << endl;
 	// 获取远程仓库的HEAD
 	fs::path repo_path = impl_->repo_manager->getRepositoryPath(session->current_repo);
 	cout << "repo path " << repo_path.string() << endl;
-	string remote_head;
-	try {
-		fs::path remote_head_path = repo_path / MARKNAME / "HEAD";
-		cout << "remote_head_path " << remote_head_path.string() << endl;
-		if (fs::exists(remote_head_path)) {
-			ifstream head_file(remote_head_path);
-			if (head_file.is_open()) {
-				getline(head_file, remote_head);
-				head_file.close();
-			}
-		}
-	} catch (const exception &e) {
-		sendErrorResponse(client_socket, StatusCode::SERVER_ERROR, "Failed to read remote HEAD");
-		return false;
-	}
+	// 只读取一次 HEAD 快照，之后按快照计算和发送对象，传输期间不持有仓库锁
+	string remote_head = session->repo->head();
 
 	// 判断是否需要更新
 	bool has_updates = false;
@@ -1209,7 +1413,7 @@ bool Server::handlePullCheckRequest(int client_socket, shared_ptr<ClientSession>
 	if (remote_head != local_head) {
 		has_updates = true;
 		// 计算需要发送的提交数量
-		auto commits_head = CommitManager::commitsCount(remote_head, local_head);
+		auto commits_head = CommitManager::commitsCount(*session->repo, remote_head, local_head);
 		commits_count = commits_head.size();
 
 		if (commits_count > 0) {
@@ -1224,64 +1428,47 @@ bool Server::handlePullCheckRequest(int client_socket, shared_ptr<ClientSession>
 			vector<fs::path> files_to_send;
 			vector<fs::path> relative_paths;
 			// TODO package the required commits
-			for (auto &head : commits_head) {
-				fs::path commit_obj_path = repo_path / MARKNAME / "objects" / head;
-				// 需要添加head进去
-				files_to_send.push_back(commit_obj_path);
-				relative_paths.push_back(fs::path("objects") / head);
-				cout << "commit head " << head << endl;
-				if (fs::exists(commit_obj_path)) {
-					ifstream commit_file(commit_obj_path, ios::binary);
-					// 读取commit数据
-					if (commit_file.is_open()) {
-						vector<uint8_t> commit_data((istreambuf_iterator<char>(commit_file)), {});
-						commit_file.close();
-
-						// 发送commit数据
-						// auto commit_msg =
-						//	ProtocolMessage::createPullCommitData(remote_head, commit_data);
-						// if (!NetworkUtils::sendMessage(client_socket, commit_msg)) {
-						//	return false;
-						//}
-
-						// 添加压缩
-						try {
-							string commit_content = string(commit_data.begin(), commit_data.end());
-							Commit commit = CommitManager::deserializeCommit(remote_head + "\n" +
-																			 commit_content);
-
-							// 添加所有tree中的对象
-							for (const auto &tree_item : commit.tree) {
-								const string &object_id = tree_item.second;
-								fs::path obj_path = repo_path / MARKNAME / "objects" / object_id;
-								if (fs::exists(obj_path)) {
-									files_to_send.push_back(obj_path);
-									relative_paths.push_back(fs::path("objects") / object_id);
-								}
-							}
-						} catch (const exception &e) {
-							// 如果解析commit失败，发送错误返回
-						}
-					}
+			const fs::path &objects_dir = session->repo->objectsDir();
+			// 用可达性位图计算 远程HEAD可达 且 客户端HEAD不可达 的对象。
+			// 浅克隆客户端没有边界之前的历史，位图会把那些提交的对象也当作客户端已有，
+			// 因此有边界时只按提交逐个比较
+			vector<string> object_ids;
+			if (!boundaries.empty() ||
+				!ReachabilityIndex::missingObjects(objects_dir, remote_head, local_head,
+												   object_ids)) {
+				// 逐个提交收集相对父提交新增的对象，父提交的树客户端已有或随前一个提交发送
+				for (auto &head : commits_head) {
+					object_ids.push_back(head);
+					auto introduced = CommitManager::objectsIntroduced(objects_dir, head);
+					object_ids.insert(object_ids.end(), introduced.begin(), introduced.end());
 				}
 			}
+			for (const auto &object_id : object_ids) {
+				// 对象可能位于包文件中
+				if (!Objects::hasObject(*session->repo, object_id))
+					continue;
+				files_to_send.push_back(session->repo->objectPath(object_id));
+				relative_paths.push_back(FileSystemUtils::objectRelativePath(object_id));
+			}
 			if (!files_to_send.empty()) {
-				// 创建压缩归档
-				vector<uint8_t> compressed_archive;
-				uint32_t raw_size;
-				bool compression_success = CompressionUtils::createCompressedArchive(
-					relative_paths, repo_path / MARKNAME, compressed_archive, raw_size,
-					[](int progress, const string &description) {
-						// 服务器端可以记录日志，但不显示进度
-					});
-
-				if (compression_success) {
-					// 发送压缩的对象数据
-					auto compressed_msg = ProtocolMessage::createPullObjectDataCompressed(
-						0, compressed_archive, raw_size, files_to_send.size());
-					if (!NetworkUtils::sendMessage(client_socket, compressed_msg)) {
-						return false;
-					}
+				// 边压缩边发送流式归档
+				uint32_t file_count = static_cast<uint32_t>(files_to_send.size());
+				uint64_t raw_size = 0;
+				auto send_chunk = [&](const vector<uint8_t> &chunk) {
+					auto msg = ProtocolMessage::createPullObjectDataCompressed(
+						ARCHIVE_STREAM_CHUNK, chunk, 0, file_count, session->checksum);
+					return NetworkUtils::sendMessage(client_socket, msg);
+				};
+				if (!CompressionUtils::streamCompressedArchive(
+						relative_paths, repo_path / MARKNAME, send_chunk, raw_size, nullptr,
+						Objects::archiveLoader(objects_dir), session->compression,
+						session->checksum)) {
+					return false;
+				}
+				auto archive_end = ProtocolMessage::createPullObjectDataCompressed(
+					ARCHIVE_STREAM_END, {}, raw_size, file_count, session->checksum);
+				if (!NetworkUtils::sendMessage(client_socket, archive_end)) {
+					return false;
 				}
 			}
 			// 发送拉取完成响应
@@ -1315,20 +1502,41 @@ bool Server::handleCloneRequest(int client_socket, shared_ptr<ClientSession> ses
 		return false;
 	}
 
-	// 获取仓库路径
-	fs::path repo_path = impl_->repo_manager->getRepositoryPath(repo_name);
+	// 只读取一次 HEAD 快照，归档中的 HEAD 使用这个值而不是复制磁盘上的文件；
+	// 对象写入后不再改变，复制期间不持有仓库锁，推送交换 HEAD 不必等待克隆
+	auto repo = impl_->repo_manager->openRepository(repo_name);
+	fs::path repo_path = repo->root();
+	string head = repo->head();
 
 	// 统计仓库文件
 	vector<pair<string, fs::path>> files_to_clone;
 	uint64_t total_size = 0;
+	bool scanned = false;
+
+	// 同一HEAD的重复克隆直接发送缓存的克隆包；放不进缓存时复用构建时的遍历结果
+	auto &cache = *impl_->clone_cache;
+	if (cache.enabled()) {
+		string key = CloneBundleCache::key(repo_path, head, session->compression,
+										   session->checksum, session->plaintext);
+		auto bundle = cache.get(key, [&]() {
+			scanned = true;
+			return buildCloneBundle(repo_path, head, session, cache.budget(), &files_to_clone,
+									&total_size);
+		});
+		if (bundle)
+			return sendCloneBundle(client_socket, repo_name, *bundle);
+	}
 
 	try {
-		// 扫描仓库目录
-		for (auto &entry : fs::recursive_directory_iterator(repo_path)) {
-			if (entry.is_regular_file()) {
-				string relative_path = fs::relative(entry.path(), repo_path).generic_string();
-				files_to_clone.push_back({relative_path, entry.path()});
-				total_size += entry.file_size();
+		// 扫描仓库目录，构建克隆包时已经遍历过则直接使用其结果
+		if (!scanned) {
+			for (auto &entry : fs::recursive_directory_iterator(repo_path)) {
+				// 跳过推送中尚未写完的临时文件
+				if (entry.is_regular_file() && !FileSystemUtils::isTemporaryFile(entry.path())) {
+					string relative_path = fs::relative(entry.path(), repo_path).generic_string();
+					files_to_clone.push_back({relative_path, entry.path()});
+					total_size += entry.file_size();
+				}
 			}
 		}
 
@@ -1339,31 +1547,59 @@ bool Server::handleCloneRequest(int client_socket, shared_ptr<ClientSession> ses
 			return false;
 		}
 
-		// 尝试创建压缩归档发送所有文件
+		// 明文模式下大文件直接发送，其余文件创建压缩归档发送
 		vector<fs::path> relative_paths;
+		vector<pair<string, fs::path>> archived_files;
 		for (const auto &file_info : files_to_clone) {
+			error_code ec;
+			uint64_t size = fs::file_size(file_info.second, ec);
+			if (session->plaintext && !ec && size >= RAW_FILE_MIN_SIZE) {
+				if (!sendCloneFileRaw(client_socket, file_info.first, file_info.second, size)) {
+					return false;
+				}
+				continue;
+			}
 			relative_paths.push_back(file_info.first);
+			archived_files.push_back(file_info);
 		}
 
-		vector<uint8_t> compressed_archive;
-		uint32_t raw_size;
-		bool compression_success = CompressionUtils::createCompressedArchive(
-			relative_paths, repo_path, compressed_archive, raw_size,
-			[](int progress, const string &description) {
-				// 服务器端可以记录日志，但不显示进度
-			});
-
-		if (compression_success) {
-			// 发送压缩的归档数据
-			auto compressed_msg = ProtocolMessage::createCloneDataCompressed(
-				0, compressed_archive, raw_size, files_to_clone.size());
-			if (!NetworkUtils::sendMessage(client_socket, compressed_msg)) {
+		// 边压缩边发送流式归档
+		uint32_t file_count = static_cast<uint32_t>(archived_files.size());
+		uint64_t raw_size = 0;
+		bool chunk_sent = false;
+		auto send_chunk = [&](const vector<uint8_t> &chunk) {
+			chunk_sent = true;
+			auto msg = ProtocolMessage::createCloneDataCompressed(ARCHIVE_STREAM_CHUNK, chunk, 0,
+																  file_count, session->checksum);
+			return NetworkUtils::sendMessage(client_socket, msg);
+		};
+		if (relative_paths.empty()) {
+			// 所有文件都已直接发送
+		} else if (CompressionUtils::streamCompressedArchive(relative_paths, repo_path, send_chunk,
+															 raw_size, nullptr, headLoader(head),
+															 session->compression,
+															 session->checksum)) {
+			auto archive_end = ProtocolMessage::createCloneDataCompressed(
+				ARCHIVE_STREAM_END, {}, raw_size, file_count, session->checksum);
+			if (!NetworkUtils::sendMessage(client_socket, archive_end)) {
 				return false;
 			}
+		} else if (chunk_sent) {
+			// 已发送部分归档，无法再回退到逐个发送文件
+			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
+							  "Failed to send repository archive");
+			return false;
 		} else {
 			// 如果压缩失败，回退到逐个发送文件
-			for (const auto &file_info : files_to_clone) {
-				if (!sendCloneFile(client_socket, file_info.first, file_info.second)) {
+			for (const auto &file_info : archived_files) {
+				bool sent =
+					file_info.first == HEAD_RELATIVE_PATH
+						? NetworkUtils::sendMessage(
+							  client_socket, ProtocolMessage::createCloneFile(
+												 file_info.first,
+												 vector<uint8_t>(head.begin(), head.end()), 0))
+						: sendCloneFile(client_socket, file_info.first, file_info.second);
+				if (!sent) {
 					sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
 									  "Failed to send file: " + file_info.first);
 					return false;
@@ -1387,6 +1623,318 @@ bool Server::handleCloneRequest(int client_socket, shared_ptr<ClientSession> ses
 	}
 }
 
+shared_ptr<const CloneBundle> Server::buildCloneBundle(const fs::path &repo_path,
+													   const string &head,
+													   shared_ptr<ClientSession> session,
+													   size_t budget,
+													   vector<pair<string, fs::path>> *scanned,
+													   uint64_t *scanned_size) {
+	auto bundle = make_shared<CloneBundle>();
+	vector<fs::path> relative_paths;
+	uint64_t archived_size = 0;
+	for (auto &entry : fs::recursive_directory_iterator(repo_path)) {
+		if (!entry.is_regular_file() || FileSystemUtils::isTemporaryFile(entry.path()))
+			continue;
+		string relative_path = fs::relative(entry.path(), repo_path).generic_string();
+		uint64_t size = entry.file_size();
+		bundle->file_count++;
+		bundle->total_size += size;
+		if (scanned)
+			scanned->push_back({relative_path, entry.path()});
+		if (session->plaintext && size >= RAW_FILE_MIN_SIZE) {
+			bundle->raw_files.push_back({relative_path, entry.path(), size});
+			continue;
+		}
+		relative_paths.push_back(relative_path);
+		archived_size += size;
+	}
+	if (scanned_size)
+		*scanned_size = bundle->total_size;
+	// 压缩后的大小未知，按原始大小判断是否放得进缓存
+	if (archived_size > budget)
+		return nullptr;
+
+	if (relative_paths.empty())
+		return bundle;
+
+	uint32_t file_count = static_cast<uint32_t>(relative_paths.size());
+	uint64_t raw_size = 0;
+	auto keep_chunk = [&](const vector<uint8_t> &chunk) {
+		auto msg = ProtocolMessage::createCloneDataCompressed(ARCHIVE_STREAM_CHUNK, chunk, 0,
+															  file_count, session->checksum);
+		bundle->frames.push_back(msg.serialize());
+		return true;
+	};
+	if (!CompressionUtils::streamCompressedArchive(relative_paths, repo_path, keep_chunk, raw_size,
+												   nullptr, headLoader(head), session->compression,
+												   session->checksum))
+		return nullptr;
+	auto archive_end = ProtocolMessage::createCloneDataCompressed(
+		ARCHIVE_STREAM_END, {}, raw_size, file_count, session->checksum);
+	bundle->frames.push_back(archive_end.serialize());
+	return bundle;
+}
+
+bool Server::sendCloneBundle(int client_socket, const string &repo_name,
+							 const CloneBundle &bundle) {
+	auto start_msg =
+		ProtocolMessage::createCloneDataStart(repo_name, bundle.file_count, bundle.total_size);
+	if (!NetworkUtils::sendMessage(client_socket, start_msg)) {
+		return false;
+	}
+	for (const auto &file : bundle.raw_files) {
+		if (!sendCloneFileRaw(client_socket, file.relative_path, file.path, file.size)) {
+			return false;
+		}
+	}
+	for (const auto &frame : bundle.frames) {
+		if (!NetworkUtils::sendData(client_socket, frame.data(), frame.size())) {
+			return false;
+		}
+	}
+
+	auto end_msg = ProtocolMessage::createCloneDataEnd();
+	if (!NetworkUtils::sendMessage(client_socket, end_msg)) {
+		return false;
+	}
+	auto response = ProtocolMessage::createStringMessage(MessageType::CLONE_RESPONSE,
+														 "Clone completed: " + repo_name);
+	return NetworkUtils::sendMessage(client_socket, response);
+}
+
+// 浅克隆请求处理：只发送 HEAD、边界文件和最近 depth 个提交需要的对象，不发送服务器的索引和配置
+bool Server::handleShallowCloneRequest(int client_socket, shared_ptr<ClientSession> session,
+									   const ProtocolMessage &msg) {
+	if (!session->authenticated) {
+		sendErrorResponse(client_socket, StatusCode::AUTH_REQUIRED, "Authentication required");
+		return false;
+	}
+
+	if (msg.payload.size() < sizeof(ShallowCloneRequestPayload)) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+						  "Invalid shallow clone request");
+		return false;
+	}
+	ShallowCloneRequestPayload request;
+	memcpy(&request, msg.payload.data(), sizeof(ShallowCloneRequestPayload));
+	if (msg.payload.size() < sizeof(ShallowCloneRequestPayload) + request.repo_name_length ||
+		request.depth == 0) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+						  "Invalid shallow clone request");
+		return false;
+	}
+	string repo_name(
+		reinterpret_cast<const char *>(msg.payload.data() + sizeof(ShallowCloneRequestPayload)),
+		request.repo_name_length);
+
+	if (repo_name.empty() || !impl_->repo_manager->repositoryExists(repo_name)) {
+		sendErrorResponse(client_socket, StatusCode::REPO_NOT_FOUND, "Repository not found");
+		return false;
+	}
+
+	// 按 HEAD 快照收集和发送对象，传输期间不持有仓库锁
+	auto repo = impl_->repo_manager->openRepository(repo_name);
+	string head = repo->head();
+
+	try {
+		// 归档路径相对仓库根目录；HEAD 和边界文件由 loader 生成，对象可能位于包文件中
+		vector<fs::path> relative_paths;
+		uint64_t total_size = 0;
+		string boundary;
+		if (!head.empty()) {
+			auto commits = repo->graph().history(head, "", request.depth);
+			vector<string> object_ids;
+			if (!Shallow::collectObjects(repo->objectsDir(), "", commits, object_ids, boundary)) {
+				sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
+								  "Failed to collect objects for shallow clone");
+				return false;
+			}
+			set<string> seen;
+			for (const auto &id : object_ids) {
+				ObjectInfo info;
+				if (!seen.insert(id).second || !Objects::objectInfo(*repo, id, info))
+					continue;
+				relative_paths.push_back(fs::path(MARKNAME) /
+										 FileSystemUtils::objectRelativePath(id));
+				total_size += info.size;
+			}
+			relative_paths.push_back(HEAD_RELATIVE_PATH);
+			total_size += head.size();
+		}
+		fs::path shallow_path = fs::path(MARKNAME) / "shallow";
+		string shallow_data = boundary.empty() ? string() : boundary + "\n";
+		if (!shallow_data.empty()) {
+			relative_paths.push_back(shallow_path);
+			total_size += shallow_data.size();
+		}
+		auto objects = Objects::archiveLoader(repo->objectsDir());
+		auto head_loader = headLoader(head);
+		auto loader = [&](const fs::path &relative, vector<uint8_t> &data) {
+			if (relative == shallow_path) {
+				data.assign(shallow_data.begin(), shallow_data.end());
+				return true;
+			}
+			return head_loader(relative, data) || objects(relative, data);
+		};
+
+		// 把归档压缩成克隆数据消息，交给 emit 发送或放入克隆包
+		uint32_t file_count = static_cast<uint32_t>(relative_paths.size());
+		auto compress = [&](const function<bool(const ProtocolMessage &)> &emit) {
+			if (relative_paths.empty())
+				return true;
+			uint64_t raw_size = 0;
+			auto sink = [&](const vector<uint8_t> &chunk) {
+				return emit(ProtocolMessage::createCloneDataCompressed(
+					ARCHIVE_STREAM_CHUNK, chunk, 0, file_count, session->checksum));
+			};
+			if (!CompressionUtils::streamCompressedArchive(relative_paths, repo->root(), sink,
+														   raw_size, nullptr, loader,
+														   session->compression,
+														   session->checksum))
+				return false;
+			return emit(ProtocolMessage::createCloneDataCompressed(
+				ARCHIVE_STREAM_END, {}, raw_size, file_count, session->checksum));
+		};
+
+		// CI 反复浅克隆同一 HEAD，能放进缓存时按深度缓存克隆包
+		auto &cache = *impl_->clone_cache;
+		if (cache.enabled() && total_size <= cache.budget()) {
+			string key =
+				CloneBundleCache::key(repo->root(), head, session->compression, session->checksum,
+									  session->plaintext, request.depth);
+			auto bundle = cache.get(key, [&]() -> shared_ptr<const CloneBundle> {
+				auto built = make_shared<CloneBundle>();
+				built->file_count = file_count;
+				built->total_size = total_size;
+				bool ok = compress([&](const ProtocolMessage &frame) {
+					built->frames.push_back(frame.serialize());
+					return true;
+				});
+				return ok ? built : nullptr;
+			});
+			if (bundle)
+				return sendCloneBundle(client_socket, repo_name, *bundle);
+		}
+
+		auto start_msg = ProtocolMessage::createCloneDataStart(repo_name, file_count, total_size);
+		if (!NetworkUtils::sendMessage(client_socket, start_msg)) {
+			return false;
+		}
+		bool chunk_sent = false;
+		bool ok = compress([&](const ProtocolMessage &frame) {
+			chunk_sent = true;
+			return NetworkUtils::sendMessage(client_socket, frame);
+		});
+		if (!ok) {
+			if (chunk_sent) {
+				return false;
+			}
+			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
+							  "Failed to send repository archive");
+			return false;
+		}
+		auto end_msg = ProtocolMessage::createCloneDataEnd();
+		if (!NetworkUtils::sendMessage(client_socket, end_msg)) {
+			return false;
+		}
+		auto response = ProtocolMessage::createStringMessage(MessageType::CLONE_RESPONSE,
+															 "Clone completed: " + repo_name);
+		return NetworkUtils::sendMessage(client_socket, response);
+	} catch (const exception &e) {
+		sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
+						  "Clone failed: " + string(e.what()));
+		return false;
+	}
+}
+
+// 加深请求处理：从每个边界提交的父提交开始再发送 depth 个提交，返回新的边界
+bool Server::handleDeepenRequest(int client_socket, shared_ptr<ClientSession> session,
+								 const ProtocolMessage &msg) {
+	if (!session->authenticated) {
+		sendErrorResponse(client_socket, StatusCode::AUTH_REQUIRED, "Authentication required");
+		return false;
+	}
+
+	if (session->current_repo.empty()) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "No repository selected");
+		return false;
+	}
+
+	if (msg.payload.size() < sizeof(DeepenRequestPayload)) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "Invalid deepen request");
+		return false;
+	}
+	DeepenRequestPayload request;
+	memcpy(&request, msg.payload.data(), sizeof(DeepenRequestPayload));
+	if (msg.payload.size() <
+			sizeof(DeepenRequestPayload) + (size_t)request.boundary_count * 20 ||
+		request.depth == 0) {
+		sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST, "Invalid deepen request");
+		return false;
+	}
+
+	const RepoContext &repo = *session->repo;
+
+	// 边界提交的整棵树客户端已经有了，更早的提交只需要相对子提交变化的对象
+	const unsigned char *raw = msg.payload.data() + sizeof(DeepenRequestPayload);
+	vector<string> object_ids;
+	vector<string> boundaries;
+	uint32_t commits_count = 0;
+	for (uint32_t i = 0; i < request.boundary_count; ++i) {
+		string id = sha1_to_hex(raw + (size_t)i * 20);
+		auto c = CommitManager::readCommit(repo.objectsDir(), id, false);
+		if (!c) {
+			sendErrorResponse(client_socket, StatusCode::INVALID_REQUEST,
+							  "Unknown shallow boundary: " + id);
+			return false;
+		}
+		if (c->parent.empty())
+			continue;
+		auto commits = repo.graph().history(c->parent, "", request.depth);
+		string boundary;
+		if (!Shallow::collectObjects(repo.objectsDir(), c->root_tree, commits, object_ids,
+									 boundary)) {
+			sendErrorResponse(client_socket, StatusCode::SERVER_ERROR,
+							  "Failed to collect objects for deepen");
+			return false;
+		}
+		commits_count += static_cast<uint32_t>(commits.size());
+		if (!boundary.empty())
+			boundaries.push_back(boundary);
+	}
+
+	vector<fs::path> relative_paths;
+	set<string> seen;
+	for (const auto &id : object_ids) {
+		if (seen.insert(id).second && Objects::hasObject(repo, id))
+			relative_paths.push_back(FileSystemUtils::objectRelativePath(id));
+	}
+	if (!relative_paths.empty()) {
+		// 与拉取相同的流式归档，客户端按拉取的方式解压到对象目录
+		uint32_t file_count = static_cast<uint32_t>(relative_paths.size());
+		uint64_t raw_size = 0;
+		auto send_chunk = [&](const vector<uint8_t> &chunk) {
+			auto msg = ProtocolMessage::createPullObjectDataCompressed(
+				ARCHIVE_STREAM_CHUNK, chunk, 0, file_count, session->checksum);
+			return NetworkUtils::sendMessage(client_socket, msg);
+		};
+		if (!CompressionUtils::streamCompressedArchive(
+				relative_paths, repo.mgDir(), send_chunk, raw_size, nullptr,
+				Objects::archiveLoader(repo.objectsDir()), session->compression,
+				session->checksum)) {
+			return false;
+		}
+		auto archive_end = ProtocolMessage::createPullObjectDataCompressed(
+			ARCHIVE_STREAM_END, {}, raw_size, file_count, session->checksum);
+		if (!NetworkUtils::sendMessage(client_socket, archive_end)) {
+			return false;
+		}
+	}
+
+	auto response = ProtocolMessage::createDeepenResponse(commits_count, boundaries);
+	return NetworkUtils::sendMessage(client_socket, response);
+}
+
 // 处理日志请求
 bool Server::handleLogRequest(int client_socket, shared_ptr<ClientSession> session,
 							  const ProtocolMessage &msg) {
@@ -1414,61 +1962,32 @@ bool Server::handleLogRequest(int client_socket, shared_ptr<ClientSession> sessi
 		int max_count = static_cast<int>(log_payload.max_count);
 		bool line = log_payload.line != 0;
 
-		// 切换到仓库目录
-		fs::path repo_path = fs::path(Config::getInstance().root_path) / session->current_repo;
-		if (!fs::exists(repo_path / ".minigit")) {
+		const RepoContext &repo = *session->repo;
+		if (!fs::exists(repo.mgDir())) {
 			sendErrorResponse(client_socket, StatusCode::INVALID_REPO, "Repository not found");
 			return false;
 		}
 
-		// 备份当前工作目录
-		fs::path original_cwd = fs::current_path();
-		fs::current_path(repo_path);
-
 		vector<pair<string, string>> commits; // commit_id, message pairs
 
-		// 获取当前HEAD
-		fs::path head_path = ".minigit/HEAD"; // 相对路径，因为我们已经在repo目录了
-		if (!fs::exists(head_path)) {
-			// 没有提交历史
-			fs::current_path(original_cwd);
-			auto response = ProtocolMessage::createLogResponse(commits);
-			return NetworkUtils::sendMessage(client_socket, response);
-		}
-
-		string current_id;
-		ifstream head_file(head_path);
-		if (head_file.is_open()) {
-			getline(head_file, current_id);
-			head_file.close();
-		}
-
+		// 获取当前HEAD，为空表示没有提交历史
+		string current_id = repo.head();
 		if (current_id.empty()) {
-			// 没有提交历史
-			fs::current_path(original_cwd);
 			auto response = ProtocolMessage::createLogResponse(commits);
 			return NetworkUtils::sendMessage(client_socket, response);
 		}
 
-		// 遍历提交历史
-		string commit_id = current_id;
-		int count = 0;
-
-		while (!commit_id.empty() && (max_count == -1 || count < max_count)) {
-			// 使用CommitManager加载提交对象
-			auto commit_opt = CommitManager::loadCommit(commit_id);
+		// 按提交图遍历历史，只读取要返回的提交的信息
+		auto ids = repo.graph().history(current_id, "",
+										max_count == -1 ? SIZE_MAX : (size_t)max_count);
+		for (const auto &commit_id : ids) {
+			auto commit_opt = CommitManager::loadCommitHeader(repo, commit_id);
 			if (!commit_opt) {
 				break;
 			}
-
 			commits.push_back(make_pair(commit_id, commit_opt->message));
-			commit_id = commit_opt->parent;
-			count++;
 		}
 
-		// 恢复工作目录
-		fs::current_path(original_cwd);
-
 		// 发送响应
 		auto response = ProtocolMessage::createLogResponse(commits);
 		return NetworkUtils::sendMessage(client_socket, response);
@@ -1517,16 +2036,29 @@ void ServerCommand::parseConfig(const vector<string> &args) {
 		} else if (args[i] == "--cert" && i + 1 < args.size()) {
 			Config::getInstance().cert_path = args[i + 1];
 			i++;
+		} else if (args[i] == "--plaintext") {
+			Config::getInstance().allow_plaintext = true;
+		} else if (args[i] == "--workers" && i + 1 < args.size()) {
+			Config::getInstance().workers = stoi(args[i + 1]);
+			i++;
+		} else if (args[i] == "--clone-cache" && i + 1 < args.size()) {
+			Config::getInstance().clone_cache_mb = stoi(args[i + 1]);
+			i++;
 		}
 	}
 }
 
 void ServerCommand::printUsage() {
 	cout << "Usage: minigit server --port <port> --root <path> [--password <password>] [--cert "
-			"<cert_path>]\n";
+			"<cert_path>] [--plaintext] [--workers <n>] [--clone-cache <MB>]\n";
 	cout << "Options:\n";
 	cout << "  --port <port>         Server port (required)\n";
 	cout << "  --root <path>         Repository root path (required)\n";
 	cout << "  --password <password> Password for authentication\n";
 	cout << "  --cert <cert_path>    Path to RSA certificate directory\n";
+	cout << "  --plaintext           Allow clients to opt out of payload encryption (behind a\n"
+			"                        TLS-terminating proxy); such clones send large files\n"
+			"                        straight from disk\n";
+	cout << "  --workers <n>         Threads handling requests (default: 2x CPU cores, at least 8)\n";
+	cout << "  --clone-cache <MB>    Memory for prebuilt clone bundles (default: 256, 0 disables)\n";
 }
\ No newline at end of file
@@ -9,6 +9,7 @@ class ServerNetwork;
 class ServerAuth;
 class ServerRepository;
 class ServerGitOps;
+struct CloneBundle;
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -32,6 +33,8 @@ public:
 	void cleanupNetwork();
 	bool createServerSocket();
 	void handleClient(int client_socket);
+	bool handleMessage(int client_socket, shared_ptr<class ClientSession> session,
+	                   const ProtocolMessage &msg);
 
 	// 认证和会话管理 - 委托给 ServerAuth 模块
 	bool handleAuthRequest(int client_socket, shared_ptr<class ClientSession> session,
@@ -59,6 +62,10 @@ public:
 	                       const ProtocolMessage &msg);
 	bool handlePushCheckRequest(int client_socket, shared_ptr<class ClientSession> session,
 	                            const ProtocolMessage &msg);
+	bool handleCompressionRequest(int client_socket, shared_ptr<class ClientSession> session,
+	                              const ProtocolMessage &msg);
+	bool handlePushHaveRequest(int client_socket, shared_ptr<class ClientSession> session,
+	                           const ProtocolMessage &msg);
 	bool handlePushCommitData(int client_socket, shared_ptr<class ClientSession> session,
 	                          const ProtocolMessage &msg);
 	bool handlePushObjectData(int client_socket, shared_ptr<class ClientSession> session,
@@ -71,6 +78,10 @@ public:
 	                            const ProtocolMessage &msg);
 	bool handleCloneRequest(int client_socket, shared_ptr<class ClientSession> session,
 	                        const ProtocolMessage &msg);
+	bool handleShallowCloneRequest(int client_socket, shared_ptr<class ClientSession> session,
+	                               const ProtocolMessage &msg);
+	bool handleDeepenRequest(int client_socket, shared_ptr<class ClientSession> session,
+	                         const ProtocolMessage &msg);
 	bool handleLogRequest(int client_socket, shared_ptr<class ClientSession> session,
 	                      const ProtocolMessage &msg);
 
@@ -78,10 +89,25 @@ public:
 	bool validatePushCommitIsLatest(const string &repo_name, const string &client_commit_parent,
 	                                const string &current_remote_head);
 	bool sendCloneFile(int client_socket, const string &relative_path, const fs::path &file_path);
+	bool sendCloneFileRaw(int client_socket, const string &relative_path, const fs::path &file_path,
+	                      uint64_t file_size);
+	// 遍历仓库并压缩出克隆包，HEAD 使用快照 head；原始大小超过 budget 或压缩失败时返回nullptr。
+	// scanned 非空时保存遍历到的文件（相对路径、绝对路径）和总大小，返回nullptr后直接用于逐个发送
+	shared_ptr<const CloneBundle> buildCloneBundle(const fs::path &repo_path, const string &head,
+	                                               shared_ptr<class ClientSession> session,
+	                                               size_t budget,
+	                                               vector<pair<string, fs::path>> *scanned = nullptr,
+	                                               uint64_t *scanned_size = nullptr);
+	bool sendCloneBundle(int client_socket, const string &repo_name, const CloneBundle &bundle);
 
 private:
 	bool running_;
 
+#ifdef __linux__
+	void runEventLoop();
+#endif
+	void runThreadPerClient();
+
 #ifdef _WIN32
 	SOCKET server_socket_;
 #else
@@ -1,89 +1,507 @@
 #include "sha256.h"
+#include <cstdlib>
 #include <cstring> // for memcpy
 
-// SHA-1常量和辅助函数
-inline uint32_t SHA1::rotl(uint32_t x, int n) {
+#if !defined(MINIGIT_SHA1_NO_SIMD) &&                                                           \
+	(defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define MINIGIT_SHA1_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA1_TARGET_SHANI
+#define SHA1_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define SHA1_TARGET_SHANI __attribute__((target("sha,sse4.1,ssse3")))
+#define SHA1_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+// 单路压缩函数：对 count 个连续的64字节块更新状态
+using CompressFn = void (*)(uint32_t state[5], const unsigned char *blocks, size_t count);
+
+inline uint32_t rotl(uint32_t x, int n) {
 	return (x << n) | (x >> (32 - n));
 }
 
-inline uint32_t SHA1::f(int t, uint32_t b, uint32_t c, uint32_t d) {
-	if (t < 20)
-		return (b & c) | ((~b) & d);
-	if (t < 40)
-		return b ^ c ^ d;
-	if (t < 60)
-		return (b & c) | (b & d) | (c & d);
-	return b ^ c ^ d;
+inline uint32_t load_be32(const unsigned char *p) {
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
 }
 
-inline uint32_t SHA1::k(int t) {
-	if (t < 20)
-		return 0x5A827999;
-	if (t < 40)
-		return 0x6ED9EBA1;
-	if (t < 60)
-		return 0x8F1BBCDC;
-	return 0xCA62C1D6;
+inline void store_be32(unsigned char *p, uint32_t v) {
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
 }
 
-void SHA1::init() {
-	h[0] = 0x67452301;
-	h[1] = 0xEFCDAB89;
-	h[2] = 0x98BADCFE;
-	h[3] = 0x10325476;
-	h[4] = 0xC3D2E1F0;
-	buf_len = 0;
-	total_len = 0;
+// 标量实现：80轮按20轮一组展开，轮函数和常量在编译期确定，消息扩展使用16字循环缓冲
+#define SHA1_W(i)                                                                                  \
+	(w[(i) & 15] = rotl(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+#define SHA1_STEP(a, b, c, d, e, f, k, wi)                                                         \
+	do {                                                                                           \
+		e += rotl(a, 5) + (f) + (k) + (wi);                                                        \
+		b = rotl(b, 30);                                                                           \
+	} while (0)
+#define SHA1_F1(b, c, d) (d ^ (b & (c ^ d)))
+#define SHA1_F2(b, c, d) (b ^ c ^ d)
+#define SHA1_F3(b, c, d) ((b & c) | (d & (b | c)))
+
+void compress_scalar(uint32_t state[5], const unsigned char *blocks, size_t count) {
+	for (; count > 0; --count, blocks += 64) {
+		uint32_t w[16];
+		for (int i = 0; i < 16; i++)
+			w[i] = load_be32(blocks + i * 4);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+		// 每次5轮，通过变量轮换避免寄存器间的搬移
+		for (int i = 0; i < 15; i += 5) {
+			SHA1_STEP(a, b, c, d, e, SHA1_F1(b, c, d), 0x5A827999, w[i]);
+			SHA1_STEP(e, a, b, c, d, SHA1_F1(a, b, c), 0x5A827999, w[i + 1]);
+			SHA1_STEP(d, e, a, b, c, SHA1_F1(e, a, b), 0x5A827999, w[i + 2]);
+			SHA1_STEP(c, d, e, a, b, SHA1_F1(d, e, a), 0x5A827999, w[i + 3]);
+			SHA1_STEP(b, c, d, e, a, SHA1_F1(c, d, e), 0x5A827999, w[i + 4]);
+		}
+		SHA1_STEP(a, b, c, d, e, SHA1_F1(b, c, d), 0x5A827999, w[15]);
+		SHA1_STEP(e, a, b, c, d, SHA1_F1(a, b, c), 0x5A827999, SHA1_W(16));
+		SHA1_STEP(d, e, a, b, c, SHA1_F1(e, a, b), 0x5A827999, SHA1_W(17));
+		SHA1_STEP(c, d, e, a, b, SHA1_F1(d, e, a), 0x5A827999, SHA1_W(18));
+		SHA1_STEP(b, c, d, e, a, SHA1_F1(c, d, e), 0x5A827999, SHA1_W(19));
+
+		for (int i = 20; i < 40; i += 5) {
+			SHA1_STEP(a, b, c, d, e, SHA1_F2(b, c, d), 0x6ED9EBA1, SHA1_W(i));
+			SHA1_STEP(e, a, b, c, d, SHA1_F2(a, b, c), 0x6ED9EBA1, SHA1_W(i + 1));
+			SHA1_STEP(d, e, a, b, c, SHA1_F2(e, a, b), 0x6ED9EBA1, SHA1_W(i + 2));
+			SHA1_STEP(c, d, e, a, b, SHA1_F2(d, e, a), 0x6ED9EBA1, SHA1_W(i + 3));
+			SHA1_STEP(b, c, d, e, a, SHA1_F2(c, d, e), 0x6ED9EBA1, SHA1_W(i + 4));
+		}
+		for (int i = 40; i < 60; i += 5) {
+			SHA1_STEP(a, b, c, d, e, SHA1_F3(b, c, d), 0x8F1BBCDC, SHA1_W(i));
+			SHA1_STEP(e, a, b, c, d, SHA1_F3(a, b, c), 0x8F1BBCDC, SHA1_W(i + 1));
+			SHA1_STEP(d, e, a, b, c, SHA1_F3(e, a, b), 0x8F1BBCDC, SHA1_W(i + 2));
+			SHA1_STEP(c, d, e, a, b, SHA1_F3(d, e, a), 0x8F1BBCDC, SHA1_W(i + 3));
+			SHA1_STEP(b, c, d, e, a, SHA1_F3(c, d, e), 0x8F1BBCDC, SHA1_W(i + 4));
+		}
+		for (int i = 60; i < 80; i += 5) {
+			SHA1_STEP(a, b, c, d, e, SHA1_F2(b, c, d), 0xCA62C1D6, SHA1_W(i));
+			SHA1_STEP(e, a, b, c, d, SHA1_F2(a, b, c), 0xCA62C1D6, SHA1_W(i + 1));
+			SHA1_STEP(d, e, a, b, c, SHA1_F2(e, a, b), 0xCA62C1D6, SHA1_W(i + 2));
+			SHA1_STEP(c, d, e, a, b, SHA1_F2(d, e, a), 0xCA62C1D6, SHA1_W(i + 3));
+			SHA1_STEP(b, c, d, e, a, SHA1_F2(c, d, e), 0xCA62C1D6, SHA1_W(i + 4));
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
 }
 
-void SHA1::process_block(const unsigned char *block) {
-	uint32_t w[80];
+#ifdef MINIGIT_SHA1_X86
 
-	// 将64字节的输入分解为16个32位字
-	for (int i = 0; i < 16; i++) {
-		w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) |
-			   block[i * 4 + 3];
+// SHA-NI实现：每条 sha1rnds4 指令完成4轮
+#define SHA1NI_ROUNDS4(Ein, Eout, M0, M1, M2, M3, F)                                               \
+	Ein = _mm_sha1nexte_epu32(Ein, M0);                                                            \
+	Eout = abcd;                                                                                   \
+	M1 = _mm_sha1msg2_epu32(M1, M0);                                                               \
+	abcd = _mm_sha1rnds4_epu32(abcd, Ein, F);                                                      \
+	M3 = _mm_sha1msg1_epu32(M3, M0);                                                               \
+	M2 = _mm_xor_si128(M2, M0)
+
+SHA1_TARGET_SHANI void compress_shani(uint32_t state[5], const unsigned char *blocks,
+									  size_t count) {
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+	__m128i e1, m0, m1, m2, m3;
+
+	for (; count > 0; --count, blocks += 64) {
+		const __m128i abcd_save = abcd;
+		const __m128i e0_save = e0;
+
+		// 0-3
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 0)), mask);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		// 4-7
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+
+		// 8-11
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 32)), mask);
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+
+		// 12-15
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 48)), mask);
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		m0 = _mm_sha1msg2_epu32(m0, m3);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m2 = _mm_sha1msg1_epu32(m2, m3);
+		m1 = _mm_xor_si128(m1, m3);
+
+		// 16-63：消息寄存器轮换，E寄存器交替
+		SHA1NI_ROUNDS4(e0, e1, m0, m1, m2, m3, 0);
+		SHA1NI_ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+		SHA1NI_ROUNDS4(e0, e1, m2, m3, m0, m1, 1);
+		SHA1NI_ROUNDS4(e1, e0, m3, m0, m1, m2, 1);
+		SHA1NI_ROUNDS4(e0, e1, m0, m1, m2, m3, 1);
+		SHA1NI_ROUNDS4(e1, e0, m1, m2, m3, m0, 1);
+		SHA1NI_ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+		SHA1NI_ROUNDS4(e1, e0, m3, m0, m1, m2, 2);
+		SHA1NI_ROUNDS4(e0, e1, m0, m1, m2, m3, 2);
+		SHA1NI_ROUNDS4(e1, e0, m1, m2, m3, m0, 2);
+		SHA1NI_ROUNDS4(e0, e1, m2, m3, m0, m1, 2);
+		SHA1NI_ROUNDS4(e1, e0, m3, m0, m1, m2, 3);
+
+		// 64-79：消息扩展已接近完成，逐步去掉多余的计算
+		e0 = _mm_sha1nexte_epu32(e0, m0);
+		e1 = abcd;
+		m1 = _mm_sha1msg2_epu32(m1, m0);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+		m3 = _mm_sha1msg1_epu32(m3, m0);
+		m2 = _mm_xor_si128(m2, m0);
+
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		m2 = _mm_sha1msg2_epu32(m2, m1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		m3 = _mm_xor_si128(m3, m1);
+
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		m3 = _mm_sha1msg2_epu32(m3, m2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		e1 = _mm_sha1nexte_epu32(e1, m3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
 	}
 
-	// 扩展到80个字
-	for (int i = 16; i < 80; i++) {
-		w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+// AVX2多路实现：8条独立数据流各处理一个块，状态按 [字][路] 排列
+#define SHA1X8_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+SHA1_TARGET_AVX2 void compress_avx2_x8(uint32_t state[5][8], const unsigned char *const blocks[8]) {
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12,
+										  13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i w[16];
+	for (int i = 0; i < 16; i++) {
+		uint32_t lane[8];
+		for (int l = 0; l < 8; l++)
+			memcpy(&lane[l], blocks[l] + i * 4, 4);
+		w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)lane), bswap);
 	}
 
-	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	__m256i a = _mm256_loadu_si256((const __m256i *)state[0]);
+	__m256i b = _mm256_loadu_si256((const __m256i *)state[1]);
+	__m256i c = _mm256_loadu_si256((const __m256i *)state[2]);
+	__m256i d = _mm256_loadu_si256((const __m256i *)state[3]);
+	__m256i e = _mm256_loadu_si256((const __m256i *)state[4]);
+	const __m256i a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+
+	for (int t = 0; t < 80; t++) {
+		__m256i wt;
+		if (t < 16) {
+			wt = w[t];
+		} else {
+			wt = _mm256_xor_si256(_mm256_xor_si256(w[(t + 13) & 15], w[(t + 8) & 15]),
+								  _mm256_xor_si256(w[(t + 2) & 15], w[t & 15]));
+			wt = SHA1X8_ROTL(wt, 1);
+			w[t & 15] = wt;
+		}
+
+		__m256i f, k;
+		if (t < 20) {
+			f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+			k = _mm256_set1_epi32(0x5A827999);
+		} else if (t < 40) {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32(0x6ED9EBA1);
+		} else if (t < 60) {
+			f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+			k = _mm256_set1_epi32((int)0x8F1BBCDC);
+		} else {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32((int)0xCA62C1D6);
+		}
 
-	// 80轮主循环
-	for (int i = 0; i < 80; i++) {
-		uint32_t temp = rotl(a, 5) + f(i, b, c, d) + e + w[i] + k(i);
+		__m256i temp = _mm256_add_epi32(_mm256_add_epi32(SHA1X8_ROTL(a, 5), f),
+										_mm256_add_epi32(_mm256_add_epi32(e, k), wt));
 		e = d;
 		d = c;
-		c = rotl(b, 30);
+		c = SHA1X8_ROTL(b, 30);
 		b = a;
 		a = temp;
 	}
 
-	h[0] += a;
-	h[1] += b;
-	h[2] += c;
-	h[3] += d;
-	h[4] += e;
+	_mm256_storeu_si256((__m256i *)state[0], _mm256_add_epi32(a, a0));
+	_mm256_storeu_si256((__m256i *)state[1], _mm256_add_epi32(b, b0));
+	_mm256_storeu_si256((__m256i *)state[2], _mm256_add_epi32(c, c0));
+	_mm256_storeu_si256((__m256i *)state[3], _mm256_add_epi32(d, d0));
+	_mm256_storeu_si256((__m256i *)state[4], _mm256_add_epi32(e, e0));
+}
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, (int)leaf, (int)subleaf);
+	for (int i = 0; i < 4; i++)
+		regs[i] = (uint32_t)r[i];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t xgetbv0() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // MINIGIT_SHA1_X86
+
+struct Backend {
+	const char *name = "scalar";
+	CompressFn compress = compress_scalar;
+	bool multi_buffer = false; // 批量接口是否使用AVX2多路实现
+};
+
+Backend detectBackend() {
+	Backend backend;
+#ifdef MINIGIT_SHA1_X86
+	uint32_t r[4];
+	cpuid(0, 0, r);
+	uint32_t max_leaf = r[0];
+	bool has_shani = false, has_avx2 = false;
+	if (max_leaf >= 7) {
+		cpuid(1, 0, r);
+		bool ssse3 = (r[2] >> 9) & 1;
+		bool sse41 = (r[2] >> 19) & 1;
+		bool osxsave = (r[2] >> 27) & 1;
+		bool avx = (r[2] >> 28) & 1;
+		cpuid(7, 0, r);
+		has_shani = ((r[1] >> 29) & 1) && ssse3 && sse41;
+		// AVX2还需要操作系统保存YMM寄存器状态
+		has_avx2 = ((r[1] >> 5) & 1) && avx && osxsave && (xgetbv0() & 0x6) == 0x6;
+	}
+
+	const char *forced = getenv("MINIGIT_SHA1");
+	string choice = forced ? forced : "";
+	if (choice == "scalar") {
+		return backend;
+	}
+	if (has_shani && (choice.empty() || choice == "shani")) {
+		backend.name = "shani";
+		backend.compress = compress_shani;
+	} else if (has_avx2 && (choice.empty() || choice == "avx2")) {
+		backend.name = "avx2";
+		backend.multi_buffer = true;
+	}
+#endif
+	return backend;
+}
+
+const Backend &backend() {
+	static const Backend instance = detectBackend();
+	return instance;
+}
+
+string toHex(const unsigned char digest[20]) {
+	static const char *hex = "0123456789abcdef";
+	string r;
+	r.reserve(40);
+	for (int i = 0; i < 20; ++i) {
+		r.push_back(hex[digest[i] >> 4]);
+		r.push_back(hex[digest[i] & 0xF]);
+	}
+	return r;
+}
+
+const uint32_t SHA1_IV[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+/**
+ * 多路计算中的单条数据流
+ * 完整块直接引用原始数据，最后不足一块的部分和填充放在 tail 中
+ */
+struct Lane {
+	const unsigned char *data = nullptr;
+	size_t full_blocks = 0;
+	size_t total_blocks = 0;
+	size_t next = 0;
+	size_t index = 0; // 对应的输入下标
+	unsigned char tail[128];
+
+	void reset(const vector<unsigned char> &buffer, size_t input_index) {
+		data = buffer.data();
+		full_blocks = buffer.size() / 64;
+		size_t rest = buffer.size() % 64;
+		size_t tail_blocks = rest + 9 > 64 ? 2 : 1;
+		memset(tail, 0, sizeof(tail));
+		if (rest > 0)
+			memcpy(tail, data + full_blocks * 64, rest);
+		tail[rest] = 0x80;
+		uint64_t bits = (uint64_t)buffer.size() * 8;
+		for (int i = 0; i < 8; i++)
+			tail[tail_blocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+		total_blocks = full_blocks + tail_blocks;
+		next = 0;
+		index = input_index;
+	}
+
+	const unsigned char *block(size_t i) const {
+		return i < full_blocks ? data + i * 64 : tail + (i - full_blocks) * 64;
+	}
+};
+
+void laneDigest(const uint32_t state[5], unsigned char out[20]) {
+	for (int i = 0; i < 5; i++)
+		store_be32(out + i * 4, state[i]);
+}
+
+#ifdef MINIGIT_SHA1_X86
+// AVX2多路调度：某一路结束后立即换入下一个输入，活跃路数过少时退回单路计算
+void hashMultiBuffer(const vector<vector<unsigned char>> &buffers, vector<string> &results) {
+	constexpr int LANES = 8;
+	static const unsigned char zero_block[64] = {0};
+	Lane lanes[LANES];
+	bool active[LANES] = {false};
+	uint32_t state[5][LANES];
+	size_t next_input = 0;
+
+	auto refill = [&](int l) {
+		active[l] = false;
+		if (next_input < buffers.size()) {
+			lanes[l].reset(buffers[next_input], next_input);
+			for (int i = 0; i < 5; i++)
+				state[i][l] = SHA1_IV[i];
+			active[l] = true;
+			next_input++;
+		}
+	};
+	for (int l = 0; l < LANES; l++)
+		refill(l);
+
+	while (true) {
+		int active_count = 0;
+		for (int l = 0; l < LANES; l++)
+			active_count += active[l] ? 1 : 0;
+		if (active_count == 0)
+			break;
+
+		if (active_count <= 2 && next_input >= buffers.size()) {
+			// 剩余数据流太少，单路计算更快
+			for (int l = 0; l < LANES; l++) {
+				if (!active[l])
+					continue;
+				uint32_t s[5];
+				for (int i = 0; i < 5; i++)
+					s[i] = state[i][l];
+				Lane &lane = lanes[l];
+				if (lane.next < lane.full_blocks) {
+					compress_scalar(s, lane.block(lane.next), lane.full_blocks - lane.next);
+					lane.next = lane.full_blocks;
+				}
+				compress_scalar(s, lane.block(lane.next), lane.total_blocks - lane.next);
+				unsigned char digest[20];
+				laneDigest(s, digest);
+				results[lane.index] = toHex(digest);
+				active[l] = false;
+			}
+			break;
+		}
+
+		const unsigned char *blocks[LANES];
+		for (int l = 0; l < LANES; l++)
+			blocks[l] = active[l] ? lanes[l].block(lanes[l].next) : zero_block;
+		compress_avx2_x8(state, blocks);
+
+		for (int l = 0; l < LANES; l++) {
+			if (!active[l])
+				continue;
+			if (++lanes[l].next == lanes[l].total_blocks) {
+				uint32_t s[5];
+				for (int i = 0; i < 5; i++)
+					s[i] = state[i][l];
+				unsigned char digest[20];
+				laneDigest(s, digest);
+				results[lanes[l].index] = toHex(digest);
+				refill(l);
+			}
+		}
+	}
+}
+#endif
+
+// 批量接口中一次性读入内存的文件大小上限，更大的文件走流式计算
+constexpr uintmax_t BATCH_FILE_LIMIT = 1 << 20;
+
+} // namespace
+
+const char *SHA1::backendName() {
+	return backend().name;
+}
+
+void SHA1::init() {
+	memcpy(h, SHA1_IV, sizeof(h));
+	buf_len = 0;
+	total_len = 0;
+}
+
+void SHA1::process_blocks(const unsigned char *blocks, size_t count) {
+	backend().compress(h, blocks, count);
 }
 
 void SHA1::update(const unsigned char *data, size_t len) {
 	total_len += len;
 
-	// 处理缓冲区中的剩余数据
-	while (len > 0) {
+	// 先补齐缓冲区中的残留数据
+	if (buf_len > 0) {
 		size_t copy_len = min(len, 64 - buf_len);
 		memcpy(buf + buf_len, data, copy_len);
 		buf_len += copy_len;
 		data += copy_len;
 		len -= copy_len;
+		if (buf_len < 64)
+			return;
+		process_blocks(buf, 1);
+		buf_len = 0;
+	}
 
-		if (buf_len == 64) {
-			process_block(buf);
-			buf_len = 0;
-		}
+	// 完整的块直接从输入处理，不经过缓冲区复制
+	size_t full = len / 64;
+	if (full > 0) {
+		process_blocks(data, full);
+		data += full * 64;
+		len -= full * 64;
+	}
+
+	if (len > 0) {
+		memcpy(buf, data, len);
+		buf_len = len;
 	}
 }
 
@@ -93,17 +511,13 @@ void SHA1::finalize(unsigned char out[20]) {
 
 	// 如果剩余空间不足8字节存放长度，则填充到下一个块
 	if (buf_len > 56) {
-		while (buf_len < 64) {
-			buf[buf_len++] = 0;
-		}
-		process_block(buf);
+		memset(buf + buf_len, 0, 64 - buf_len);
+		process_blocks(buf, 1);
 		buf_len = 0;
 	}
 
 	// 填充0直到56字节
-	while (buf_len < 56) {
-		buf[buf_len++] = 0;
-	}
+	memset(buf + buf_len, 0, 56 - buf_len);
 
 	// 添加长度（以比特为单位）
 	uint64_t total_bits = total_len * 8;
@@ -112,15 +526,11 @@ void SHA1::finalize(unsigned char out[20]) {
 		total_bits >>= 8;
 	}
 
-	process_block(buf);
+	process_blocks(buf, 1);
 
 	// 输出结果
-	for (int i = 0; i < 5; i++) {
-		out[i * 4] = (h[i] >> 24) & 0xFF;
-		out[i * 4 + 1] = (h[i] >> 16) & 0xFF;
-		out[i * 4 + 2] = (h[i] >> 8) & 0xFF;
-		out[i * 4 + 3] = h[i] & 0xFF;
-	}
+	for (int i = 0; i < 5; i++)
+		store_be32(out + i * 4, h[i]);
 }
 
 string sha1_bytes(const vector<unsigned char> &data) {
@@ -129,20 +539,16 @@ string sha1_bytes(const vector<unsigned char> &data) {
 	s.update(data.data(), data.size());
 	unsigned char out[20];
 	s.finalize(out);
-
-	static const char *hex = "0123456789abcdef";
-	string r;
-	r.reserve(40);
-	for (int i = 0; i < 20; ++i) {
-		r.push_back(hex[out[i] >> 4]);
-		r.push_back(hex[out[i] & 0xF]);
-	}
-	return r;
+	return toHex(out);
 }
 
 string sha1_string(const string &str) {
-	vector<unsigned char> data(str.begin(), str.end());
-	return sha1_bytes(data);
+	SHA1 s;
+	s.init();
+	s.update(reinterpret_cast<const unsigned char *>(str.data()), str.size());
+	unsigned char out[20];
+	s.finalize(out);
+	return toHex(out);
 }
 
 string sha1_file(const fs::path &p) {
@@ -168,13 +574,78 @@ string sha1_file(const fs::path &p) {
 
 	unsigned char out[20];
 	s.finalize(out);
+	return toHex(out);
+}
 
-	static const char *hex = "0123456789abcdef";
-	string r;
-	r.reserve(40);
+vector<string> sha1_buffers(const vector<vector<unsigned char>> &buffers) {
+	vector<string> results(buffers.size());
+#ifdef MINIGIT_SHA1_X86
+	if (backend().multi_buffer && buffers.size() > 1) {
+		hashMultiBuffer(buffers, results);
+		return results;
+	}
+#endif
+	for (size_t i = 0; i < buffers.size(); ++i)
+		results[i] = sha1_bytes(buffers[i]);
+	return results;
+}
+
+vector<string> sha1_files(const vector<fs::path> &paths) {
+	vector<string> results(paths.size());
+	vector<vector<unsigned char>> small_files;
+	vector<size_t> small_index;
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		error_code ec;
+		uintmax_t size = fs::file_size(paths[i], ec);
+		if (ec)
+			continue;
+		try {
+			if (size > BATCH_FILE_LIMIT) {
+				results[i] = sha1_file(paths[i]);
+				continue;
+			}
+			ifstream f(paths[i], ios::binary);
+			if (!f.is_open())
+				continue;
+			vector<unsigned char> data(size);
+			f.read(reinterpret_cast<char *>(data.data()), size);
+			data.resize(f.gcount());
+			small_files.push_back(std::move(data));
+			small_index.push_back(i);
+		} catch (const exception &) {
+			// 读取失败的文件保持空结果
+		}
+	}
+
+	vector<string> small_results = sha1_buffers(small_files);
+	for (size_t i = 0; i < small_index.size(); ++i)
+		results[small_index[i]] = small_results[i];
+	return results;
+}
+
+string sha1_to_hex(const unsigned char raw[20]) {
+	return toHex(raw);
+}
+
+bool sha1_from_hex(const string &hex, unsigned char raw[20]) {
+	if (hex.size() != 40)
+		return false;
+	auto nibble = [](char c) -> int {
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	};
 	for (int i = 0; i < 20; ++i) {
-		r.push_back(hex[out[i] >> 4]);
-		r.push_back(hex[out[i] & 0xF]);
+		int hi = nibble(hex[2 * i]);
+		int lo = nibble(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		raw[i] = (unsigned char)((hi << 4) | lo);
 	}
-	return r;
-}
\ No newline at end of file
+	return true;
+}
@@ -5,6 +5,13 @@
 /**
  * SHA-1 哈希计算类
  * 高性能实现，针对大文件优化
+ *
+ * 压缩函数在首次使用时按CPU能力选择后端：
+ *   - x86 SHA扩展（SHA-NI）
+ *   - 标量展开实现（通用回退）
+ * 批量接口 sha1_buffers/sha1_files 在没有SHA-NI时使用AVX2同时计算8路独立数据流。
+ * 可通过环境变量 MINIGIT_SHA1=scalar|shani|avx2 强制指定后端（用于测试和基准对比），
+ * 编译时定义 MINIGIT_SHA1_NO_SIMD 可完全关闭SIMD路径。
  */
 class SHA1 {
 public:
@@ -12,18 +19,17 @@ public:
 	void update(const unsigned char *data, size_t len);
 	void finalize(unsigned char out[20]);
 
+	// 当前使用的压缩后端名称（"shani"、"avx2" 或 "scalar"）
+	static const char *backendName();
+
 private:
 	uint32_t h[5];
 	unsigned char buf[64];
 	size_t buf_len = 0;
 	uint64_t total_len = 0;
 
-	// 辅助函数
-	static inline uint32_t rotl(uint32_t x, int n);
-	static inline uint32_t f(int t, uint32_t b, uint32_t c, uint32_t d);
-	static inline uint32_t k(int t);
-
-	void process_block(const unsigned char *block);
+	// 连续处理多个64字节块
+	void process_blocks(const unsigned char *blocks, size_t count);
 };
 
 /**
@@ -41,6 +47,26 @@ string sha1_bytes(const vector<unsigned char> &data);
  */
 string sha1_file(const fs::path &p);
 
+/**
+ * 批量计算多个内存缓冲区的SHA-1哈希
+ * 结果顺序与输入一致；在支持AVX2的CPU上多路并行计算
+ */
+vector<string> sha1_buffers(const vector<vector<unsigned char>> &buffers);
+
+/**
+ * 批量计算多个文件的SHA-1哈希
+ * 小文件一次性读入后走多路并行路径，大文件仍使用流式处理；
+ * 无法读取的文件对应结果为空字符串
+ */
+vector<string> sha1_files(const vector<fs::path> &paths);
+
+/**
+ * 20字节原始摘要与40位十六进制字符串之间的转换
+ * sha1_from_hex 在输入不是合法的40位十六进制时返回false
+ */
+string sha1_to_hex(const unsigned char raw[20]);
+bool sha1_from_hex(const string &hex, unsigned char raw[20]);
+
 // 兼容性别名（保持向后兼容）
 using SHA256 = SHA1;
 
@@ -54,4 +80,4 @@ inline string sha256_bytes(const vector<unsigned char> &data) {
 
 inline string sha256_file(const fs::path &p) {
 	return sha1_file(p);
-}
\ No newline at end of file
+}
@@ -0,0 +1,58 @@
+#include "shallow.h"
+#include "commit.h"
+#include "filesystem_utils.h"
+#include "trees.h"
+
+vector<string> Shallow::read(const fs::path &mg_dir) {
+	vector<string> boundaries;
+	ifstream in(path(mg_dir));
+	string line;
+	while (getline(in, line)) {
+		while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+			line.pop_back();
+		if (!line.empty())
+			boundaries.push_back(line);
+	}
+	return boundaries;
+}
+
+bool Shallow::write(const fs::path &mg_dir, const vector<string> &boundaries) {
+	if (boundaries.empty()) {
+		error_code ec;
+		fs::remove(path(mg_dir), ec);
+		return !ec;
+	}
+	string data;
+	for (const auto &id : boundaries)
+		data += id + "\n";
+	return FileSystemUtils::replaceFile(path(mg_dir), data.data(), data.size());
+}
+
+bool Shallow::collectObjects(const fs::path &objects_dir, const string &known_root,
+							 const vector<string> &commits, vector<string> &ids,
+							 string &boundary) {
+	boundary.clear();
+	string child_root = known_root;
+	string oldest_parent;
+	for (const auto &id : commits) {
+		auto c = CommitManager::readCommit(objects_dir, id, false);
+		if (!c)
+			return false;
+		ids.push_back(id);
+		if (c->root_tree.empty()) {
+			// 旧格式的提交直接列出全部文件，无法按子树比较
+			c = CommitManager::readCommit(objects_dir, id, true);
+			if (!c)
+				return false;
+			for (const auto &kv : c->tree)
+				ids.push_back(kv.second);
+		} else if (!Trees::newObjects(objects_dir, child_root, c->root_tree, ids)) {
+			return false;
+		}
+		child_root = c->root_tree;
+		oldest_parent = c->parent;
+	}
+	if (!oldest_parent.empty())
+		boundary = commits.back();
+	return true;
+}
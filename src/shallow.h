@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * 浅克隆的边界
+ * MARKNAME/shallow 每行一个提交哈希：这些提交在本地存在，父提交和更早的历史没有传输。
+ * 遍历历史时读不到父提交对象就在边界处停止；加深历史后边界前移，历史完整时删除该文件
+ */
+class Shallow {
+public:
+	static fs::path path(const fs::path &mg_dir) { return mg_dir / "shallow"; }
+
+	// 不是浅克隆时返回空列表
+	static vector<string> read(const fs::path &mg_dir);
+	// boundaries 为空时删除边界文件
+	static bool write(const fs::path &mg_dir, const vector<string> &boundaries);
+
+	/**
+	 * 收集 commits（一段由新到旧的连续历史）需要传输的对象：提交对象、树对象和blob
+	 * known_root 为接收方已有的、commits[0] 子提交的根树，为空时收集 commits[0] 的整棵树；
+	 * 之后每个提交只收集与其子提交相比变化的子树，因此只传输历史中变化的对象。
+	 * 最旧的提交还有父提交时 boundary 为该提交，否则为空
+	 */
+	static bool collectObjects(const fs::path &objects_dir, const string &known_root,
+							   const vector<string> &commits, vector<string> &ids,
+							   string &boundary);
+};
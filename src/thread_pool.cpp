@@ -0,0 +1,169 @@
+#include "thread_pool.h"
+#include <cstdlib>
+
+namespace {
+// 当前线程在所属线程池中的队列编号，非工作线程为 SIZE_MAX
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_index = SIZE_MAX;
+} // namespace
+
+ThreadPool::ThreadPool(size_t worker_count) {
+	worker_count = max<size_t>(worker_count, 1);
+	for (size_t i = 0; i < worker_count; ++i) {
+		queues.push_back(make_unique<WorkQueue>());
+	}
+	for (size_t i = 0; i < worker_count; ++i) {
+		threads.emplace_back([this, i]() { workerLoop(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_cv.notify_all();
+	for (auto &t : threads) {
+		if (t.joinable())
+			t.join();
+	}
+}
+
+ThreadPool &ThreadPool::getInstance() {
+	static ThreadPool instance(defaultWorkerCount());
+	return instance;
+}
+
+size_t ThreadPool::defaultWorkerCount() {
+	if (const char *env = getenv("MINIGIT_THREADS")) {
+		long n = strtol(env, nullptr, 10);
+		if (n > 0)
+			return (size_t)n;
+	}
+	unsigned hw = thread::hardware_concurrency();
+	return hw > 0 ? hw : 1;
+}
+
+void ThreadPool::submit(Task task) {
+	size_t target = (current_pool == this) ? current_index
+										   : next_queue.fetch_add(1) % queues.size();
+	{
+		lock_guard<mutex> lock(queues[target]->m);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	{
+		lock_guard<mutex> lock(sleep_mutex);
+		queued++;
+	}
+	sleep_cv.notify_all();
+}
+
+bool ThreadPool::tryPop(size_t self, Task &task) {
+	if (queued.load() == 0)
+		return false;
+
+	// 优先从自己的队尾取任务（局部性更好）
+	if (self < queues.size()) {
+		WorkQueue &own = *queues[self];
+		lock_guard<mutex> lock(own.m);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// 从其他队列的队首窃取
+	size_t n = queues.size();
+	size_t start = (self < n) ? self + 1 : next_queue.load();
+	for (size_t k = 0; k < n; ++k) {
+		WorkQueue &victim = *queues[(start + k) % n];
+		lock_guard<mutex> lock(victim.m);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::runPending() {
+	Task task;
+	size_t self = (current_pool == this) ? current_index : SIZE_MAX;
+	if (!tryPop(self, task))
+		return false;
+	task();
+	return true;
+}
+
+void ThreadPool::waitFor(const function<bool()> &done) {
+	unique_lock<mutex> lock(sleep_mutex);
+	sleep_cv.wait(lock, [&]() { return done() || queued.load() > 0; });
+}
+
+void ThreadPool::notifyAll() {
+	{
+		lock_guard<mutex> lock(sleep_mutex);
+	}
+	sleep_cv.notify_all();
+}
+
+void ThreadPool::workerLoop(size_t id) {
+	current_pool = this;
+	current_index = id;
+	while (true) {
+		Task task;
+		if (tryPop(id, task)) {
+			task();
+			continue;
+		}
+		unique_lock<mutex> lock(sleep_mutex);
+		sleep_cv.wait(lock, [this]() { return stopping || queued.load() > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+TaskGroup::~TaskGroup() {
+	// 保证析构前所有任务都已结束（任务中引用了本对象）
+	if (pending.load() > 0) {
+		try {
+			wait();
+		} catch (...) {
+		}
+	}
+}
+
+void TaskGroup::spawn(ThreadPool::Task task) {
+	pending++;
+	// 计数归零后本对象可能立即析构，因此单独捕获线程池引用
+	pool.submit([this, &owner = pool, task = std::move(task)]() {
+		try {
+			task();
+		} catch (...) {
+			lock_guard<mutex> lock(error_mutex);
+			if (!error)
+				error = current_exception();
+		}
+		if (--pending == 0) {
+			owner.notifyAll();
+		}
+	});
+}
+
+void TaskGroup::wait() {
+	// 等待期间当前线程也参与执行任务
+	while (pending.load() > 0) {
+		if (pool.runPending())
+			continue;
+		pool.waitFor([this]() { return pending.load() == 0; });
+	}
+	if (error) {
+		exception_ptr e = error;
+		error = nullptr;
+		rethrow_exception(e);
+	}
+}
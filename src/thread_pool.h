@@ -0,0 +1,103 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * 工作窃取线程池
+ * 每个工作线程维护自己的任务双端队列：本线程从队尾取任务，空闲线程从其他队列的队首窃取。
+ * 工作线程数量由环境变量 MINIGIT_THREADS 指定，默认为 hardware_concurrency。
+ * 等待任务组的线程也会参与执行任务，因此在任务中再提交子任务不会造成死锁。
+ */
+class ThreadPool {
+public:
+	using Task = function<void()>;
+
+	explicit ThreadPool(size_t worker_count);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// 进程共享的线程池（首次使用时创建）
+	static ThreadPool &getInstance();
+
+	// 根据 MINIGIT_THREADS 和CPU核心数计算默认线程数
+	static size_t defaultWorkerCount();
+
+	size_t size() const { return threads.size(); }
+
+	// 提交任务：在工作线程内提交时放入本线程队列，否则轮流分配
+	void submit(Task task);
+
+	// 取出并执行一个任务，没有可执行任务时返回false
+	bool runPending();
+
+	// 阻塞直到 done() 为真或有新任务入队
+	void waitFor(const function<bool()> &done);
+
+	// 唤醒所有等待 waitFor 的线程
+	void notifyAll();
+
+private:
+	struct WorkQueue {
+		mutex m;
+		deque<Task> tasks;
+	};
+
+	vector<unique_ptr<WorkQueue>> queues;
+	vector<thread> threads;
+	atomic<size_t> queued{0};
+	atomic<size_t> next_queue{0};
+	mutex sleep_mutex;
+	condition_variable sleep_cv;
+	bool stopping = false;
+
+	bool tryPop(size_t self, Task &task);
+	void workerLoop(size_t id);
+};
+
+/**
+ * 任务组：跟踪一批任务（包括任务中派生的子任务）的完成情况
+ * wait() 返回前重新抛出任务中的第一个异常
+ */
+class TaskGroup {
+public:
+	explicit TaskGroup(ThreadPool &pool = ThreadPool::getInstance()) : pool(pool) {}
+	~TaskGroup();
+
+	void spawn(ThreadPool::Task task);
+	void wait();
+
+private:
+	ThreadPool &pool;
+	atomic<size_t> pending{0};
+	mutex error_mutex;
+	exception_ptr error;
+};
+
+/**
+ * 将 [0, count) 按 grain 大小分块并行执行 fn(begin, end)
+ */
+template <typename F> void parallelFor(size_t count, size_t grain, F &&fn) {
+	if (count == 0)
+		return;
+	grain = max<size_t>(grain, 1);
+	if (count <= grain) {
+		fn(size_t(0), count);
+		return;
+	}
+	TaskGroup group;
+	for (size_t begin = 0; begin < count; begin += grain) {
+		size_t end = min(count, begin + grain);
+		group.spawn([&fn, begin, end]() { fn(begin, end); });
+	}
+	group.wait();
+}
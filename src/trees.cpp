@@ -0,0 +1,217 @@
+#include "trees.h"
+#include "filesystem_utils.h"
+#include "objects.h"
+#include <cstring>
+
+namespace {
+const char TREE_MAGIC[4] = {'M', 'G', 'T', 1};
+
+enum TreeEntryKind : uint8_t {
+	TREE_ENTRY_BLOB = 1,
+	TREE_ENTRY_TREE = 2,
+};
+
+string joinPath(const string &prefix, const string &name) {
+	return prefix.empty() ? name : prefix + "/" + name;
+}
+
+// 把 [begin, end) 中（都以 prefix_len 长度的目录前缀开头）的文件写成一个树对象
+string storeRange(const fs::path &objects_dir, map<string, string>::const_iterator begin,
+				  map<string, string>::const_iterator end, size_t prefix_len) {
+	vector<TreeEntry> entries;
+	auto it = begin;
+	while (it != end) {
+		string_view rest = string_view(it->first).substr(prefix_len);
+		size_t slash = rest.find('/');
+		if (slash == string_view::npos) {
+			entries.push_back({string(rest), it->second, false});
+			++it;
+			continue;
+		}
+
+		// 同一子目录下的路径在有序映射中是连续的
+		string dir_prefix = it->first.substr(0, prefix_len + slash + 1);
+		auto sub_end = it;
+		while (sub_end != end && sub_end->first.compare(0, dir_prefix.size(), dir_prefix) == 0)
+			++sub_end;
+		string sub_id = storeRange(objects_dir, it, sub_end, dir_prefix.size());
+		entries.push_back({string(rest.substr(0, slash)), sub_id, true});
+		it = sub_end;
+	}
+
+	sort(entries.begin(), entries.end(),
+		 [](const TreeEntry &a, const TreeEntry &b) { return a.name < b.name; });
+	string body = Trees::serialize(entries);
+	string id = sha1_string(body);
+	if (!Objects::hasObject(objects_dir, id)) {
+		fs::path dst = FileSystemUtils::objectPath(objects_dir, id);
+		fs::create_directories(dst.parent_path());
+		LooseObject::write(dst, ObjectType::Tree, reinterpret_cast<const uint8_t *>(body.data()),
+						   body.size(), true);
+	}
+	return id;
+}
+
+bool readOrEmpty(const fs::path &objects_dir, const string &id, vector<TreeEntry> &entries) {
+	entries.clear();
+	return id.empty() || Trees::read(objects_dir, id, entries);
+}
+
+bool diffTrees(const fs::path &objects_dir, const string &old_id, const string &new_id,
+			   const string &prefix, const Trees::DiffCallback &fn) {
+	if (old_id == new_id)
+		return true;
+	vector<TreeEntry> old_entries, new_entries;
+	if (!readOrEmpty(objects_dir, old_id, old_entries) ||
+		!readOrEmpty(objects_dir, new_id, new_entries))
+		return false;
+
+	// 一侧的条目相对空树比较
+	auto one_side = [&](const TreeEntry &e, bool is_old) {
+		string path = joinPath(prefix, e.name);
+		if (e.is_tree)
+			return is_old ? diffTrees(objects_dir, e.id, "", path, fn)
+						  : diffTrees(objects_dir, "", e.id, path, fn);
+		if (is_old)
+			fn(path, e.id, "");
+		else
+			fn(path, "", e.id);
+		return true;
+	};
+
+	size_t i = 0, j = 0;
+	while (i < old_entries.size() || j < new_entries.size()) {
+		int c = i == old_entries.size()	  ? 1
+				: j == new_entries.size() ? -1
+										  : old_entries[i].name.compare(new_entries[j].name);
+		if (c < 0) {
+			if (!one_side(old_entries[i++], true))
+				return false;
+		} else if (c > 0) {
+			if (!one_side(new_entries[j++], false))
+				return false;
+		} else {
+			const TreeEntry &o = old_entries[i++];
+			const TreeEntry &n = new_entries[j++];
+			if (o.id == n.id && o.is_tree == n.is_tree)
+				continue;
+			if (o.is_tree && n.is_tree) {
+				if (!diffTrees(objects_dir, o.id, n.id, joinPath(prefix, n.name), fn))
+					return false;
+			} else if (!o.is_tree && !n.is_tree) {
+				fn(joinPath(prefix, n.name), o.id, n.id);
+			} else {
+				// 文件和目录互相替换：分别作为删除和新增处理
+				if (!one_side(o, true) || !one_side(n, false))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+} // namespace
+
+string Trees::serialize(const vector<TreeEntry> &entries) {
+	size_t size = sizeof(TREE_MAGIC) + 4;
+	for (const auto &e : entries)
+		size += 1 + 4 + e.name.size() + 20;
+
+	string s;
+	s.reserve(size);
+	s.append(TREE_MAGIC, sizeof(TREE_MAGIC));
+	uint32_t count = static_cast<uint32_t>(entries.size());
+	s.append(reinterpret_cast<const char *>(&count), sizeof(count));
+	unsigned char raw[20];
+	for (const auto &e : entries) {
+		if (!sha1_from_hex(e.id, raw))
+			throw runtime_error("Invalid object id in tree: " + e.id);
+		s.push_back(static_cast<char>(e.is_tree ? TREE_ENTRY_TREE : TREE_ENTRY_BLOB));
+		uint32_t len = static_cast<uint32_t>(e.name.size());
+		s.append(reinterpret_cast<const char *>(&len), sizeof(len));
+		s.append(e.name);
+		s.append(reinterpret_cast<const char *>(raw), 20);
+	}
+	return s;
+}
+
+bool Trees::parse(string_view body, vector<TreeEntry> &entries) {
+	entries.clear();
+	if (body.size() < sizeof(TREE_MAGIC) + 4 ||
+		memcmp(body.data(), TREE_MAGIC, sizeof(TREE_MAGIC)) != 0)
+		return false;
+	uint32_t count;
+	memcpy(&count, body.data() + sizeof(TREE_MAGIC), sizeof(count));
+	body.remove_prefix(sizeof(TREE_MAGIC) + 4);
+
+	entries.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t len;
+		if (body.size() < 1 + sizeof(len))
+			return false;
+		uint8_t kind = static_cast<uint8_t>(body[0]);
+		memcpy(&len, body.data() + 1, sizeof(len));
+		body.remove_prefix(1 + sizeof(len));
+		if (body.size() < (size_t)len + 20)
+			return false;
+
+		TreeEntry e;
+		e.name.assign(body.substr(0, len));
+		e.id = sha1_to_hex(reinterpret_cast<const unsigned char *>(body.data() + len));
+		e.is_tree = kind == TREE_ENTRY_TREE;
+		entries.push_back(std::move(e));
+		body.remove_prefix(len + 20);
+	}
+	return true;
+}
+
+bool Trees::read(const fs::path &objects_dir, const string &id, vector<TreeEntry> &entries) {
+	vector<uint8_t> data;
+	if (!Objects::readObject(objects_dir, id, data))
+		return false;
+	return parse(string_view(reinterpret_cast<const char *>(data.data()), data.size()), entries);
+}
+
+string Trees::store(const fs::path &objects_dir, const map<string, string> &files) {
+	return storeRange(objects_dir, files.begin(), files.end(), 0);
+}
+
+bool Trees::flatten(const fs::path &objects_dir, const string &root, map<string, string> &files) {
+	files.clear();
+	return diff(objects_dir, "", root,
+				[&files](const string &path, const string &, const string &id) {
+					files.emplace(path, id);
+				});
+}
+
+bool Trees::diff(const fs::path &objects_dir, const string &old_root, const string &new_root,
+				 const DiffCallback &fn) {
+	return diffTrees(objects_dir, old_root, new_root, "", fn);
+}
+
+bool Trees::newObjects(const fs::path &objects_dir, const string &old_root,
+					   const string &new_root, vector<string> &ids) {
+	if (new_root.empty() || old_root == new_root)
+		return true;
+	vector<TreeEntry> old_entries, new_entries;
+	if (!readOrEmpty(objects_dir, old_root, old_entries) ||
+		!readOrEmpty(objects_dir, new_root, new_entries))
+		return false;
+
+	ids.push_back(new_root);
+	map<string, const TreeEntry *> old_by_name;
+	for (const auto &e : old_entries)
+		old_by_name.emplace(e.name, &e);
+
+	for (const auto &e : new_entries) {
+		auto it = old_by_name.find(e.name);
+		const TreeEntry *o = it == old_by_name.end() ? nullptr : it->second;
+		if (o && o->id == e.id)
+			continue;
+		if (!e.is_tree) {
+			ids.push_back(e.id);
+		} else if (!newObjects(objects_dir, o && o->is_tree ? o->id : "", e.id, ids)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+#include <functional>
+#include <string_view>
+
+/**
+ * 树对象中的一项：文件（blob）或子目录（tree）
+ */
+struct TreeEntry {
+	string name;
+	string id;
+	bool is_tree = false;
+};
+
+/**
+ * 分层树对象
+ * 每个目录一个树对象："MGT" + 版本(1字节) + u32条目数
+ *   + 每个条目：类型(1字节，1=blob 2=tree) + u32名称长度 + 名称 + 20字节对象哈希（按名称排序）
+ * 内容相同的子目录得到相同的哈希，提交之间未变化的子树自然共享，
+ * 比较两棵树时只需要进入哈希不同的子树
+ */
+class Trees {
+public:
+	// old_id 为空表示新增，new_id 为空表示删除
+	using DiffCallback =
+		function<void(const string &path, const string &old_id, const string &new_id)>;
+
+	/**
+	 * 把扁平的 路径 -> blob哈希 映射写成树对象，返回根树哈希
+	 * 已经存在的树对象（未变化的子目录）不会重复写入
+	 */
+	static string store(const fs::path &objects_dir, const map<string, string> &files);
+
+	static string serialize(const vector<TreeEntry> &entries);
+	static bool parse(string_view body, vector<TreeEntry> &entries);
+	static bool read(const fs::path &objects_dir, const string &id, vector<TreeEntry> &entries);
+
+	// 展开成扁平的 路径 -> blob哈希 映射
+	static bool flatten(const fs::path &objects_dir, const string &root, map<string, string> &files);
+
+	// 比较两棵树，只进入哈希不同的子树；树不存在时传空字符串
+	static bool diff(const fs::path &objects_dir, const string &old_root, const string &new_root,
+					 const DiffCallback &fn);
+
+	/**
+	 * 收集 new_root 中相对 old_root 新出现的对象（变化的树对象和blob），用于传输
+	 * old_root 为空时收集整棵树
+	 */
+	static bool newObjects(const fs::path &objects_dir, const string &old_root,
+						   const string &new_root, vector<string> &ids);
+};
@@ -0,0 +1,120 @@
+#include "working_tree.h"
+#include "filesystem_utils.h"
+#include "sha256.h"
+#include "thread_pool.h"
+
+namespace {
+// 每个哈希任务处理的文件数，足够大以便批量SHA-1接口填满多路计算
+constexpr size_t HASH_GRAIN = 32;
+// 每个stat任务处理的文件数
+constexpr size_t STAT_GRAIN = 256;
+} // namespace
+
+vector<string> WorkingTree::scan(const fs::path &dir) {
+	auto &fsu = FileSystemUtils::getInstance();
+
+	string base;
+	try {
+		base = fs::relative(dir, fsu.repoRoot()).generic_string();
+	} catch (const fs::filesystem_error &) {
+		base.clear();
+	}
+	if (base == ".")
+		base.clear();
+
+	mutex files_mutex;
+	vector<string> files;
+	TaskGroup group;
+
+	// 相对路径通过拼接父目录前缀得到，避免对每个文件调用 fs::relative
+	function<void(const fs::path &, const string &)> visit = [&](const fs::path &d,
+																   const string &prefix) {
+		vector<string> local;
+		error_code ec;
+		fs::directory_iterator it(d, fs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+			const fs::directory_entry &entry = *it;
+			if (fsu.isIgnored(entry.path()))
+				continue;
+
+			string name = entry.path().filename().generic_string();
+			string rel = prefix.empty() ? name : prefix + "/" + name;
+
+			// 静默忽略单个文件的错误（比如权限问题）
+			error_code sec;
+			if (entry.is_directory(sec) && !entry.is_symlink(sec)) {
+				fs::path child = entry.path();
+				group.spawn([&visit, child, rel]() { visit(child, rel); });
+			} else if (entry.is_regular_file(sec)) {
+				local.push_back(std::move(rel));
+			}
+		}
+
+		if (!local.empty()) {
+			lock_guard<mutex> lock(files_mutex);
+			files.insert(files.end(), make_move_iterator(local.begin()),
+						 make_move_iterator(local.end()));
+		}
+	};
+
+	group.spawn([&]() { visit(dir, base); });
+	group.wait();
+
+	// 任务完成顺序不确定，排序后保证结果稳定
+	sort(files.begin(), files.end());
+	return files;
+}
+
+vector<string> WorkingTree::hashFiles(const vector<fs::path> &paths) {
+	vector<string> hashes(paths.size());
+	parallelFor(paths.size(), HASH_GRAIN, [&](size_t begin, size_t end) {
+		vector<fs::path> chunk(paths.begin() + begin, paths.begin() + end);
+		vector<string> chunk_hashes = sha1_files(chunk);
+		for (size_t i = 0; i < chunk_hashes.size(); ++i) {
+			hashes[begin + i] = std::move(chunk_hashes[i]);
+		}
+	});
+	return hashes;
+}
+
+vector<string> WorkingTree::hashWithIndex(const vector<string> &rel_paths, const IndexFile &index,
+										  Index::Changes &refreshed) {
+	fs::path root = FileSystemUtils::getInstance().repoRoot();
+	vector<string> hashes(rel_paths.size());
+	vector<FileStat> stats(rel_paths.size());
+	vector<char> stat_ok(rel_paths.size(), 0);
+	vector<size_t> tracked(rel_paths.size(), IndexFile::npos);
+
+	// 只对暂存区中有记录的文件取stat，未跟踪的文件总是需要计算哈希
+	parallelFor(rel_paths.size(), STAT_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			tracked[i] = index.find(rel_paths[i]);
+			if (tracked[i] != IndexFile::npos)
+				stat_ok[i] = FileSystemUtils::statFile(root / rel_paths[i], stats[i]) ? 1 : 0;
+		}
+	});
+
+	vector<size_t> dirty;
+	vector<fs::path> dirty_paths;
+	for (size_t i = 0; i < rel_paths.size(); ++i) {
+		if (tracked[i] != IndexFile::npos && stat_ok[i] &&
+			Index::isUpToDate(index, tracked[i], stats[i])) {
+			hashes[i] = index.sha(tracked[i]);
+		} else {
+			dirty.push_back(i);
+			dirty_paths.push_back(root / rel_paths[i]);
+		}
+	}
+
+	vector<string> dirty_hashes = hashFiles(dirty_paths);
+	for (size_t k = 0; k < dirty.size(); ++k) {
+		size_t i = dirty[k];
+		hashes[i] = std::move(dirty_hashes[k]);
+		// 内容未变但stat变化（例如touch过），记录新的stat以便下次跳过
+		if (tracked[i] != IndexFile::npos && stat_ok[i] && !hashes[i].empty() &&
+			hashes[i] == index.sha(tracked[i])) {
+			refreshed[rel_paths[i]] = Index::Entry{hashes[i], stats[i]};
+		}
+	}
+	return hashes;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "index.h"
+
+/**
+ * 工作目录扫描与哈希工具类
+ * 目录遍历和文件哈希都通过共享线程池并行执行，结果顺序与线程调度无关
+ */
+class WorkingTree {
+public:
+	/**
+	 * 递归扫描目录，返回相对于仓库根目录的文件路径（按字典序排序）
+	 * 每个子目录作为一个独立任务，由空闲线程窃取执行
+	 */
+	static vector<string> scan(const fs::path &dir);
+
+	/**
+	 * 并行计算一组文件的哈希，结果与输入一一对应
+	 * 不存在或不是常规文件的路径对应空字符串
+	 */
+	static vector<string> hashFiles(const vector<fs::path> &paths);
+
+	/**
+	 * 计算工作目录文件（相对路径）的哈希，stat信息与暂存区记录一致的文件直接复用暂存区中的哈希
+	 * 重新计算后内容与暂存区一致的条目需要刷新stat信息，这些条目写入 refreshed，
+	 * 调用方通过 Index::update 写回
+	 */
+	static vector<string> hashWithIndex(const vector<string> &rel_paths, const IndexFile &index,
+										Index::Changes &refreshed);
+};